@@ -0,0 +1,178 @@
+#include "Aref.hpp"
+#include "test_config.h"
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace GDSTXT {
+
+namespace {
+
+bool _fits(int64_t value) noexcept
+{
+  return value >= std::numeric_limits<int32_t>::min() && value <= std::numeric_limits<int32_t>::max();
+}
+
+int32_t _round(double value) noexcept
+{
+  auto rounded = std::llround(value);
+  if (rounded > std::numeric_limits<int32_t>::max())
+    return std::numeric_limits<int32_t>::max();
+  if (rounded < std::numeric_limits<int32_t>::min())
+    return std::numeric_limits<int32_t>::min();
+  return static_cast<int32_t>(rounded);
+}
+
+// start, start + step, start + 2 * step ... into out[0, count)
+void _arithmetic(int32_t start, int32_t step, int32_t count, int32_t* out) noexcept
+{
+  int32_t i = 0;
+#if defined(__SSE2__)
+  // lanes only ever hold values inside the row, the add wraps past its end
+  if (count >= 4) {
+    auto lanes = _mm_setr_epi32(start, static_cast<int32_t>(start + static_cast<int64_t>(step)),
+      static_cast<int32_t>(start + 2 * static_cast<int64_t>(step)),
+      static_cast<int32_t>(start + 3 * static_cast<int64_t>(step)));
+    auto stride = _mm_set1_epi32(static_cast<int32_t>(static_cast<uint32_t>(step) * 4));
+    for (; i + 4 <= count; i += 4) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), lanes);
+      lanes = _mm_add_epi32(lanes, stride);
+    }
+  }
+#endif
+  for (; i < count; ++i)
+    out[i] = static_cast<int32_t>(start + static_cast<int64_t>(i) * step);
+}
+
+}
+
+ArefLattice::ArefLattice(const Element& aref)
+{
+  if (aref.xy.size() < 3 || aref.columns <= 0 || aref.rows <= 0)
+    throw std::runtime_error("AREF of " + aref.sname + " is corrupted");
+  _columns = aref.columns;
+  _rows = aref.rows;
+  _x = aref.xy[0].x;
+  _y = aref.xy[0].y;
+  _column_x = static_cast<int64_t>(aref.xy[1].x) - _x;
+  _column_y = static_cast<int64_t>(aref.xy[1].y) - _y;
+  _row_x = static_cast<int64_t>(aref.xy[2].x) - _x;
+  _row_y = static_cast<int64_t>(aref.xy[2].y) - _y;
+
+  _exact = _column_x % _columns == 0 && _column_y % _columns == 0
+    && _row_x % _rows == 0 && _row_y % _rows == 0;
+  if (_exact) {
+    // origins are linear in column and row, the corners bound them all
+    auto last_column = _columns - 1;
+    auto last_row = _rows - 1;
+    for (int corner = 0; corner < 4; ++corner) {
+      int64_t column = (corner & 1) ? last_column : 0;
+      int64_t row = (corner & 2) ? last_row : 0;
+      _exact = _exact
+        && _fits(_x + column * (_column_x / _columns) + row * (_row_x / _rows))
+        && _fits(_y + column * (_column_y / _columns) + row * (_row_y / _rows));
+    }
+  }
+}
+
+uint64_t ArefLattice::count() const noexcept
+{
+  return static_cast<uint64_t>(_columns) * static_cast<uint64_t>(_rows);
+}
+
+Point ArefLattice::origin(int32_t column, int32_t row) const noexcept
+{
+  if (_exact) {
+    return Point {
+      static_cast<int32_t>(_x + column * (_column_x / _columns) + row * (_row_x / _rows)),
+      static_cast<int32_t>(_y + column * (_column_y / _columns) + row * (_row_y / _rows))
+    };
+  }
+  auto start_x = _x + row * (static_cast<double>(_row_x) / _rows);
+  auto start_y = _y + row * (static_cast<double>(_row_y) / _rows);
+  return Point {
+    _round(start_x + column * (static_cast<double>(_column_x) / _columns)),
+    _round(start_y + column * (static_cast<double>(_column_y) / _columns))
+  };
+}
+
+void ArefLattice::row(int32_t row, int32_t* x, int32_t* y) const noexcept
+{
+  if (_exact) {
+    auto start_x = _x + row * (_row_x / _rows);
+    auto start_y = _y + row * (_row_y / _rows);
+    _arithmetic(static_cast<int32_t>(start_x), static_cast<int32_t>(_column_x / _columns), _columns, x);
+    _arithmetic(static_cast<int32_t>(start_y), static_cast<int32_t>(_column_y / _columns), _columns, y);
+    return;
+  }
+
+  // off-grid pitch, same rounding the flattener applies to points
+  auto column_x = static_cast<double>(_column_x) / _columns;
+  auto column_y = static_cast<double>(_column_y) / _columns;
+  auto start_x = _x + row * (static_cast<double>(_row_x) / _rows);
+  auto start_y = _y + row * (static_cast<double>(_row_y) / _rows);
+  for (int32_t column = 0; column < _columns; ++column) {
+    x[column] = _round(start_x + column * column_x);
+    y[column] = _round(start_y + column * column_y);
+  }
+}
+
+void ArefLattice::expand(std::vector<int32_t>& x, std::vector<int32_t>& y) const
+{
+  auto offset = x.size();
+  x.resize(offset + count());
+  y.resize(offset + count());
+  for (int32_t i = 0; i < _rows; ++i)
+    row(i, &x[offset + static_cast<std::size_t>(i) * _columns], &y[offset + static_cast<std::size_t>(i) * _columns]);
+}
+
+uint64_t instance_count(const Element& element)
+{
+  if (element.kind == ElementKind::sref)
+    return 1;
+  if (element.kind == ElementKind::aref)
+    return ArefLattice(element).count();
+  return 0;
+}
+
+TEST_CASE("testing ArefLattice") {
+  Element aref;
+  aref.reset(ElementKind::aref);
+  aref.columns = 5;
+  aref.rows = 2;
+  std::vector<int32_t> x, y;
+
+  SUBCASE("rotated lattice on grid") {
+    aref.xy = {{100, 0}, {100, 50}, {80, 0}};
+    ArefLattice lattice(aref);
+    CHECK(lattice.count() == 10);
+    lattice.expand(x, y);
+    REQUIRE(x.size() == 10);
+    CHECK(x[4] == 100);
+    CHECK(y[4] == 40);
+    CHECK(x[5] == 90);
+    CHECK(y[9] == 40);
+    CHECK(lattice.origin(4, 1).x == x[9]);
+  }
+  SUBCASE("off-grid pitch rounds like a transformed point") {
+    aref.xy = {{0, 0}, {7, 0}, {0, 3}};
+    ArefLattice(aref).expand(x, y);
+    CHECK(x[1] == 1);
+    CHECK(x[3] == 4);
+    CHECK(y[5] == 2);
+    CHECK(ArefLattice(aref).origin(3, 1).x == x[8]);
+  }
+  SUBCASE("should count without expanding and reject corrupted AREF") {
+    aref.columns = 32767;
+    aref.rows = 32767;
+    aref.xy = {{0, 0}, {32767, 0}, {0, 32767}};
+    CHECK(instance_count(aref) == 32767ULL * 32767ULL);
+    aref.xy.pop_back();
+    CHECK_THROWS_AS(instance_count(aref), std::exception);
+  }
+}
+
+}
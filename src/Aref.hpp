@@ -0,0 +1,41 @@
+#ifndef __AREF__H__
+#define __AREF__H__
+
+#include <vector>
+#include <cstdint>
+#include "Element.hpp"
+
+namespace GDSTXT {
+
+// instance origins of an AREF:
+//   origin + column * (p1 - p0) / columns + row * (p2 - p0) / rows
+// with p0, p1, p2 its three XY points
+class ArefLattice {
+  public:
+    // throws when the AREF has no COLROW or fewer than three points
+    explicit ArefLattice(const Element& aref);
+    // columns * rows, nothing is generated
+    uint64_t count() const noexcept;
+    int32_t columns() const noexcept { return _columns; }
+    int32_t rows() const noexcept { return _rows; }
+    // one origin, rounded the same way row() does
+    Point origin(int32_t column, int32_t row) const noexcept;
+    // columns() origins of one row into x[] and y[]
+    void row(int32_t row, int32_t* x, int32_t* y) const noexcept;
+    // every origin, row after row, appended to x and y
+    void expand(std::vector<int32_t>& x, std::vector<int32_t>& y) const;
+  private:
+    int64_t _x, _y;
+    int64_t _column_x, _column_y;
+    int64_t _row_x, _row_y;
+    int32_t _columns, _rows;
+    // steps divide evenly and every origin fits in int32
+    bool _exact;
+};
+
+// instances an AREF places, 1 for SREF, 0 for anything else
+uint64_t instance_count(const Element& element);
+
+}
+
+#endif //__AREF__H__
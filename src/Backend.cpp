@@ -0,0 +1,565 @@
+#include "Backend.hpp"
+#include "HugePages.hpp"
+#include "config.h"
+#include "test_config.h"
+#include "test_fixtures.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#ifdef GDSTXT_HAVE_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+namespace GDSTXT {
+namespace IO {
+
+namespace {
+
+// posix_memalign'd, or on huge pages when asked for and at least one
+// huge page big, a smaller buffer would only grow
+class AlignedBuffer {
+  public:
+    AlignedBuffer(std::size_t size, std::size_t alignment, bool huge_pages)
+      : _heap(nullptr, &std::free)
+    {
+      if (huge_pages && size >= huge_page_size) {
+        _huge = HugeBuffer(size);
+        return;
+      }
+      void* ptr = nullptr;
+      if (posix_memalign(&ptr, std::max(alignment, sizeof(void*)), std::max<std::size_t>(size, 1)) != 0)
+        throw std::runtime_error("failed to allocate io buffer");
+      _heap.reset(static_cast<char*>(ptr));
+    }
+    char* get() const noexcept { return _huge.data() != nullptr ? _huge.data() : _heap.get(); }
+  private:
+    std::unique_ptr<char, decltype(&std::free)> _heap;
+    HugeBuffer _huge;
+};
+
+AlignedBuffer _aligned_alloc(std::size_t size, std::size_t alignment, bool huge_pages)
+{
+  return AlignedBuffer(size, alignment, huge_pages);
+}
+
+std::size_t _pread_full(int fd, unsigned char* dst, std::size_t size, uint64_t offset)
+{
+  std::size_t done = 0;
+  while (done < size) {
+    auto ret = ::pread(fd, dst + done, size - done, offset + done);
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      throw std::runtime_error(std::string("read failed: ") + std::strerror(errno));
+    }
+    if (ret == 0)
+      break;
+    done += static_cast<std::size_t>(ret);
+  }
+  return done;
+}
+
+void _pwrite_full(int fd, const char* data, std::size_t size, uint64_t offset)
+{
+  while (size > 0) {
+    auto ret = ::pwrite(fd, data, size, offset);
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      throw std::runtime_error(std::string("write failed: ") + std::strerror(errno));
+    }
+    data += ret;
+    offset += ret;
+    size -= static_cast<std::size_t>(ret);
+  }
+}
+
+void _write_full(int fd, const char* data, std::size_t size)
+{
+  while (size > 0) {
+    auto ret = ::write(fd, data, size);
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      throw std::runtime_error(std::string("write failed: ") + std::strerror(errno));
+    }
+    data += ret;
+    size -= static_cast<std::size_t>(ret);
+  }
+}
+
+}
+
+///////////////////////////////////////////
+
+#ifdef GDSTXT_HAVE_IO_URING
+
+bool Uring::available() noexcept
+{
+  try {
+    Uring probe(1);
+    return true;
+  } catch (const std::exception&) {
+    return false;
+  }
+}
+
+Uring::Uring(unsigned entries)
+  : _ring_fd(-1), _sq_ptr(MAP_FAILED), _sq_size(0), _cq_ptr(MAP_FAILED), _cq_size(0),
+    _sqes(MAP_FAILED), _sqes_size(0), _to_submit(0)
+{
+  io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  _ring_fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+  if (_ring_fd < 0)
+    throw std::runtime_error(std::string("io_uring_setup failed: ") + std::strerror(errno));
+
+  _entries = params.sq_entries;
+  _sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  _cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap)
+    _sq_size = _cq_size = std::max(_sq_size, _cq_size);
+
+  _sq_ptr = ::mmap(nullptr, _sq_size, PROT_READ | PROT_WRITE,
+    MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQ_RING);
+  if (_sq_ptr == MAP_FAILED) {
+    ::close(_ring_fd);
+    throw std::runtime_error("failed to map io_uring submission ring");
+  }
+  if (single_mmap) {
+    _cq_ptr = _sq_ptr;
+  } else {
+    _cq_ptr = ::mmap(nullptr, _cq_size, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_CQ_RING);
+  }
+  _sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+  _sqes = ::mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE,
+    MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQES);
+  if (_cq_ptr == MAP_FAILED || _sqes == MAP_FAILED) {
+    if (_cq_ptr != MAP_FAILED && _cq_ptr != _sq_ptr)
+      ::munmap(_cq_ptr, _cq_size);
+    ::munmap(_sq_ptr, _sq_size);
+    ::close(_ring_fd);
+    throw std::runtime_error("failed to map io_uring rings");
+  }
+
+  auto sq = static_cast<char*>(_sq_ptr);
+  _sq_head  = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+  _sq_tail  = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  _sq_mask  = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  _sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+  auto cq = static_cast<char*>(_cq_ptr);
+  _cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  _cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  _cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  _cqes = cq + params.cq_off.cqes;
+}
+
+void* Uring::_prepare(
+  unsigned char opcode, int fd, uint64_t addr, unsigned len, uint64_t offset, uint64_t user_data)
+{
+  unsigned tail = *_sq_tail;
+  if (tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE) >= _entries)
+    throw std::runtime_error("io_uring submission queue is full");
+
+  unsigned index = tail & *_sq_mask;
+  auto sqe = static_cast<io_uring_sqe*>(_sqes) + index;
+  std::memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->addr = addr;
+  sqe->len = len;
+  sqe->off = offset;
+  sqe->user_data = user_data;
+  _sq_array[index] = index;
+  __atomic_store_n(_sq_tail, tail + 1, __ATOMIC_RELEASE);
+  ++_to_submit;
+  return sqe;
+}
+
+void Uring::prepare_read(int fd, void* buf, unsigned len, uint64_t offset, uint64_t user_data)
+{
+  _prepare(IORING_OP_READ, fd, reinterpret_cast<uint64_t>(buf), len, offset, user_data);
+}
+
+void Uring::prepare_write(int fd, const void* buf, unsigned len, uint64_t offset, uint64_t user_data)
+{
+  _prepare(IORING_OP_WRITE, fd, reinterpret_cast<uint64_t>(buf), len, offset, user_data);
+}
+
+void Uring::submit()
+{
+  while (_to_submit > 0) {
+    auto ret = ::syscall(__NR_io_uring_enter, _ring_fd, _to_submit, 0, 0, nullptr, 0);
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      throw std::runtime_error(std::string("io_uring_enter failed: ") + std::strerror(errno));
+    }
+    _to_submit -= static_cast<unsigned>(ret);
+  }
+}
+
+Uring::Completion Uring::wait()
+{
+  submit();
+  while (true) {
+    unsigned head = *_cq_head;
+    if (head != __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE)) {
+      auto cqe = static_cast<io_uring_cqe*>(_cqes) + (head & *_cq_mask);
+      Completion ret {cqe->user_data, cqe->res};
+      __atomic_store_n(_cq_head, head + 1, __ATOMIC_RELEASE);
+      return ret;
+    }
+    auto ret = ::syscall(__NR_io_uring_enter, _ring_fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+    if (ret < 0 && errno != EINTR)
+      throw std::runtime_error(std::string("io_uring_enter failed: ") + std::strerror(errno));
+  }
+}
+
+Uring::~Uring()
+{
+  ::munmap(_sqes, _sqes_size);
+  if (_cq_ptr != _sq_ptr)
+    ::munmap(_cq_ptr, _cq_size);
+  ::munmap(_sq_ptr, _sq_size);
+  ::close(_ring_fd);
+}
+
+#else
+
+bool Uring::available() noexcept
+{
+  return false;
+}
+
+Uring::Uring(unsigned)
+{
+  throw std::runtime_error("built without io_uring support");
+}
+
+void Uring::prepare_read(int, void*, unsigned, uint64_t, uint64_t) {}
+void Uring::prepare_write(int, const void*, unsigned, uint64_t, uint64_t) {}
+void Uring::submit() {}
+Uring::Completion Uring::wait() { return Completion {0, -1}; }
+Uring::~Uring() {}
+
+#endif
+
+///////////////////////////////////////////
+
+namespace {
+
+class SyncInput: public InputSource {
+  public:
+    explicit SyncInput(int fd): _fd(fd) {}
+    std::size_t read(unsigned char* dst, std::size_t size) override
+    {
+      while (true) {
+        auto ret = ::read(_fd, dst, size);
+        if (ret >= 0)
+          return static_cast<std::size_t>(ret);
+        if (errno != EINTR)
+          throw std::runtime_error(std::string("read failed: ") + std::strerror(errno));
+      }
+    }
+  private:
+    int _fd;
+};
+
+// keeps queue_depth block reads in flight, blocks are consumed in file order
+class UringInput: public InputSource {
+  public:
+    UringInput(int fd, std::size_t block_size, unsigned queue_depth, bool huge_pages)
+      : _fd(fd), _ring(queue_depth), _block_size(block_size), _current(0),
+        _next_offset(0), _eof(false)
+    {
+      for (unsigned i = 0; i < queue_depth; ++i) {
+        _slots.emplace_back(_aligned_alloc(_block_size, 4096, huge_pages));
+        _submit(i);
+      }
+      _ring.submit();
+    }
+
+    std::size_t read(unsigned char* dst, std::size_t size) override
+    {
+      while (true) {
+        auto& slot = _slots[_current];
+        if (!slot.in_flight && !slot.ready)
+          return 0;
+        _wait_for(_current);
+        if (slot.consumed < slot.filled) {
+          auto count = std::min(size, slot.filled - slot.consumed);
+          std::memcpy(dst, slot.data.get() + slot.consumed, count);
+          slot.consumed += count;
+          return count;
+        }
+        slot.ready = false;
+        if (slot.filled < _block_size)
+          _eof = true;
+        if (_eof)
+          return 0;
+        _submit(_current);
+        _ring.submit();
+        _current = (_current + 1) % _slots.size();
+      }
+    }
+
+    ~UringInput() override
+    {
+      try {
+        for (std::size_t i = 0; i < _slots.size(); ++i)
+          _wait_for(i);
+      } catch (const std::exception&) {
+      }
+    }
+
+  private:
+    struct Slot {
+      explicit Slot(AlignedBuffer&& buffer): data(std::move(buffer)) {}
+      AlignedBuffer data;
+      uint64_t offset = 0;
+      std::size_t filled = 0;
+      std::size_t consumed = 0;
+      bool in_flight = false;
+      bool ready = false;
+    };
+
+    void _submit(std::size_t index)
+    {
+      auto& slot = _slots[index];
+      slot.offset = _next_offset;
+      slot.filled = slot.consumed = 0;
+      slot.in_flight = true;
+      slot.ready = false;
+      _next_offset += _block_size;
+      _ring.prepare_read(_fd, slot.data.get(), static_cast<unsigned>(_block_size), slot.offset, index);
+    }
+
+    void _wait_for(std::size_t index)
+    {
+      while (_slots[index].in_flight) {
+        auto completion = _ring.wait();
+        auto& slot = _slots[completion.user_data];
+        slot.in_flight = false;
+        slot.ready = true;
+        // short reads and kernels without IORING_OP_READ finish with pread
+        slot.filled = completion.res > 0 ? static_cast<std::size_t>(completion.res) : 0;
+        if (slot.filled < _block_size) {
+          auto buf = reinterpret_cast<unsigned char*>(slot.data.get());
+          slot.filled += _pread_full(
+            _fd, buf + slot.filled, _block_size - slot.filled, slot.offset + slot.filled);
+        }
+      }
+    }
+
+    int _fd;
+    Uring _ring;
+    std::size_t _block_size;
+    std::vector<Slot> _slots;
+    std::size_t _current;
+    uint64_t _next_offset;
+    bool _eof;
+};
+
+class SyncOutput: public OutputSink {
+  public:
+    SyncOutput(int fd, std::size_t buffer_size, std::size_t alignment, bool huge_pages)
+      : _fd(fd), _buffer(_aligned_alloc(buffer_size, alignment, huge_pages))
+    {}
+    char* buffer() override { return _buffer.get(); }
+    char* submit(std::size_t size) override
+    {
+      _write_full(_fd, _buffer.get(), size);
+      return _buffer.get();
+    }
+    void finish() override {}
+  private:
+    int _fd;
+    AlignedBuffer _buffer;
+};
+
+// rotates through queue_depth buffers, each one written asynchronously
+// while the formatter fills the next
+class UringOutput: public OutputSink {
+  public:
+    UringOutput(int fd, std::size_t buffer_size, unsigned queue_depth, std::size_t alignment, bool huge_pages)
+      : _fd(fd), _ring(queue_depth), _current(0), _offset(0)
+    {
+      for (unsigned i = 0; i < queue_depth; ++i) {
+        _buffers.emplace_back(_aligned_alloc(buffer_size, alignment, huge_pages));
+        _pending.push_back(0);
+        _offsets.push_back(0);
+      }
+    }
+
+    char* buffer() override { return _buffers[_current].get(); }
+
+    char* submit(std::size_t size) override
+    {
+      if (size > 0) {
+        _pending[_current] = size;
+        _offsets[_current] = _offset;
+        _ring.prepare_write(_fd, _buffers[_current].get(), static_cast<unsigned>(size), _offset, _current);
+        _ring.submit();
+        _offset += size;
+        _current = (_current + 1) % _buffers.size();
+      }
+      while (_pending[_current] > 0)
+        _complete_one();
+      return _buffers[_current].get();
+    }
+
+    void finish() override
+    {
+      while (std::any_of(_pending.begin(), _pending.end(), [](std::size_t i){ return i > 0; }))
+        _complete_one();
+    }
+
+    ~UringOutput() override
+    {
+      try {
+        finish();
+      } catch (const std::exception&) {
+      }
+    }
+
+  private:
+    void _complete_one()
+    {
+      auto completion = _ring.wait();
+      auto index = completion.user_data;
+      auto size = _pending[index];
+      _pending[index] = 0;
+      std::size_t done = completion.res > 0 ? static_cast<std::size_t>(completion.res) : 0;
+      if (completion.res < 0 && completion.res != -EINVAL && completion.res != -EOPNOTSUPP)
+        throw std::runtime_error(std::string("write failed: ") + std::strerror(-completion.res));
+      if (done < size)
+        _pwrite_full(_fd, _buffers[index].get() + done, size - done, _offsets[index] + done);
+    }
+
+    int _fd;
+    Uring _ring;
+    std::vector<AlignedBuffer> _buffers;
+    std::vector<std::size_t> _pending;
+    std::vector<uint64_t> _offsets;
+    std::size_t _current;
+    uint64_t _offset;
+};
+
+}
+
+std::unique_ptr<InputSource> make_input(
+  int fd, IOBackend backend, std::size_t block_size, unsigned queue_depth, bool huge_pages)
+{
+  if (backend == IOBackend::uring) {
+    try {
+      return std::unique_ptr<InputSource>(
+        new UringInput(fd, block_size, std::max(queue_depth, 1u), huge_pages));
+    } catch (const std::exception&) {
+    }
+  }
+  return std::unique_ptr<InputSource>(new SyncInput(fd));
+}
+
+std::unique_ptr<OutputSink> make_output(
+  int fd, IOBackend backend, std::size_t buffer_size, unsigned queue_depth,
+  std::size_t alignment, bool huge_pages)
+{
+  if (backend == IOBackend::uring) {
+    try {
+      return std::unique_ptr<OutputSink>(
+        new UringOutput(fd, buffer_size, std::max(queue_depth, 1u), alignment, huge_pages));
+    } catch (const std::exception&) {
+    }
+  }
+  return std::unique_ptr<OutputSink>(new SyncOutput(fd, buffer_size, alignment, huge_pages));
+}
+
+
+TEST_CASE("testing io_uring backend") {
+  if (!Uring::available())
+    return;
+  const std::size_t block = 4096;
+  TestDirectory directory;
+  auto read_all = [](const std::string& path, IOBackend backend, unsigned queue_depth, std::size_t step) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    REQUIRE(fd >= 0);
+    std::vector<unsigned char> data;
+    {
+      auto input = make_input(fd, backend, block, queue_depth);
+      std::vector<unsigned char> chunk(step);
+      while (auto count = input->read(chunk.data(), chunk.size()))
+        data.insert(data.end(), chunk.begin(), chunk.begin() + count);
+    }
+    ::close(fd);
+    return data;
+  };
+
+  // a short last block and a file that ends exactly on a block boundary
+  for (auto size : {block * 7 + 123, block * 4}) {
+    CAPTURE(size);
+    std::vector<char> expected(size);
+    for (std::size_t i = 0; i < size; ++i)
+      expected[i] = static_cast<char>(i * 131 + i / block);
+    auto path = directory.path("input_" + std::to_string(size));
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    REQUIRE(fd >= 0);
+    _write_full(fd, expected.data(), expected.size());
+    ::close(fd);
+
+    auto sync = read_all(path, IOBackend::sync, 1, 1000);
+    CHECK(std::string(sync.begin(), sync.end()) == std::string(expected.begin(), expected.end()));
+    // more blocks than queue_depth, so slots are recycled, and reads that
+    // straddle slot boundaries
+    for (unsigned queue_depth : {2u, 3u}) {
+      auto uring = read_all(path, IOBackend::uring, queue_depth, 1000);
+      CHECK(uring == sync);
+    }
+  }
+
+  SUBCASE("writes through queue_depth buffers in file order") {
+    auto path = directory.path("output");
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    REQUIRE(fd >= 0);
+    std::string expected;
+    {
+      auto output = make_output(fd, IOBackend::uring, block, 2, block);
+      auto buffer = output->buffer();
+      for (std::size_t i = 0; i < 9; ++i) {
+        auto size = i == 4 ? 0 : (i * 997) % block + 1;
+        for (std::size_t j = 0; j < size; ++j)
+          buffer[j] = static_cast<char>('a' + (i + j) % 26);
+        expected.append(buffer, size);
+        buffer = output->submit(size);
+      }
+      output->finish();
+    }
+    ::close(fd);
+    auto written = read_all(path, IOBackend::sync, 1, block);
+    CHECK(std::string(written.begin(), written.end()) == expected);
+  }
+
+  SUBCASE("failed completions throw") {
+    auto path = directory.path("input_" + std::to_string(block * 4));
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    REQUIRE(fd >= 0);
+    {
+      auto output = make_output(fd, IOBackend::uring, block, 2, block);
+      std::fill(output->buffer(), output->buffer() + 100, 'x');
+      output->submit(100);
+      CHECK_THROWS_AS(output->finish(), std::runtime_error);
+    }
+    ::close(fd);
+  }
+}
+
+}
+}
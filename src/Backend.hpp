@@ -0,0 +1,116 @@
+#ifndef __BACKEND__H__
+#define __BACKEND__H__
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace GDSTXT {
+namespace IO {
+
+enum class IOBackend {
+  sync,
+  uring
+};
+
+// how a file is going to be read, passed on to the kernel's readahead
+enum class AccessHint {
+  none,
+  // front to back: wider readahead, the next blocks asked for early
+  sequential,
+  // scattered reads: no readahead
+  random
+};
+
+// sequential byte source, read() returns 0 only at end of file
+class InputSource {
+  public:
+    virtual std::size_t read(unsigned char* dst, std::size_t size) = 0;
+    virtual ~InputSource() = default;
+};
+
+// sink owning the buffers it writes from, submit() hands over the first
+// size bytes of buffer() and returns the buffer to fill next
+class OutputSink {
+  public:
+    virtual char* buffer() = 0;
+    virtual char* submit(std::size_t size) = 0;
+    // wait until every submitted byte reached the file
+    virtual void finish() = 0;
+    virtual ~OutputSink() = default;
+};
+
+// staged bytes appended to a vector instead of a file
+class VectorSink: public OutputSink {
+  public:
+    VectorSink(std::vector<char>& data, std::size_t capacity) : _data(data), _buffer(capacity) {}
+    char* buffer() override { return _buffer.data(); }
+    char* submit(std::size_t size) override
+    {
+      _data.insert(_data.end(), _buffer.data(), _buffer.data() + size);
+      return _buffer.data();
+    }
+    void finish() override {}
+  private:
+    std::vector<char>& _data;
+    std::vector<char> _buffer;
+};
+
+// minimal io_uring wrapper over the raw syscalls, throws if the kernel
+// or the sandbox refuses io_uring_setup
+class Uring {
+  public:
+    struct Completion {
+      uint64_t user_data;
+      int32_t res;
+    };
+    static bool available() noexcept;
+    explicit Uring(unsigned entries);
+    Uring(const Uring&) = delete;
+    Uring& operator=(const Uring&) = delete;
+    void prepare_read(int fd, void* buf, unsigned len, uint64_t offset, uint64_t user_data);
+    void prepare_write(int fd, const void* buf, unsigned len, uint64_t offset, uint64_t user_data);
+    void submit();
+    Completion wait();
+    ~Uring();
+  private:
+    void* _prepare(unsigned char opcode, int fd, uint64_t addr, unsigned len, uint64_t offset, uint64_t user_data);
+
+    int _ring_fd;
+    void* _sq_ptr;
+    std::size_t _sq_size;
+    void* _cq_ptr;
+    std::size_t _cq_size;
+    void* _sqes;
+    std::size_t _sqes_size;
+    unsigned* _sq_head;
+    unsigned* _sq_tail;
+    unsigned* _sq_mask;
+    unsigned* _sq_array;
+    unsigned* _cq_head;
+    unsigned* _cq_tail;
+    unsigned* _cq_mask;
+    void* _cqes;
+    unsigned _entries;
+    unsigned _to_submit;
+};
+
+// block_size/buffer_size: bytes per read(2)/write(2) or per io_uring request
+// queue_depth: io_uring requests kept in flight ahead of the parser or
+//              behind the formatter, ignored by the sync backend
+// huge_pages: buffers of 2M or more on huge pages, see HugeBuffer
+// io_uring variants fall back to the sync ones when io_uring is unavailable
+std::unique_ptr<InputSource> make_input(
+  int fd, IOBackend backend, std::size_t block_size, unsigned queue_depth,
+  bool huge_pages = false);
+std::unique_ptr<OutputSink> make_output(
+  int fd, IOBackend backend, std::size_t buffer_size, unsigned queue_depth,
+  std::size_t alignment, bool huge_pages = false);
+
+
+}
+}
+
+#endif //__BACKEND__H__
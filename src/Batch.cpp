@@ -0,0 +1,206 @@
+#include "Batch.hpp"
+#include "Codec.hpp"
+#include "test_config.h"
+#include "test_fixtures.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <glob.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace GDSTXT {
+
+namespace {
+
+// whole file into data, keeping its capacity
+void _read_file(const std::string& filename, std::vector<unsigned char>& data)
+{
+  int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    throw std::runtime_error("Failed to open " + filename);
+  struct stat info;
+  if (::fstat(fd, &info) != 0) {
+    ::close(fd);
+    throw std::runtime_error("Failed to stat " + filename);
+  }
+  data.resize(static_cast<std::size_t>(info.st_size));
+  std::size_t done = 0;
+  while (done < data.size()) {
+    auto count = ::read(fd, data.data() + done, data.size() - done);
+    if (count <= 0) {
+      ::close(fd);
+      throw std::runtime_error("Failed to read " + filename);
+    }
+    done += static_cast<std::size_t>(count);
+  }
+  ::close(fd);
+}
+
+void _write_file(const std::string& filename, const void* data, std::size_t size)
+{
+  int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+    throw std::runtime_error("Failed to open " + filename);
+  auto first = static_cast<const char*>(data);
+  while (size > 0) {
+    auto count = ::write(fd, first, size);
+    if (count <= 0) {
+      ::close(fd);
+      throw std::runtime_error("Failed to write " + filename);
+    }
+    first += count;
+    size -= static_cast<std::size_t>(count);
+  }
+  if (::close(fd) != 0)
+    throw std::runtime_error("Failed to write " + filename);
+}
+
+uint64_t _file_size(const std::string& filename) noexcept
+{
+  struct stat info;
+  return ::stat(filename.c_str(), &info) == 0 ? static_cast<uint64_t>(info.st_size) : 0;
+}
+
+}
+
+std::vector<BatchJob> read_manifest(const std::string& filename)
+{
+  std::ifstream manifest(filename);
+  if (!manifest)
+    throw std::runtime_error("Failed to open " + filename);
+  std::vector<BatchJob> jobs;
+  std::string line;
+  for (std::size_t number = 1; std::getline(manifest, line); ++number) {
+    std::istringstream fields(line);
+    BatchJob job;
+    if (!(fields >> job.input) || job.input[0] == '#')
+      continue;
+    std::string extra;
+    if (!(fields >> job.output) || fields >> extra)
+      throw std::runtime_error(filename + ":" + std::to_string(number) + " needs an input and an output");
+    jobs.push_back(std::move(job));
+  }
+  return jobs;
+}
+
+std::vector<BatchJob> glob_jobs(const std::string& input_pattern, const std::string& output_pattern)
+{
+  auto star = output_pattern.find('*');
+  if (star == std::string::npos || output_pattern.find('*', star + 1) != std::string::npos)
+    throw std::runtime_error("output pattern " + output_pattern + " needs exactly one *");
+
+  glob_t matches;
+  auto result = ::glob(input_pattern.c_str(), 0, nullptr, &matches);
+  if (result != 0 && result != GLOB_NOMATCH) {
+    ::globfree(&matches);
+    throw std::runtime_error("Failed to expand " + input_pattern);
+  }
+  std::vector<BatchJob> jobs;
+  for (std::size_t i = 0; result == 0 && i < matches.gl_pathc; ++i) {
+    std::string input(matches.gl_pathv[i]);
+    auto slash = input.rfind('/');
+    auto name = input.substr(slash == std::string::npos ? 0 : slash + 1);
+    auto dot = name.rfind('.');
+    if (dot != std::string::npos && dot > 0)
+      name.erase(dot);
+    jobs.push_back(BatchJob {input, output_pattern.substr(0, star) + name + output_pattern.substr(star + 1)});
+  }
+  ::globfree(&matches);
+  return jobs;
+}
+
+BatchConverter::BatchConverter(Direction direction, unsigned threads, ThreadPool::Placement placement)
+  : _direction(direction), _pool(threads, placement), _scratch(_pool.size())
+{}
+
+std::vector<std::string> BatchConverter::run(const std::vector<BatchJob>& jobs)
+{
+  std::vector<uint64_t> sizes;
+  for (const auto& job : jobs)
+    sizes.push_back(_file_size(job.input));
+  std::vector<std::string> errors(jobs.size());
+  _pool.submit_largest_first(sizes, [this, &jobs, &errors](std::size_t i) -> ThreadPool::Task {
+    return [this, &jobs, &errors, i](unsigned worker) {
+      try {
+        _convert(jobs[i], _scratch[worker]);
+      } catch (const std::exception& e) {
+        errors[i] = e.what();
+      }
+    };
+  });
+  _pool.wait();
+  return errors;
+}
+
+void BatchConverter::_convert(const BatchJob& job, Scratch& scratch) const
+{
+  _read_file(job.input, scratch.input);
+  auto data = scratch.input.data();
+  auto size = scratch.input.size();
+
+  if (_direction == Direction::gds2txt) {
+    scratch.text.clear();
+    auto result = decode_batch(data, size, scratch.text);
+    if (result.status != Status::ok)
+      throw std::runtime_error("offset " + std::to_string(result.consumed) + ": " + status_message(result.status));
+    _write_file(job.output, scratch.text.data(), scratch.text.size());
+    return;
+  }
+
+  auto text = reinterpret_cast<const char*>(data);
+  std::size_t offset = 0;
+  std::size_t line = 1;
+  if (size >= 9 && std::memcmp(text, "#dialect:", 9) == 0) {
+    auto newline = static_cast<const char*>(std::memchr(text, '\n', size));
+    offset = newline == nullptr ? size : newline - text + 1;
+    std::string header(text + 9, text + offset);
+    while (!header.empty() && (header.back() == '\n' || header.back() == '\r' || header.back() == ' '))
+      header.pop_back();
+    if (header != "plain")
+      throw std::runtime_error(header + " text is not supported in batch mode");
+    line = 2;
+  }
+  scratch.gds.clear();
+  auto result = encode_batch(text + offset, size - offset, scratch.gds);
+  if (result.status != Status::ok)
+    throw std::runtime_error("line " + std::to_string(line + result.records) + ": " + status_message(result.status));
+  _write_file(job.output, scratch.gds.data(), scratch.gds.size());
+}
+
+TEST_CASE("testing BatchConverter") {
+  TestDirectory directory;
+  auto path = [&directory](const std::string& name) { return directory.path(name); };
+  std::string lines = "HEADER:600\nBGNLIB:1 2 3 4 5 6 1 2 3 4 5 6\nLIBNAME:LIB\nENDLIB\n";
+  _write_file(path("batch_0.txt"), lines.data(), lines.size());
+  std::string bad = "HEADER:600\nLIBNAME:LIB\nLAYER:one\n";
+  _write_file(path("batch_1.txt"), bad.data(), bad.size());
+  std::string manifest = "# input output\n" + path("batch_0.txt") + " " + path("batch_0.gds") + "\n\n"
+    + path("batch_1.txt") + " " + path("batch_1.gds") + "\n";
+  _write_file(path("batch.list"), manifest.data(), manifest.size());
+
+  auto jobs = read_manifest(path("batch.list"));
+  REQUIRE(jobs.size() == 2);
+  CHECK(jobs[1].output == path("batch_1.gds"));
+  auto globbed = glob_jobs(path("batch_?.txt"), path("*.gds"));
+  REQUIRE(globbed.size() == 2);
+  CHECK(globbed[0].input == jobs[0].input);
+  CHECK(globbed[0].output == jobs[0].output);
+
+  BatchConverter encode(BatchConverter::Direction::txt2gds, 2);
+  auto errors = encode.run(jobs);
+  CHECK(errors[0].empty());
+  CHECK(errors[1] == "line 3: value is not a number of the record's data type");
+
+  BatchConverter decode(BatchConverter::Direction::gds2txt, 2);
+  errors = decode.run({BatchJob {path("batch_0.gds"), path("batch_0.out")}});
+  CHECK(errors[0].empty());
+  std::vector<unsigned char> text;
+  _read_file(path("batch_0.out"), text);
+  CHECK(std::string(text.begin(), text.end()) == lines);
+}
+
+}
@@ -0,0 +1,53 @@
+#ifndef __BATCH__H__
+#define __BATCH__H__
+
+#include <string>
+#include <vector>
+#include "ThreadPool.hpp"
+
+namespace GDSTXT {
+
+struct BatchJob {
+  std::string input;
+  std::string output;
+};
+
+// "input output" per line, blank lines and lines starting with # skipped
+std::vector<BatchJob> read_manifest(const std::string& filename);
+
+// every file matching input_pattern, the output named by output_pattern
+// with its one * replaced by the input file name without extension
+std::vector<BatchJob> glob_jobs(const std::string& input_pattern, const std::string& output_pattern);
+
+// Plain text conversion of many files in one process, either direction.
+// Jobs run on a work-stealing pool, largest input first on every worker,
+// each file read and converted whole in buffers the worker keeps across
+// files, with one status check per file through the codec of Codec.hpp.
+// The scratch buffers grow on the worker that uses them, on its own node
+// when the pool is placed with ThreadPool::Placement::numa.
+class BatchConverter {
+  public:
+    enum class Direction {
+      gds2txt,
+      txt2gds
+    };
+    BatchConverter(Direction direction, unsigned threads = default_thread_count(),
+                   ThreadPool::Placement placement = ThreadPool::Placement::any);
+    // message per job, empty for the ones that converted
+    std::vector<std::string> run(const std::vector<BatchJob>& jobs);
+  private:
+    struct Scratch {
+      std::vector<unsigned char> input;
+      std::vector<char> text;
+      std::vector<unsigned char> gds;
+    };
+    void _convert(const BatchJob& job, Scratch& scratch) const;
+
+    Direction _direction;
+    ThreadPool _pool;
+    std::vector<Scratch> _scratch;
+};
+
+}
+
+#endif //__BATCH__H__
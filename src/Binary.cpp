@@ -0,0 +1,301 @@
+#include "Binary.hpp"
+#include "SPEC.hpp"
+#include "convert_func.hpp"
+#include "test_config.h"
+#include "test_fixtures.h"
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace GDSTXT {
+namespace IO {
+
+namespace {
+
+const char binary_magic[8] = {'G', 'D', 'S', 'T', 'X', 'T', 'B', '\0'};
+
+std::size_t _value_width(unsigned char data_type)
+{
+  switch (static_cast<SPEC::TagDataType>(data_type)) {
+    case SPEC::TagDataType::BITARRAY:
+    case SPEC::TagDataType::INTEGER_2:
+      return 2;
+    case SPEC::TagDataType::INTEGER_4:
+      return 4;
+    case SPEC::TagDataType::REAL_8:
+      return 8;
+    default:
+      return 1;
+  }
+}
+
+std::size_t _padding(uint64_t size, std::size_t alignment)
+{
+  return static_cast<std::size_t>((alignment - size % alignment) % alignment);
+}
+
+}
+
+BinaryFile::BinaryFile(const std::string& filename)
+  : _file(filename)
+{
+  if (_file.size() < sizeof(BinaryHeader))
+    throw std::runtime_error(filename + " is not a binary gds dump");
+
+  BinaryHeader header;
+  std::memcpy(&header, _file.data(), sizeof(header));
+  if (std::memcmp(header.magic, binary_magic, sizeof(binary_magic)) != 0)
+    throw std::runtime_error(filename + " is not a binary gds dump");
+  if (header.version != binary_version)
+    throw std::runtime_error(filename + " has unsupported version " + std::to_string(header.version));
+  if (header.byte_order != binary_byte_order)
+    throw std::runtime_error(filename + " was written with a different byte order");
+
+  // sections in file order, each column has to end before the next one
+  // starts and the last one before the end of the file; differences only,
+  // nothing here can overflow
+  uint64_t size = _file.size();
+  uint64_t count = header.record_count;
+  if (header.payload_offset < sizeof(BinaryHeader) || header.payload_offset > header.tags_offset
+      || header.tags_offset > header.types_offset || header.types_offset > header.lengths_offset
+      || header.lengths_offset > header.offsets_offset
+      || header.payload_offset % 8 != 0 || header.lengths_offset % 4 != 0 || header.offsets_offset % 8 != 0)
+    throw std::runtime_error(filename + " is corrupted");
+  if (header.offsets_offset > size || count > (size - header.offsets_offset) / sizeof(uint64_t))
+    throw std::runtime_error(filename + " is truncated");
+  if (count > header.types_offset - header.tags_offset || count > header.lengths_offset - header.types_offset
+      || count > (header.offsets_offset - header.lengths_offset) / sizeof(uint32_t))
+    throw std::runtime_error(filename + " is corrupted");
+
+  _count = static_cast<std::size_t>(count);
+  auto base = _file.data();
+  _payload = base + header.payload_offset;
+  _tags = base + header.tags_offset;
+  _types = base + header.types_offset;
+  _lengths = reinterpret_cast<const uint32_t*>(base + header.lengths_offset);
+  _offsets = reinterpret_cast<const uint64_t*>(base + header.offsets_offset);
+
+  auto payload_size = header.tags_offset - header.payload_offset;
+  for (std::size_t i = 0; i < _count; ++i) {
+    if (_offsets[i] % 8 != 0 || _offsets[i] > payload_size || _lengths[i] > payload_size - _offsets[i])
+      throw std::runtime_error(filename + " record " + std::to_string(i) + " is corrupted");
+  }
+}
+
+void BinaryFile::encode_gds(std::size_t i, std::vector<unsigned char>& out) const
+{
+  auto size = payload_size(i);
+  auto data = payload(i);
+  out.resize(size);
+  switch (static_cast<SPEC::TagDataType>(data_type(i))) {
+    case SPEC::TagDataType::BITARRAY:
+    case SPEC::TagDataType::INTEGER_2: {
+      auto values = this->values<uint16_t>(i);
+      for (std::size_t j = 0; j < size / 2; ++j)
+        store_be16(&out[j * 2], values[j]);
+      break;
+    }
+    case SPEC::TagDataType::INTEGER_4: {
+      auto values = this->values<uint32_t>(i);
+      for (std::size_t j = 0; j < size / 4; ++j)
+        store_be32(&out[j * 4], values[j]);
+      break;
+    }
+    case SPEC::TagDataType::REAL_8: {
+      auto values = this->values<double>(i);
+      for (std::size_t j = 0; j < size / 8; ++j)
+        double_to_real8(values[j], &out[j * 8]);
+      break;
+    }
+    default: {
+      std::copy(data, data + size, out.begin());
+      break;
+    }
+  }
+}
+
+///////////////////////////////////////////
+
+BinaryWriter::BinaryWriter(const std::string& filename, const WriterOptions& options)
+  : _filename(filename), _writer(filename, options), _payload_size(0), _closed(false)
+{
+  // placeholder, the real header is patched in by close()
+  char header[sizeof(BinaryHeader)] = {};
+  _writer.write(header, sizeof(header));
+}
+
+void BinaryWriter::append(unsigned char tag, unsigned char data_type,
+                          const unsigned char* body, std::size_t size)
+{
+  auto width = _value_width(data_type);
+  if (size % width != 0)
+    throw std::runtime_error(std::get<0>(SPEC::tagname_map.at(tag)) + " data is corrupted");
+
+  _scratch.resize(size + _padding(size, 8));
+  auto out = _scratch.data();
+  switch (static_cast<SPEC::TagDataType>(data_type)) {
+    case SPEC::TagDataType::BITARRAY:
+    case SPEC::TagDataType::INTEGER_2: {
+      for (std::size_t j = 0; j < size; j += 2) {
+        auto value = load_be16(body + j);
+        std::memcpy(out + j, &value, 2);
+      }
+      break;
+    }
+    case SPEC::TagDataType::INTEGER_4: {
+      for (std::size_t j = 0; j < size; j += 4) {
+        auto value = load_be32(body + j);
+        std::memcpy(out + j, &value, 4);
+      }
+      break;
+    }
+    case SPEC::TagDataType::REAL_8: {
+      for (std::size_t j = 0; j < size; j += 8) {
+        auto value = real8_to_double(body + j);
+        std::memcpy(out + j, &value, 8);
+      }
+      break;
+    }
+    default: {
+      std::memcpy(out, body, size);
+      break;
+    }
+  }
+  std::fill(out + size, out + _scratch.size(), 0);
+
+  _tags.push_back(tag);
+  _types.push_back(data_type);
+  _lengths.push_back(static_cast<uint32_t>(size));
+  _offsets.push_back(_payload_size);
+  _writer.write(reinterpret_cast<const char*>(out), _scratch.size());
+  _payload_size += _scratch.size();
+}
+
+void BinaryWriter::close()
+{
+  if (_closed)
+    return;
+  _closed = true;
+
+  BinaryHeader header;
+  std::memcpy(header.magic, binary_magic, sizeof(binary_magic));
+  header.version = binary_version;
+  header.byte_order = binary_byte_order;
+  header.record_count = _tags.size();
+  header.payload_offset = sizeof(BinaryHeader);
+
+  auto position = header.payload_offset + _payload_size;
+  auto write_column = [this, &position](const void* data, std::size_t size, std::size_t alignment) {
+    const char zeros[8] = {};
+    auto padding = _padding(position, alignment);
+    _writer.write(zeros, padding);
+    position += padding;
+    auto offset = position;
+    _writer.write(static_cast<const char*>(data), size);
+    position += size;
+    return offset;
+  };
+  header.tags_offset = write_column(_tags.data(), _tags.size(), 1);
+  header.types_offset = write_column(_types.data(), _types.size(), 1);
+  header.lengths_offset = write_column(_lengths.data(), _lengths.size() * sizeof(uint32_t), 4);
+  header.offsets_offset = write_column(_offsets.data(), _offsets.size() * sizeof(uint64_t), 8);
+  _writer.close();
+
+  // O_DIRECT writers can't patch 64 bytes in place, reopen plainly
+  int fd = ::open(_filename.c_str(), O_WRONLY | O_CLOEXEC);
+  if (fd < 0)
+    throw std::runtime_error("failed to open " + _filename);
+  auto ret = ::pwrite(fd, &header, sizeof(header), 0);
+  ::close(fd);
+  if (ret != static_cast<ssize_t>(sizeof(header)))
+    throw std::runtime_error("failed to write header of " + _filename);
+}
+
+TEST_CASE("testing BinaryWriter and BinaryFile") {
+  std::vector<unsigned char> gds;
+  test_record(gds, SPEC::Tag::HEADER, SPEC::TagDataType::INTEGER_2, {600});
+  test_record(gds, SPEC::Tag::BGNLIB, SPEC::TagDataType::INTEGER_2, std::vector<int64_t>(12, 7));
+  test_name(gds, SPEC::Tag::LIBNAME, "LIB");
+  test_header(gds, SPEC::Tag::UNITS, SPEC::TagDataType::REAL_8, 16);
+  gds.resize(gds.size() + 16);
+  double_to_real8(0.001, &gds[gds.size() - 16]);
+  double_to_real8(1e-9, &gds[gds.size() - 8]);
+  test_record(gds, SPEC::Tag::BGNSTR, SPEC::TagDataType::INTEGER_2, std::vector<int64_t>(12, 7));
+  test_name(gds, SPEC::Tag::STRNAME, "TOP");
+  test_record(gds, SPEC::Tag::BOUNDARY, SPEC::TagDataType::NODATA);
+  test_record(gds, SPEC::Tag::LAYER, SPEC::TagDataType::INTEGER_2, {-3});
+  test_record(gds, SPEC::Tag::STRANS, SPEC::TagDataType::BITARRAY, {0x8006});
+  test_record(gds, SPEC::Tag::XY, SPEC::TagDataType::INTEGER_4,
+              {0, 0, -2147483648LL, 2147483647, 1000, -1000, 0, 0});
+  test_record(gds, SPEC::Tag::ENDEL, SPEC::TagDataType::NODATA);
+  test_record(gds, SPEC::Tag::ENDSTR, SPEC::TagDataType::NODATA);
+  test_record(gds, SPEC::Tag::ENDLIB, SPEC::TagDataType::NODATA);
+
+  TestDirectory directory;
+  auto path = directory.path("lib.bin");
+  {
+    BinaryWriter writer(path);
+    for (std::size_t offset = 0; offset < gds.size(); offset += load_be16(&gds[offset]))
+      writer.append(gds[offset + 2], gds[offset + 3], &gds[offset + 4], load_be16(&gds[offset]) - 4u);
+    writer.close();
+  }
+
+  SUBCASE("encode_gds gives back the gds bytes") {
+    BinaryFile file(path);
+    CHECK(file.size() == 13);
+    CHECK(file.values<int32_t>(9)[2] == -2147483648LL);
+    CHECK(file.values<double>(3)[1] == 1e-9);
+    std::vector<unsigned char> image, body;
+    for (std::size_t i = 0; i < file.size(); ++i) {
+      file.encode_gds(i, body);
+      test_header(image, static_cast<SPEC::Tag>(file.tag(i)), static_cast<SPEC::TagDataType>(file.data_type(i)),
+                  body.size());
+      image.insert(image.end(), body.begin(), body.end());
+    }
+    CHECK(image == gds);
+  }
+
+  SUBCASE("damaged dumps are refused") {
+    std::vector<unsigned char> dump;
+    {
+      MappedFile file(path);
+      dump.assign(file.data(), file.data() + file.size());
+    }
+    BinaryHeader header;
+    std::memcpy(&header, dump.data(), sizeof(header));
+    auto damaged = directory.path("damaged.bin");
+    auto refused = [&damaged](const std::vector<unsigned char>& bytes) {
+      {
+        Writer writer(damaged);
+        writer.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        writer.close();
+      }
+      CHECK_THROWS_AS(BinaryFile file(damaged), std::runtime_error);
+    };
+    auto with_field = [&dump](std::size_t offset, uint64_t value, std::size_t width) {
+      auto bytes = dump;
+      std::memcpy(bytes.data() + offset, &value, width);
+      return bytes;
+    };
+
+    // truncated inside the header and inside the last column
+    refused(std::vector<unsigned char>(dump.begin(), dump.begin() + 40));
+    refused(std::vector<unsigned char>(dump.begin(), dump.end() - 8));
+    refused(with_field(0, 'X', 1));
+    refused(with_field(offsetof(BinaryHeader, byte_order), 0x04030201, 4));
+    // sections out of order, past the end, or wrapping around
+    refused(with_field(offsetof(BinaryHeader, tags_offset), header.types_offset + 1, 8));
+    refused(with_field(offsetof(BinaryHeader, offsets_offset), header.offsets_offset + 4096, 8));
+    refused(with_field(offsetof(BinaryHeader, offsets_offset), UINT64_MAX - 7, 8));
+    refused(with_field(offsetof(BinaryHeader, record_count), UINT64_MAX / 8, 8));
+    refused(with_field(offsetof(BinaryHeader, payload_offset), 8, 8));
+    // a record whose payload would run past the payload section
+    refused(with_field(header.offsets_offset + 9 * 8, header.tags_offset, 8));
+    refused(with_field(header.lengths_offset + 9 * 4, 0xffffffff, 4));
+  }
+}
+
+}
+}
@@ -0,0 +1,97 @@
+#ifndef __BINARY__H__
+#define __BINARY__H__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "MappedFile.hpp"
+#include "Writer.hpp"
+
+// Column-oriented binary dump of a gds stream, native byte order.
+//
+//   Header            64 bytes, see BinaryHeader
+//   payload           record values back to back, each record 8-byte aligned:
+//                     BITARRAY uint16, INTEGER_2 int16, INTEGER_4 int32,
+//                     REAL_8 IEEE double, ASCII and others raw gds bytes
+//   tags              uint8  [record_count]
+//   data types        uint8  [record_count]
+//   lengths           uint32 [record_count], payload bytes without padding
+//   offsets           uint64 [record_count], relative to payload start
+//
+// The file is meant to be mmapped and read in place, e.g. with numpy:
+//   xy = np.frombuffer(buf, np.int32, lengths[i] // 4, payload + offsets[i])
+
+namespace GDSTXT {
+namespace IO {
+
+struct BinaryHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t record_count;
+  uint64_t payload_offset;
+  uint64_t tags_offset;
+  uint64_t types_offset;
+  uint64_t lengths_offset;
+  uint64_t offsets_offset;
+};
+
+static_assert(sizeof(BinaryHeader) == 64, "binary header must stay 64 bytes");
+
+constexpr uint32_t binary_version = 1;
+constexpr uint32_t binary_byte_order = 0x01020304;
+
+class BinaryFile {
+  public:
+    explicit BinaryFile(const std::string& filename);
+    BinaryFile(const BinaryFile&) = delete;
+    BinaryFile& operator=(const BinaryFile&) = delete;
+    std::size_t size() const noexcept { return _count; }
+    unsigned char tag(std::size_t i) const noexcept { return _tags[i]; }
+    unsigned char data_type(std::size_t i) const noexcept { return _types[i]; }
+    const unsigned char* payload(std::size_t i) const noexcept { return _payload + _offsets[i]; }
+    std::size_t payload_size(std::size_t i) const noexcept { return _lengths[i]; }
+    template<typename T>
+    const T* values(std::size_t i) const noexcept
+    {
+      return reinterpret_cast<const T*>(payload(i));
+    }
+    // gds record body of record i, big-endian, replaces out
+    void encode_gds(std::size_t i, std::vector<unsigned char>& out) const;
+  private:
+    MappedFile _file;
+    std::size_t _count;
+    const unsigned char* _payload;
+    const unsigned char* _tags;
+    const unsigned char* _types;
+    const uint32_t* _lengths;
+    const uint64_t* _offsets;
+};
+
+class BinaryWriter {
+  public:
+    BinaryWriter(const std::string& filename, const WriterOptions& options = WriterOptions());
+    BinaryWriter(const BinaryWriter&) = delete;
+    BinaryWriter& operator=(const BinaryWriter&) = delete;
+    // body: gds record body after tag and data type bytes
+    void append(unsigned char tag, unsigned char data_type,
+                const unsigned char* body, std::size_t size);
+    // writes the columns and the header
+    void close();
+  private:
+    std::string _filename;
+    Writer _writer;
+    uint64_t _payload_size;
+    std::vector<unsigned char> _tags;
+    std::vector<unsigned char> _types;
+    std::vector<uint32_t> _lengths;
+    std::vector<uint64_t> _offsets;
+    std::vector<unsigned char> _scratch;
+    bool _closed;
+};
+
+}
+}
+
+#endif //__BINARY__H__
@@ -0,0 +1,213 @@
+#include "BoundingBox.hpp"
+#include "Aref.hpp"
+#include "test_config.h"
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace GDSTXT {
+
+namespace {
+
+#if defined(__SSE2__)
+// SSE2 has no 32-bit min/max, select through a compare mask
+inline __m128i _min(__m128i a, __m128i b)
+{
+  auto greater = _mm_cmpgt_epi32(a, b);
+  return _mm_or_si128(_mm_and_si128(greater, b), _mm_andnot_si128(greater, a));
+}
+
+inline __m128i _max(__m128i a, __m128i b)
+{
+  auto greater = _mm_cmpgt_epi32(a, b);
+  return _mm_or_si128(_mm_and_si128(greater, a), _mm_andnot_si128(greater, b));
+}
+#endif
+
+int32_t _clamp(int64_t value) noexcept
+{
+  return static_cast<int32_t>(std::max<int64_t>(std::numeric_limits<int32_t>::min(),
+    std::min<int64_t>(std::numeric_limits<int32_t>::max(), value)));
+}
+
+}
+
+void Box::extend(const Box& other) noexcept
+{
+  x_min = std::min(x_min, other.x_min);
+  y_min = std::min(y_min, other.y_min);
+  x_max = std::max(x_max, other.x_max);
+  y_max = std::max(y_max, other.y_max);
+}
+
+void Box::extend(Point point) noexcept
+{
+  x_min = std::min(x_min, point.x);
+  y_min = std::min(y_min, point.y);
+  x_max = std::max(x_max, point.x);
+  y_max = std::max(y_max, point.y);
+}
+
+Box points_box(const Point* points, std::size_t count) noexcept
+{
+  Box ret;
+  std::size_t i = 0;
+#if defined(__SSE2__)
+  // lanes are x0 y0 x1 y1, folded to one point at the end
+  if (count >= 2) {
+    auto low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(points));
+    auto high = low;
+    for (i = 2; i + 2 <= count; i += 2) {
+      auto pair = _mm_loadu_si128(reinterpret_cast<const __m128i*>(points + i));
+      low = _min(low, pair);
+      high = _max(high, pair);
+    }
+    low = _min(low, _mm_shuffle_epi32(low, _MM_SHUFFLE(1, 0, 3, 2)));
+    high = _max(high, _mm_shuffle_epi32(high, _MM_SHUFFLE(1, 0, 3, 2)));
+    ret.x_min = _mm_cvtsi128_si32(low);
+    ret.y_min = _mm_cvtsi128_si32(_mm_shuffle_epi32(low, _MM_SHUFFLE(1, 1, 1, 1)));
+    ret.x_max = _mm_cvtsi128_si32(high);
+    ret.y_max = _mm_cvtsi128_si32(_mm_shuffle_epi32(high, _MM_SHUFFLE(1, 1, 1, 1)));
+  }
+#endif
+  for (; i < count; ++i)
+    ret.extend(points[i]);
+  return ret;
+}
+
+Box transform_box(const Box& box, const Transform& transform) noexcept
+{
+  Box ret;
+  if (box.empty())
+    return ret;
+  ret.extend(transform.apply(Point {box.x_min, box.y_min}));
+  ret.extend(transform.apply(Point {box.x_min, box.y_max}));
+  ret.extend(transform.apply(Point {box.x_max, box.y_min}));
+  ret.extend(transform.apply(Point {box.x_max, box.y_max}));
+  return ret;
+}
+
+Box element_box(const Element& element) noexcept
+{
+  switch (element.kind) {
+    case ElementKind::boundary:
+    case ElementKind::box:
+      return points_box(element.xy.data(), element.xy.size());
+    case ElementKind::path: {
+      auto ret = points_box(element.xy.data(), element.xy.size());
+      if (ret.empty())
+        return ret;
+      // covers any end style and joint, not the exact outline
+      auto half = (std::abs(static_cast<int64_t>(element.width)) + 1) / 2;
+      ret.x_min = _clamp(ret.x_min - half);
+      ret.y_min = _clamp(ret.y_min - half);
+      ret.x_max = _clamp(ret.x_max + half);
+      ret.y_max = _clamp(ret.y_max + half);
+      return ret;
+    }
+    default:
+      return Box();
+  }
+}
+
+Box reference_box(const Element& reference, const Box& child)
+{
+  if (reference.xy.empty())
+    throw std::runtime_error("reference to " + reference.sname + " has no XY");
+  if (reference.kind == ElementKind::sref)
+    return transform_box(child, Transform::placement(reference, reference.xy[0]));
+
+  // the instances' union is bounded by the four corner instances
+  Box ret;
+  ArefLattice lattice(reference);
+  for (auto column : {0, lattice.columns() - 1}) {
+    for (auto row : {0, lattice.rows() - 1})
+      ret.extend(transform_box(child, Transform::placement(reference, lattice.origin(column, row))));
+  }
+  return ret;
+}
+
+std::vector<Box> structure_boxes(const Library& library, unsigned threads)
+{
+  auto levels = library.levels();
+  unsigned height = 0;
+  for (auto level : levels)
+    height = std::max(height, level);
+  std::vector<std::vector<std::size_t>> by_level(height + 1);
+  for (std::size_t i = 0; i < levels.size(); ++i)
+    by_level[levels[i]].push_back(i);
+
+  // every child of a level is finished before the level starts
+  std::vector<Box> ret(library.structures.size());
+  for (const auto& cells : by_level) {
+    parallel_for(cells.size(), threads, [&library, &ret, &cells](std::size_t i) {
+      auto index = cells[i];
+      Box box;
+      for (const auto& element : library.structures[index].elements) {
+        if (element.kind == ElementKind::sref || element.kind == ElementKind::aref) {
+          box.extend(reference_box(element, ret[library.index_of(element.sname)]));
+        } else {
+          box.extend(element_box(element));
+        }
+      }
+      ret[index] = box;
+    });
+  }
+  return ret;
+}
+
+TEST_CASE("testing bounding boxes") {
+  SUBCASE("points_box handles odd counts and negative values") {
+    std::vector<Point> points {{3, -4}, {-7, 2}, {5, 9}, {0, -11}, {1, 1}};
+    for (std::size_t count = 1; count <= points.size(); ++count) {
+      auto box = points_box(points.data(), count);
+      Box expect;
+      for (std::size_t i = 0; i < count; ++i)
+        expect.extend(points[i]);
+      CHECK(box.x_min == expect.x_min);
+      CHECK(box.y_min == expect.y_min);
+      CHECK(box.x_max == expect.x_max);
+      CHECK(box.y_max == expect.y_max);
+    }
+    CHECK(points_box(points.data(), 0).empty());
+  }
+
+  SUBCASE("hierarchy through SREF and AREF") {
+    Element square;
+    square.reset(ElementKind::boundary);
+    square.xy = {{0, 0}, {0, 10}, {10, 10}, {10, 0}, {0, 0}};
+    Element aref;
+    aref.reset(ElementKind::aref);
+    aref.sname = "A";
+    aref.columns = 3;
+    aref.rows = 2;
+    aref.xy = {{0, 0}, {60, 0}, {0, 40}};
+    Element sref;
+    sref.reset(ElementKind::sref);
+    sref.sname = "A";
+    sref.angle = 90;
+    sref.xy = {{-5, 0}};
+
+    Library library;
+    Structure a;
+    a.name = "A";
+    a.elements = {square};
+    Structure top;
+    top.name = "TOP";
+    top.elements = {sref, aref};
+    library.add(std::move(top));
+    library.add(std::move(a));
+
+    auto boxes = structure_boxes(library, 2);
+    CHECK(boxes[1].x_max == 10);
+    CHECK(boxes[0].x_min == -15);
+    CHECK(boxes[0].y_min == 0);
+    CHECK(boxes[0].x_max == 50);
+    CHECK(boxes[0].y_max == 30);
+  }
+}
+
+}
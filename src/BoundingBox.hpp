@@ -0,0 +1,49 @@
+#ifndef __BOUNDING__BOX__H__
+#define __BOUNDING__BOX__H__
+
+#include <vector>
+#include <cstdint>
+#include <limits>
+#include "Element.hpp"
+#include "Library.hpp"
+#include "Transform.hpp"
+#include "Parallel.hpp"
+
+namespace GDSTXT {
+
+// inclusive, empty until something is added
+struct Box {
+  int32_t x_min = std::numeric_limits<int32_t>::max();
+  int32_t y_min = std::numeric_limits<int32_t>::max();
+  int32_t x_max = std::numeric_limits<int32_t>::min();
+  int32_t y_max = std::numeric_limits<int32_t>::min();
+
+  bool empty() const noexcept { return x_min > x_max; }
+  bool intersects(const Box& other) const noexcept
+  {
+    return x_min <= other.x_max && other.x_min <= x_max
+      && y_min <= other.y_max && other.y_min <= y_max;
+  }
+  void extend(const Box& other) noexcept;
+  void extend(Point point) noexcept;
+};
+
+// min/max over interleaved points, SSE2 two points at a time
+Box points_box(const Point* points, std::size_t count) noexcept;
+// box of the four transformed corners, exact for Manhattan placements
+Box transform_box(const Box& box, const Transform& transform) noexcept;
+// own extent of BOUNDARY/BOX/PATH, paths grow by half their width;
+// references, TEXT and NODE give an empty box
+Box element_box(const Element& element) noexcept;
+// extent of every instance an SREF/AREF places, child is the box of the
+// referenced structure
+Box reference_box(const Element& reference, const Box& child);
+
+// box of every structure in library order, SREF/AREF included; cells are
+// computed once each, leaves first, a level of the hierarchy at a time
+// on up to threads threads. Throws on cycles and undefined references.
+std::vector<Box> structure_boxes(const Library& library, unsigned threads = default_thread_count());
+
+}
+
+#endif //__BOUNDING__BOX__H__
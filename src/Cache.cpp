@@ -0,0 +1,189 @@
+#include "Cache.hpp"
+#include "Codec.hpp"
+#include "Hash.hpp"
+#include "Reader.hpp"
+#include "SPEC.hpp"
+#include "TextFormat.hpp"
+#include "test_config.h"
+#include "test_fixtures.h"
+#include <cerrno>
+#include <cstdio>
+#include <stdexcept>
+#include <thread>
+#include <fcntl.h>
+#include <glob.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace GDSTXT {
+
+namespace {
+
+// bumped whenever the text a conversion writes changes
+constexpr char cache_version[] = "gds2txt-cache-1";
+
+void _make_directory(const std::string& directory)
+{
+  if (::mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST)
+    throw std::runtime_error("Failed to create directory " + directory);
+}
+
+// text of the records in [begin, end)
+void _write_records(const unsigned char* data, uint64_t begin, uint64_t end, TextDialect dialect,
+                    IO::Writer& output)
+{
+  IO::RecordCursor cursor(data, static_cast<std::size_t>(end), begin);
+  IO::RecordView record;
+  while (cursor.next(record)) {
+    if (dialect == TextDialect::compact && record.tag == static_cast<unsigned char>(SPEC::Tag::XY))
+      write_compact_xy(record, output);
+    else
+      write_record_text(record, output);
+  }
+}
+
+}
+
+ConversionCache::ConversionCache(const std::string& directory)
+  : _directory(directory)
+{
+  _make_directory(_directory);
+}
+
+uint64_t ConversionCache::key(const unsigned char* data, std::size_t size, const std::string& options) noexcept
+{
+  auto seed = hash64(reinterpret_cast<const unsigned char*>(cache_version), sizeof(cache_version) - 1);
+  seed = hash64(reinterpret_cast<const unsigned char*>(options.data()), options.size(), seed);
+  return hash64(data, size, seed);
+}
+
+std::string ConversionCache::_path(const std::string& kind, uint64_t key) const
+{
+  char hex[17];
+  std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(key));
+  return _directory + "/" + kind + "/" + hex;
+}
+
+bool ConversionCache::fetch(const std::string& kind, uint64_t key, IO::Writer& output) const
+{
+  auto path = _path(kind, key);
+  // one open, an entry renamed in or replaced meanwhile is read whole
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    if (errno == ENOENT)
+      return false;
+    throw std::runtime_error("Failed to open " + path);
+  }
+  char chunk[1 << 16];
+  while (true) {
+    auto count = ::read(fd, chunk, sizeof(chunk));
+    if (count < 0 && errno == EINTR)
+      continue;
+    if (count < 0) {
+      ::close(fd);
+      throw std::runtime_error("Failed to read " + path);
+    }
+    if (count == 0)
+      break;
+    output.write(chunk, static_cast<std::size_t>(count));
+  }
+  ::close(fd);
+  return true;
+}
+
+void ConversionCache::store(const std::string& kind, uint64_t key, const char* data, std::size_t size) const
+{
+  _make_directory(_directory + "/" + kind);
+  auto path = _path(kind, key);
+  // unique per process and thread, readers only ever see whole entries
+  auto staging = path + "." + std::to_string(::getpid()) + "."
+    + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+  {
+    IO::Writer writer(staging);
+    writer.write(data, size);
+    writer.close();
+  }
+  if (std::rename(staging.c_str(), path.c_str()) != 0) {
+    std::remove(staging.c_str());
+    throw std::runtime_error("Failed to store " + path);
+  }
+}
+
+void write_text_cached(const unsigned char* data, std::size_t size, TextDialect dialect,
+                       const ConversionCache& cache, IO::Writer& output, std::size_t min_cached)
+{
+  write_dialect_header(dialect, output);
+  auto options = std::string("cell ") + (dialect == TextDialect::compact ? "compact" : "plain");
+  std::vector<char> text;
+  uint64_t position = 0;
+  for (const auto& span : scan_structures(data, size)) {
+    _write_records(data, position, span.begin, dialect, output);
+    position = span.end;
+    auto bytes = static_cast<std::size_t>(span.end - span.begin);
+    if (bytes < min_cached) {
+      _write_records(data, span.begin, span.end, dialect, output);
+      continue;
+    }
+    auto key = ConversionCache::key(data + span.begin, bytes, options);
+    if (cache.fetch("cells", key, output))
+      continue;
+    text.clear();
+    {
+      IO::Writer cell(std::unique_ptr<IO::OutputSink>(new IO::VectorSink(text, 1 << 16)), 1 << 16, span.name);
+      _write_records(data, span.begin, span.end, dialect, cell);
+      cell.close();
+    }
+    cache.store("cells", key, text.data(), text.size());
+    output.write(text.data(), text.size());
+  }
+  _write_records(data, position, size, dialect, output);
+}
+
+TEST_CASE("testing ConversionCache") {
+  auto library = [](const std::string& second) {
+    return "HEADER:600\nBGNLIB:1 2 3 4 5 6 1 2 3 4 5 6\nLIBNAME:LIB\nUNITS:0.001 1e-09\n"
+      "BGNSTR:1 2 3 4 5 6 1 2 3 4 5 6\nSTRNAME:A\nBOUNDARY\nLAYER:1\nDATATYPE:0\n"
+      "XY:0 0 0 10 10 10 10 0 0 0\nENDEL\nENDSTR\n"
+      "BGNSTR:1 2 3 4 5 6 1 2 3 4 5 6\nSTRNAME:B\nSREF\nSNAME:A\nXY:" + second + "\nENDEL\nENDSTR\nENDLIB\n";
+  };
+  TestDirectory directory;
+  ConversionCache cache(directory.path("cache"));
+  CHECK(ConversionCache::key(nullptr, 0, "a") != ConversionCache::key(nullptr, 0, "b"));
+
+  auto convert = [&cache](const std::string& lines) {
+    std::vector<unsigned char> gds;
+    REQUIRE(encode_batch(lines.data(), lines.size(), gds).status == Status::ok);
+    std::vector<char> text;
+    IO::Writer output(std::unique_ptr<IO::OutputSink>(new IO::VectorSink(text, 1 << 16)), 1 << 16, "text");
+    write_text_cached(gds.data(), gds.size(), TextDialect::plain, cache, output, 0);
+    output.close();
+    return std::string(text.begin(), text.end());
+  };
+  auto entries = [&directory]() {
+    glob_t matches;
+    ::glob(directory.path("cache/cells/*").c_str(), 0, nullptr, &matches);
+    auto count = matches.gl_pathc;
+    ::globfree(&matches);
+    return count;
+  };
+  auto first = library("5 5");
+  CHECK(convert(first) == first);
+  CHECK(entries() == 2);
+  // A comes from the cache, only B is converted again
+  auto second = library("7 7");
+  CHECK(convert(second) == second);
+  CHECK(entries() == 3);
+
+  std::vector<unsigned char> gds;
+  encode_batch(first.data(), first.size(), gds);
+  auto a = scan_structures(gds.data(), gds.size())[0];
+  auto key = ConversionCache::key(gds.data() + a.begin, a.end - a.begin, "cell plain");
+  std::vector<char> text;
+  IO::Writer output(std::unique_ptr<IO::OutputSink>(new IO::VectorSink(text, 1 << 16)), 1 << 16, "text");
+  CHECK(cache.fetch("cells", key, output));
+  CHECK_FALSE(cache.fetch("cells", key + 1, output));
+  output.close();
+  CHECK(std::string(text.begin(), text.end()).compare(0, 17, "BGNSTR:1 2 3 4 5 ") == 0);
+}
+
+}
@@ -0,0 +1,43 @@
+#ifndef __CACHE__H__
+#define __CACHE__H__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "Dialect.hpp"
+#include "Writer.hpp"
+
+namespace GDSTXT {
+
+// Outputs of earlier conversions in a directory, each one in a file named
+// after the hash of the input bytes and the options that produced it, so
+// an identical input converted the same way is a copy. Entries are written
+// under a temporary name and renamed, processes can share the directory.
+// Nothing is ever evicted, the directory can be emptied at any time.
+class ConversionCache {
+  public:
+    // the directory is created if missing
+    explicit ConversionCache(const std::string& directory);
+    // XXH64 of data seeded with the options and the cache format version
+    static uint64_t key(const unsigned char* data, std::size_t size, const std::string& options) noexcept;
+    // the bytes stored under kind and key written to output, false when
+    // there are none
+    bool fetch(const std::string& kind, uint64_t key, IO::Writer& output) const;
+    void store(const std::string& kind, uint64_t key, const char* data, std::size_t size) const;
+  private:
+    std::string _path(const std::string& kind, uint64_t key) const;
+
+    std::string _directory;
+};
+
+// gds image as text with every structure's lines cached on their own,
+// keyed by the structure's bytes, so an edit of one cell only converts
+// that cell again; the header records and structures smaller than
+// min_cached bytes are converted every time
+void write_text_cached(const unsigned char* data, std::size_t size, TextDialect dialect,
+                       const ConversionCache& cache, IO::Writer& output,
+                       std::size_t min_cached = 16 << 10);
+
+}
+
+#endif //__CACHE__H__
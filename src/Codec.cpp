@@ -0,0 +1,734 @@
+#include "Codec.hpp"
+#include "SPEC.hpp"
+#include "Format.hpp"
+#include "test_config.h"
+#include <algorithm>
+#include <array>
+#include <utility>
+#include <cmath>
+#include <cstring>
+#include <string>
+
+namespace GDSTXT {
+
+namespace {
+
+bool _space(char c) noexcept
+{
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\f' || c == '\v';
+}
+
+// next whitespace separated token of [first, last), false at the end
+bool _token(const char*& first, const char* last, const char*& begin, const char*& end) noexcept
+{
+  while (first != last && _space(*first))
+    ++first;
+  if (first == last)
+    return false;
+  begin = first;
+  while (first != last && !_space(*first))
+    ++first;
+  end = first;
+  return true;
+}
+
+Result<int64_t> _parse_int(const char* first, const char* last, int64_t min, int64_t max) noexcept
+{
+  bool negative = false;
+  if (first != last && (*first == '-' || *first == '+'))
+    negative = *first++ == '-';
+  if (first == last || last - first > 18)
+    return Status::bad_number;
+  int64_t value = 0;
+  for (; first != last; ++first) {
+    if (*first < '0' || *first > '9')
+      return Status::bad_number;
+    value = value * 10 + (*first - '0');
+  }
+  if (negative)
+    value = -value;
+  if (value < min || value > max)
+    return Status::bad_number;
+  return value;
+}
+
+Result<double> _parse_real(const char* first, const char* last) noexcept
+{
+  char buffer[64];
+  if (last - first >= static_cast<std::ptrdiff_t>(sizeof(buffer)))
+    return Status::bad_number;
+  std::copy(first, last, buffer);
+  buffer[last - first] = '\0';
+  char* end = nullptr;
+  double value = std::strtod(buffer, &end);
+  if (end != buffer + (last - first) || end == buffer)
+    return Status::bad_number;
+  return value;
+}
+
+
+// value handlers, one per data type and direction
+
+char* _decode_nodata(const unsigned char*, std::size_t, char* out) noexcept
+{
+  return out;
+}
+
+Status _encode_nodata(const char*, const char*, std::vector<unsigned char>&)
+{
+  return Status::ok;
+}
+
+char* _format_bit_array(char* out, const unsigned char* value) noexcept
+{
+  return format_int(out, load_be16(value));
+}
+
+char* _format_int2(char* out, const unsigned char* value) noexcept
+{
+  return format_int(out, static_cast<int16_t>(load_be16(value)));
+}
+
+char* _format_int4(char* out, const unsigned char* value) noexcept
+{
+  return format_int(out, static_cast<int32_t>(load_be32(value)));
+}
+
+char* _format_real8(char* out, const unsigned char* value) noexcept
+{
+  return format_real(out, real8_to_double(value));
+}
+
+template<std::size_t Width, char* (*Format)(char*, const unsigned char*) noexcept>
+char* _decode_values(const unsigned char* body, std::size_t size, char* out) noexcept
+{
+  if (size == 0)
+    return out;
+  *out++ = ':';
+  out = Format(out, body);
+  for (std::size_t i = Width; i < size; i += Width) {
+    *out++ = ' ';
+    out = Format(out, body + i);
+  }
+  return out;
+}
+
+Status _store_int2(const char* first, const char* last, unsigned char* out) noexcept
+{
+  auto value = _parse_int(first, last, INT16_MIN, UINT16_MAX);
+  if (value)
+    store_be16(out, static_cast<uint16_t>(value.value()));
+  return value.status();
+}
+
+Status _store_int4(const char* first, const char* last, unsigned char* out) noexcept
+{
+  auto value = _parse_int(first, last, INT32_MIN, UINT32_MAX);
+  if (value)
+    store_be32(out, static_cast<uint32_t>(value.value()));
+  return value.status();
+}
+
+Status _store_real8(const char* first, const char* last, unsigned char* out) noexcept
+{
+  auto value = _parse_real(first, last);
+  if (value)
+    text_to_real8(value.value(), out);
+  return value.status();
+}
+
+template<std::size_t Width, Status (*Store)(const char*, const char*, unsigned char*) noexcept>
+Status _encode_values(const char* first, const char* last, std::vector<unsigned char>& gds)
+{
+  const char* token_begin;
+  const char* token_end;
+  while (_token(first, last, token_begin, token_end)) {
+    gds.resize(gds.size() + Width);
+    auto status = Store(token_begin, token_end, gds.data() + gds.size() - Width);
+    if (status != Status::ok)
+      return status;
+  }
+  return Status::ok;
+}
+
+char* _decode_ascii(const unsigned char* body, std::size_t size, char* out) noexcept
+{
+  while (size > 0 && body[size - 1] == '\0')
+    --size;
+  *out++ = ':';
+  return std::copy(body, body + size, out);
+}
+
+Status _encode_ascii(const char* first, const char* last, std::vector<unsigned char>& gds)
+{
+  gds.insert(gds.end(), first, last);
+  if ((last - first) % 2 != 0)
+    gds.push_back('\0');
+  return Status::ok;
+}
+
+Status _encode_unsupported(const char*, const char*, std::vector<unsigned char>&)
+{
+  return Status::bad_data_type;
+}
+
+// points an XY record body holds
+constexpr int64_t _max_xy_points = (0xffff - 4) / 8;
+
+// "a,b" of a compact XY token, any int4 coordinate or the move between two
+Status _parse_pair(const char* first, const char* last, int64_t& a, int64_t& b) noexcept
+{
+  auto comma = std::find(first, last, ',');
+  if (comma == last)
+    return Status::bad_number;
+  auto a_value = _parse_int(first, comma, -int64_t(UINT32_MAX), UINT32_MAX);
+  auto b_value = _parse_int(comma + 1, last, -int64_t(UINT32_MAX), UINT32_MAX);
+  if (!a_value || !b_value)
+    return Status::bad_number;
+  a = a_value.value();
+  b = b_value.value();
+  return Status::ok;
+}
+
+// body of a compact dialect XY line (see Dialect.hpp) as int4 values; a
+// *N repeat past the points one record holds stops at too_long instead
+// of expanding
+Status _encode_compact_xy(const char* first, const char* last, std::vector<unsigned char>& gds)
+{
+  const char* token_begin;
+  const char* token_end;
+  int64_t points = 0;
+  int64_t x = 0;
+  int64_t y = 0;
+  int64_t first_x = 0;
+  int64_t first_y = 0;
+  while (_token(first, last, token_begin, token_end)) {
+    auto star = std::find(token_begin, token_end, '*');
+    int64_t dx = 0;
+    int64_t dy = 0;
+    int64_t repeat = 1;
+    Status status = Status::ok;
+    if (points == 0) {
+      // the first point is absolute and never repeats
+      status = _parse_pair(token_begin, token_end, x, y);
+      first_x = x;
+      first_y = y;
+    } else if (token_end - token_begin == 1 && *token_begin == 'z') {
+      dx = first_x - x;
+      dy = first_y - y;
+    } else {
+      if (star != token_end) {
+        auto count = _parse_int(star + 1, token_end, 1, INT64_MAX);
+        if (!count)
+          return count.status();
+        repeat = count.value();
+      }
+      if (*token_begin == 'h' || *token_begin == 'v') {
+        auto delta = _parse_int(token_begin + 1, star, -int64_t(UINT32_MAX), UINT32_MAX);
+        status = delta.status();
+        (*token_begin == 'h' ? dx : dy) = delta ? delta.value() : 0;
+      } else {
+        status = _parse_pair(token_begin, star, dx, dy);
+      }
+    }
+    if (status != Status::ok)
+      return status;
+    if (repeat > _max_xy_points - points)
+      return Status::too_long;
+
+    auto at = gds.size();
+    gds.resize(at + repeat * 8);
+    for (int64_t i = 0; i < repeat; ++i, at += 8) {
+      x += dx;
+      y += dy;
+      store_be32(gds.data() + at, static_cast<uint32_t>(x));
+      store_be32(gds.data() + at + 4, static_cast<uint32_t>(y));
+    }
+    points += repeat;
+  }
+  return Status::ok;
+}
+
+constexpr std::size_t _length(const char* name) noexcept
+{
+  std::size_t size = 0;
+  while (name[size] != '\0')
+    ++size;
+  return size;
+}
+
+// real4 and data types without notation get no decoder
+constexpr RecordCodec _type_codec(unsigned char data_type, const char* name) noexcept
+{
+  switch (static_cast<SPEC::TagDataType>(data_type)) {
+    case SPEC::TagDataType::NODATA:
+      return {name, _length(name), data_type, 0, &_decode_nodata, &_encode_nodata};
+    case SPEC::TagDataType::BITARRAY:
+      return {name, _length(name), data_type, 2,
+              &_decode_values<2, _format_bit_array>, &_encode_values<2, _store_int2>};
+    case SPEC::TagDataType::INTEGER_2:
+      return {name, _length(name), data_type, 2,
+              &_decode_values<2, _format_int2>, &_encode_values<2, _store_int2>};
+    case SPEC::TagDataType::INTEGER_4:
+      return {name, _length(name), data_type, 4,
+              &_decode_values<4, _format_int4>, &_encode_values<4, _store_int4>};
+    case SPEC::TagDataType::REAL_8:
+      return {name, _length(name), data_type, 8,
+              &_decode_values<8, _format_real8>, &_encode_values<8, _store_real8>};
+    case SPEC::TagDataType::ASCII:
+      return {name, _length(name), data_type, 0, &_decode_ascii, &_encode_ascii};
+    default:
+      return {name, _length(name), data_type, 0, nullptr, &_encode_unsupported};
+  }
+}
+
+constexpr RecordCodec _tag_codec(std::size_t tag) noexcept
+{
+  return tag < SPEC::tag_count
+    ? _type_codec(SPEC::tag_specs[tag].data_type, SPEC::tag_specs[tag].name)
+    : RecordCodec {nullptr, 0, 0xff, 0, nullptr, nullptr};
+}
+
+template<std::size_t... Tags>
+constexpr std::array<RecordCodec, sizeof...(Tags)> _tag_codecs(std::index_sequence<Tags...>) noexcept
+{
+  return {{_tag_codec(Tags)...}};
+}
+
+template<std::size_t... Types>
+constexpr std::array<RecordCodec, sizeof...(Types)> _type_codecs(std::index_sequence<Types...>) noexcept
+{
+  return {{_type_codec(static_cast<unsigned char>(Types), "")...}};
+}
+
+constexpr auto tag_codecs = _tag_codecs(std::make_index_sequence<256>());
+// for records that do not carry the data type SPEC gives their tag
+constexpr auto type_codecs = _type_codecs(std::make_index_sequence<7>());
+
+static_assert(tag_codecs[0x10].width == 4, "XY is int4");
+static_assert(tag_codecs[0x19].data_type == 0x06, "STRING is ascii");
+static_assert(tag_codecs[0x3d].name == nullptr, "tags past UNKNOW are undefined");
+
+}
+
+double real8_to_double(const unsigned char* bytes) noexcept
+{
+  uint64_t mant = 0;
+  for (int i = 1; i < 8; ++i) {
+    mant = (mant << 8) | bytes[i];
+  }
+  int expr = bytes[0] & 0x7f;
+  double ret = std::ldexp(static_cast<double>(mant), 4 * (expr - 64) - 56);
+  return (bytes[0] & 0x80) ? -ret : ret;
+}
+
+void double_to_real8(double value, unsigned char* bytes) noexcept
+{
+  // zero keeps exponent 64 like _str_to_real8 does
+  std::fill(bytes, bytes + 8, 0);
+  if (value == 0.0 || std::isnan(value)) {
+    bytes[0] = 0x40;
+    return;
+  }
+  unsigned char sign = 0;
+  if (value < 0) {
+    sign = 0x80;
+    value = -value;
+  }
+  // value = m * 2^e with m in [0.5, 1), pick base-16 exponent q so that
+  // the 56 bit mantissa m * 2^(e - 4q) lands in [1/16, 1)
+  int e = 0;
+  double m = std::frexp(value, &e);
+  int q = e > 0 ? (e + 3) / 4 : -((-e) / 4);
+  if (q + 64 < 0) {
+    bytes[0] = 0x40;
+    return;
+  }
+  if (q + 64 > 127) {
+    bytes[0] = sign | 0x7f;
+    std::fill(bytes + 1, bytes + 8, 0xff);
+    return;
+  }
+  auto mant = static_cast<uint64_t>(std::ldexp(m, 56 + e - 4 * q));
+  bytes[0] = sign | static_cast<unsigned char>(q + 64);
+  for (int i = 7; i > 0; --i) {
+    bytes[i] = static_cast<unsigned char>(mant & 0xff);
+    mant >>= 8;
+  }
+}
+
+void text_to_real8(double value, unsigned char* bytes) noexcept
+{
+  bytes[0] = 0;
+  if (value < 0) {
+    bytes[0] = 0x80;
+    value = -value;
+  }
+  int e = 0;
+  if (value < 1e-77) {
+    value = 0;
+  } else {
+    double lg16 = std::log(value) / std::log(16.0);
+    e = static_cast<int>(std::ceil(lg16));
+    if (e == lg16)
+      ++e;
+  }
+  value /= std::pow(16.0, e - 14);
+  bytes[0] |= ((e + 64) & 0x7f);
+  auto m = static_cast<uint64_t>(value + 0.5);
+  for (int i = 7; i > 0; --i) {
+    bytes[i] = static_cast<unsigned char>(m & 0xff);
+    m >>= 8;
+  }
+}
+
+TEST_CASE("testing real8 <-> double") {
+  SUBCASE("bytes 0x4110000000000000 should be 1.0 both ways") {
+    unsigned char data[8] {0x41, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    CHECK(real8_to_double(data) == 1.0);
+    unsigned char ret[8];
+    double_to_real8(1.0, ret);
+    CHECK(std::equal(data, data + 8, ret));
+  }
+  SUBCASE("1e-3 and -2.5 should round trip") {
+    for (double value : {1e-3, -2.5, 1e-9, 0.0}) {
+      unsigned char ret[8];
+      double_to_real8(value, ret);
+      CHECK(real8_to_double(ret) == value);
+    }
+  }
+}
+
+///////////////////////////////////////////
+
+const char* status_message(Status status) noexcept
+{
+  switch (status) {
+    case Status::ok:
+      return "ok";
+    case Status::truncated:
+      return "record is truncated";
+    case Status::bad_length:
+      return "record length is corrupted";
+    case Status::unknown_tag:
+      return "unknown tag";
+    case Status::bad_data_type:
+      return "unsupported data type";
+    case Status::corrupted_body:
+      return "record data is corrupted";
+    case Status::bad_number:
+      return "value is not a number of the record's data type";
+    case Status::too_long:
+      return "record exceeds 65535 bytes";
+  }
+  return "unknown status";
+}
+
+Result<RecordCodec> record_codec(unsigned char tag, unsigned char data_type, std::size_t size) noexcept
+{
+  auto codec = tag_codecs[tag];
+  if (codec.name == nullptr)
+    return Status::unknown_tag;
+  if (codec.data_type != data_type) {
+    if (data_type >= type_codecs.size())
+      return Status::bad_data_type;
+    auto name = codec.name;
+    auto name_size = codec.name_size;
+    codec = type_codecs[data_type];
+    codec.name = name;
+    codec.name_size = name_size;
+  }
+  if (codec.decode == nullptr)
+    return Status::bad_data_type;
+  if (codec.width != 0 && size % codec.width != 0)
+    return Status::corrupted_body;
+  return codec;
+}
+
+Status RecordTextStream::begin(unsigned char tag, unsigned char data_type, std::size_t size) noexcept
+{
+  auto codec = record_codec(tag, data_type, size);
+  if (!codec)
+    return codec.status();
+  _codec = codec.value();
+  _started = false;
+  _carried = 0;
+  _ascii.clear();
+  return Status::ok;
+}
+
+char* RecordTextStream::_values(const unsigned char* data, std::size_t size, char* out) noexcept
+{
+  if (size == 0)
+    return out;
+  if (!_started) {
+    _started = true;
+    return _codec.write_text(data, size, out);
+  }
+  // decode() starts with ':', later pieces continue the value list
+  auto first = out;
+  out = _codec.decode(data, size, out);
+  *first = ' ';
+  return out;
+}
+
+char* RecordTextStream::feed(const unsigned char* data, std::size_t size, char* out)
+{
+  auto width = _codec.width;
+  if (width == 0) {
+    _ascii.insert(_ascii.end(), data, data + size);
+    return out;
+  }
+  if (_carried > 0) {
+    auto take = std::min(width - _carried, size);
+    std::memcpy(_carry + _carried, data, take);
+    _carried += take;
+    data += take;
+    size -= take;
+    if (_carried < width)
+      return out;
+    out = _values(_carry, width, out);
+    _carried = 0;
+  }
+  auto whole = size - size % width;
+  out = _values(data, whole, out);
+  _carried = size - whole;
+  std::memcpy(_carry, data + whole, _carried);
+  return out;
+}
+
+char* RecordTextStream::end(char* out) noexcept
+{
+  if (!_started) {
+    _started = true;
+    out = _codec.write_text(_ascii.data(), _ascii.size(), out);
+  }
+  *out++ = '\n';
+  return out;
+}
+
+Result<unsigned char> tag_from_name(const char* name, std::size_t size) noexcept
+{
+  for (std::size_t tag = 0; tag < SPEC::tag_count; ++tag) {
+    const auto& codec = tag_codecs[tag];
+    if (codec.name_size == size && std::memcmp(codec.name, name, size) == 0)
+      return static_cast<unsigned char>(tag);
+  }
+  return Status::unknown_tag;
+}
+
+Status decode_record(unsigned char tag, unsigned char data_type, const unsigned char* body,
+                     std::size_t size, std::vector<char>& text)
+{
+  auto codec = record_codec(tag, data_type, size);
+  if (!codec)
+    return codec.status();
+  auto begin = text.size();
+  text.resize(begin + codec.value().text_bound(size));
+  auto end = codec.value().write_text(body, size, text.data() + begin);
+  text.resize(end - text.data());
+  return Status::ok;
+}
+
+Status encode_record(const char* line, std::size_t size, std::vector<unsigned char>& gds, bool compact)
+{
+  auto last = line + size;
+  auto colon = std::find(line, last, ':');
+  auto name_begin = line;
+  auto name_end = colon;
+  while (name_begin != name_end && *name_begin == ' ')
+    ++name_begin;
+  while (name_end != name_begin && name_end[-1] == ' ')
+    --name_end;
+  auto tag = tag_from_name(name_begin, name_end - name_begin);
+  if (!tag)
+    return tag.status();
+  const auto& codec = tag_codecs[tag.value()];
+
+  auto begin = gds.size();
+  gds.resize(begin + 4);
+  auto body = colon == last ? last : colon + 1;
+  auto status = compact && tag.value() == static_cast<unsigned char>(SPEC::Tag::XY)
+    ? _encode_compact_xy(body, last, gds)
+    : codec.encode(body, last, gds);
+  auto length = gds.size() - begin;
+  if (status == Status::ok && length > 0xffff)
+    status = Status::too_long;
+  if (status != Status::ok) {
+    gds.resize(begin);
+    return status;
+  }
+  store_be16(gds.data() + begin, static_cast<uint16_t>(length));
+  gds[begin + 2] = tag.value();
+  gds[begin + 3] = codec.data_type;
+  return Status::ok;
+}
+
+BatchResult decode_batch(const unsigned char* data, std::size_t size, std::vector<char>& text)
+{
+  BatchResult result {Status::ok, 0, 0};
+  while (result.consumed != size) {
+    auto first = data + result.consumed;
+    if (size - result.consumed < 4) {
+      result.status = Status::truncated;
+      break;
+    }
+    std::size_t length = load_be16(first);
+    if (length < 4) {
+      result.status = Status::bad_length;
+      break;
+    }
+    if (size - result.consumed < length) {
+      result.status = Status::truncated;
+      break;
+    }
+    result.status = decode_record(first[2], first[3], first + 4, length - 4, text);
+    if (result.status != Status::ok)
+      break;
+    text.push_back('\n');
+    result.consumed += length;
+    ++result.records;
+  }
+  return result;
+}
+
+BatchResult encode_batch(const char* text, std::size_t size, std::vector<unsigned char>& gds, bool compact)
+{
+  BatchResult result {Status::ok, 0, 0};
+  while (result.consumed != size) {
+    auto first = text + result.consumed;
+    auto newline = static_cast<const char*>(std::memchr(first, '\n', size - result.consumed));
+    auto end = newline == nullptr ? text + size : newline;
+    result.status = encode_record(first, end - first, gds, compact);
+    if (result.status != Status::ok)
+      break;
+    result.consumed = end - text + (newline == nullptr ? 0 : 1);
+    ++result.records;
+  }
+  return result;
+}
+
+TEST_CASE("testing RecordTextStream") {
+  // an XY of three points and a padded STRNAME, fed a few bytes at a time
+  std::vector<unsigned char> gds;
+  std::string lines = "XY:1 -2 300000 4 -5 6\nSTRNAME:TOP\nENDEL\nLAYER\n";
+  // CHECK only, this file builds without exceptions
+  CHECK(encode_batch(lines.data(), lines.size() - 6, gds).status == Status::ok);
+  gds.insert(gds.end(), {0, 4, 0x0d, 0x02});
+
+  for (std::size_t piece : {1, 3, 5, 8, 64}) {
+    std::string text;
+    RecordTextStream stream;
+    for (std::size_t offset = 0; offset < gds.size();) {
+      auto size = load_be16(gds.data() + offset) - 4u;
+      auto status = stream.begin(gds[offset + 2], gds[offset + 3], size);
+      CHECK(status == Status::ok);
+      if (status != Status::ok)
+        break;
+      auto body = gds.data() + offset + 4;
+      for (std::size_t done = 0; done < size; done += piece) {
+        auto count = std::min(piece, size - done);
+        std::vector<char> out(stream.feed_bound(count));
+        text.append(out.data(), stream.feed(body + done, count, out.data()));
+      }
+      std::vector<char> out(stream.end_bound());
+      text.append(out.data(), stream.end(out.data()));
+      offset += size + 4;
+    }
+    CHECK(text == lines);
+  }
+  RecordTextStream stream;
+  CHECK(stream.begin(0x10, 0x03, 6) == Status::corrupted_body);
+}
+
+TEST_CASE("testing decode_batch and encode_batch") {
+  std::string lines =
+    "HEADER:600\n"
+    "BGNSTR:2020 1 2 3 4 5 2020 1 2 3 4 5\n"
+    "STRNAME:TOP\n"
+    "BOUNDARY\n"
+    "LAYER:1\n"
+    "XY:0 0 100 -100 0 0\n"
+    "ENDEL\n"
+    "UNITS:0.001 1e-09\n";
+  std::vector<unsigned char> gds;
+  auto encoded = encode_batch(lines.data(), lines.size(), gds);
+  CHECK(encoded.status == Status::ok);
+  CHECK(encoded.records == 8);
+  CHECK(encoded.consumed == lines.size());
+  // odd STRNAME is padded
+  CHECK(gds[6 + 28 + 1] == 8);
+
+  std::vector<char> text;
+  auto decoded = decode_batch(gds.data(), gds.size(), text);
+  CHECK(decoded.status == Status::ok);
+  CHECK(decoded.records == 8);
+  CHECK(std::string(text.begin(), text.end()) == lines);
+
+  SUBCASE("a bad line stops the batch and leaves the records before it") {
+    std::string bad = "HEADER:600\nLAYER:x\nENDEL\n";
+    std::vector<unsigned char> out;
+    auto result = encode_batch(bad.data(), bad.size(), out);
+    CHECK(result.status == Status::bad_number);
+    CHECK(result.records == 1);
+    CHECK(result.consumed == 11);
+    CHECK(out.size() == 6);
+    CHECK(encode_record("FOO:1", 5, out) == Status::unknown_tag);
+    CHECK(encode_record("LAYER:70000", 11, out) == Status::bad_number);
+    CHECK(out.size() == 6);
+  }
+  SUBCASE("a data type other than the spec's decodes as itself") {
+    unsigned char layer[] {0x00, 0x08, 0x0d, 0x03, 0x00, 0x01, 0x00, 0x00};
+    std::vector<char> line;
+    CHECK(decode_record(layer[2], layer[3], layer + 4, 4, line) == Status::ok);
+    CHECK(std::string(line.begin(), line.end()) == "LAYER:65536");
+    CHECK(record_codec(0x0d, 0x02, 3).status() == Status::corrupted_body);
+    CHECK(record_codec(0x70, 0x02, 2).status() == Status::unknown_tag);
+  }
+  SUBCASE("corrupted records are reported, not thrown") {
+    unsigned char odd[] {0x00, 0x07, 0x10, 0x03, 0x01, 0x02, 0x03};
+    CHECK(decode_batch(odd, sizeof(odd), text).status == Status::corrupted_body);
+    unsigned char short_length[] {0x00, 0x02, 0x00, 0x02};
+    CHECK(decode_batch(short_length, sizeof(short_length), text).status == Status::bad_length);
+    unsigned char real4[] {0x00, 0x08, 0x1b, 0x04, 0x00, 0x00, 0x00, 0x00};
+    CHECK(decode_batch(real4, sizeof(real4), text).status == Status::bad_data_type);
+    CHECK(decode_batch(odd, 5, text).status == Status::truncated);
+  }
+}
+
+TEST_CASE("testing compact XY lines") {
+  auto xy = [](const std::string& line) {
+    std::vector<unsigned char> gds;
+    auto status = encode_record(line.data(), line.size(), gds, true);
+    std::vector<char> text;
+    if (status == Status::ok)
+      decode_record(gds[2], gds[3], gds.data() + 4, gds.size() - 4, text);
+    return std::make_pair(status, std::string(text.begin(), text.end()));
+  };
+  SUBCASE("manhattan rectangle closes with z") {
+    auto result = xy("XY:0,0 h100 v50 h-100 z");
+    CHECK(result.first == Status::ok);
+    CHECK(result.second == "XY:0 0 100 0 100 50 0 50 0 0");
+  }
+  SUBCASE("repeated moves and diagonal deltas") {
+    CHECK(xy("XY:-5,7 3,3*2 v-1").second == "XY:-5 7 -2 10 1 13 1 12");
+  }
+  SUBCASE("a repeat stops at the points one record holds") {
+    CHECK(xy("XY:0,0 h1*8190").first == Status::ok);
+    CHECK(xy("XY:0,0 h1*8191").first == Status::too_long);
+    CHECK(xy("XY:0,0 h1*3000000000").first == Status::too_long);
+  }
+  SUBCASE("garbage is a bad number") {
+    CHECK(xy("XY:0,0 q5").first == Status::bad_number);
+    CHECK(xy("XY:0 0").first == Status::bad_number);
+    CHECK(xy("XY:0,0 h1*0").first == Status::bad_number);
+  }
+  SUBCASE("other records and plain batches keep the plain notation") {
+    std::string lines = "LAYER:1\nXY:0,0 h5\n";
+    std::vector<unsigned char> gds;
+    CHECK(encode_batch(lines.data(), lines.size(), gds, true).records == 2);
+    CHECK(encode_batch(lines.data(), lines.size(), gds).status == Status::bad_number);
+  }
+}
+
+}
@@ -0,0 +1,175 @@
+#ifndef __CODEC__H__
+#define __CODEC__H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Format.hpp"
+
+namespace GDSTXT {
+
+// raw pointer helpers for contiguous record bodies, gds is big-endian
+inline uint16_t load_be16(const unsigned char* p) noexcept
+{
+  return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+inline uint32_t load_be32(const unsigned char* p) noexcept
+{
+  return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16)
+    | (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+
+inline void store_be16(unsigned char* p, uint16_t value) noexcept
+{
+  p[0] = static_cast<unsigned char>(value >> 8);
+  p[1] = static_cast<unsigned char>(value);
+}
+
+inline void store_be32(unsigned char* p, uint32_t value) noexcept
+{
+  p[0] = static_cast<unsigned char>(value >> 24);
+  p[1] = static_cast<unsigned char>(value >> 16);
+  p[2] = static_cast<unsigned char>(value >> 8);
+  p[3] = static_cast<unsigned char>(value);
+}
+
+// gds excess-64 base-16 real8 <-> IEEE double, every double converts exactly
+double real8_to_double(const unsigned char* bytes) noexcept;
+void double_to_real8(double value, unsigned char* bytes) noexcept;
+// the rounding txt2gds has always used for text values, kept so the same
+// text keeps giving the same bytes
+void text_to_real8(double value, unsigned char* bytes) noexcept;
+
+// The record <-> text line codec without exceptions: what the converters
+// in convert_func.hpp and StreamRecord/AsciiRecord throw for comes back
+// as a Status instead, so this part also builds with -fno-exceptions.
+// Running out of memory is the one failure left to the allocator.
+enum class Status : unsigned char {
+  ok,
+  // record header or body runs past the end of the input
+  truncated,
+  // record length below 4
+  bad_length,
+  unknown_tag,
+  // real4 and the data types SPEC has no notation for
+  bad_data_type,
+  // body size is not a multiple of the value size
+  corrupted_body,
+  // text value is not a number or does not fit the data type
+  bad_number,
+  // encoded record would exceed 65535 bytes
+  too_long
+};
+
+const char* status_message(Status status) noexcept;
+
+// a value or why there is none
+template<typename T>
+class Result {
+  public:
+    Result(T value) noexcept : _value(value), _status(Status::ok) {}
+    Result(Status status) noexcept : _value(), _status(status) {}
+    explicit operator bool() const noexcept { return _status == Status::ok; }
+    Status status() const noexcept { return _status; }
+    const T& value() const noexcept { return _value; }
+  private:
+    T _value;
+    Status _status;
+};
+
+// How the records of one tag convert: the entry of a 256-entry table
+// indexed by tag and built at compile time from SPEC::tag_specs, pointing
+// at the handlers specialized for that tag's data type, one per direction.
+struct RecordCodec {
+  const char* name;
+  std::size_t name_size;
+  unsigned char data_type;
+  // body bytes per value, 0 for NODATA and ASCII
+  std::size_t width;
+  // ":values" for a body of size bytes, nothing for NODATA or an empty
+  // body; returns one past the last char written
+  char* (*decode)(const unsigned char* body, std::size_t size, char* out) noexcept;
+  // the text after ':' appended to gds as body bytes
+  Status (*encode)(const char* first, const char* last, std::vector<unsigned char>& gds);
+
+  // most chars write_text() gives for a body of size bytes
+  std::size_t text_bound(std::size_t size) const noexcept
+  {
+    return name_size + 1 + (width == 0 ? size : size / width * (max_number_width + 1));
+  }
+  // name and values, room for text_bound(size) chars is up to the caller
+  char* write_text(const unsigned char* body, std::size_t size, char* out) const noexcept
+  {
+    for (std::size_t i = 0; i < name_size; ++i)
+      *out++ = name[i];
+    return decode(body, size, out);
+  }
+};
+
+// codec for a record of this tag, data type and body size; records whose
+// data type is not the one SPEC gives are decoded by their own data type
+Result<RecordCodec> record_codec(unsigned char tag, unsigned char data_type, std::size_t size) noexcept;
+
+// One record's text line written as its body arrives in pieces of any
+// size, e.g. an 8191 point XY straight out of read buffers. A value split
+// between two pieces is carried over to the next, so the record is never
+// whole in memory; ASCII bodies are the exception, held until end() to
+// drop their NUL padding. The line is the one write_text() gives.
+class RecordTextStream {
+  public:
+    Status begin(unsigned char tag, unsigned char data_type, std::size_t size) noexcept;
+    // most chars feed() writes for size more bytes
+    std::size_t feed_bound(std::size_t size) const noexcept
+    {
+      return _codec.name_size + 1 + (_codec.width == 0 ? 0 : (size + _carried) / _codec.width * (max_number_width + 1));
+    }
+    char* feed(const unsigned char* data, std::size_t size, char* out);
+    // most chars end() writes
+    std::size_t end_bound() const noexcept { return _codec.name_size + _ascii.size() + 2; }
+    // rest of the line and its newline, once the whole body was fed
+    char* end(char* out) noexcept;
+  private:
+    char* _values(const unsigned char* data, std::size_t size, char* out) noexcept;
+
+    RecordCodec _codec {};
+    bool _started = false;
+    unsigned char _carry[8];
+    std::size_t _carried = 0;
+    std::vector<unsigned char> _ascii;
+};
+
+// tag byte of a text record name such as "BOUNDARY"
+Result<unsigned char> tag_from_name(const char* name, std::size_t size) noexcept;
+
+// one record body as the text line StreamRecord::to_text() gives,
+// without newline, appended to text; text is unchanged on failure
+Status decode_record(unsigned char tag, unsigned char data_type, const unsigned char* body,
+                     std::size_t size, std::vector<char>& text);
+
+// one text line without newline as AsciiRecord::to_stream() bytes,
+// appended to gds; gds is unchanged on failure. With compact an XY line
+// is in the compact dialect's notation, see Dialect.hpp
+Status encode_record(const char* line, std::size_t size, std::vector<unsigned char>& gds,
+                     bool compact = false);
+
+// where a batch stopped: records converted and input bytes they took,
+// on failure the next record is the one status is about
+struct BatchResult {
+  Status status;
+  std::size_t records;
+  std::size_t consumed;
+};
+
+// every record of data as a newline terminated text line, data has to
+// hold whole records; the caller checks the status once per batch
+BatchResult decode_batch(const unsigned char* data, std::size_t size, std::vector<char>& text);
+
+// newline separated lines as gds records, a last line without newline
+// included, so batches have to be split after a newline
+BatchResult encode_batch(const char* text, std::size_t size, std::vector<unsigned char>& gds,
+                         bool compact = false);
+
+}
+
+#endif //__CODEC__H__
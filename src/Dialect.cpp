@@ -0,0 +1,120 @@
+#include "Dialect.hpp"
+#include "SPEC.hpp"
+#include "convert_func.hpp"
+#include <stdexcept>
+
+namespace GDSTXT {
+
+const char compact_dialect_header[] = "#dialect:compact-1";
+
+TextDialect parse_dialect_header(const std::string& line)
+{
+  if (line.compare(0, 9, "#dialect:") != 0)
+    return TextDialect::plain;
+  auto name = line.substr(9);
+  while (!name.empty() && (name.back() == ' ' || name.back() == '\r'))
+    name.pop_back();
+  if (name == "plain")
+    return TextDialect::plain;
+  if (name == "compact-1")
+    return TextDialect::compact;
+  throw std::runtime_error("unknow text dialect " + name);
+}
+
+void write_dialect_header(TextDialect dialect, IO::Writer& out)
+{
+  if (dialect == TextDialect::compact) {
+    out.write(compact_dialect_header);
+    out.put('\n');
+  }
+}
+
+///////////////////////////////////////////
+
+namespace {
+
+void _write_move(IO::Writer& out, int64_t dx, int64_t dy, int64_t repeat)
+{
+  out.put(' ');
+  if (dx == 0 && dy != 0) {
+    out.put('v');
+    out.write_int(dy);
+  } else if (dy == 0 && dx != 0) {
+    out.put('h');
+    out.write_int(dx);
+  } else {
+    out.write_int(dx);
+    out.put(',');
+    out.write_int(dy);
+  }
+  if (repeat > 1) {
+    out.put('*');
+    out.write_int(repeat);
+  }
+}
+
+// x_at/y_at give point i widened to int64_t, tag name and ':' are written
+template<typename X, typename Y>
+void _write_compact(std::size_t count, X x_at, Y y_at, IO::Writer& out)
+{
+  if (count == 0) {
+    out.put('\n');
+    return;
+  }
+
+  out.write_int(x_at(0));
+  out.put(',');
+  out.write_int(y_at(0));
+
+  // closing point of polygons collapses to z
+  auto last = count;
+  bool closed = count > 2 && x_at(count - 1) == x_at(0) && y_at(count - 1) == y_at(0);
+  if (closed)
+    --last;
+
+  std::size_t i = 1;
+  while (i < last) {
+    auto dx = x_at(i) - x_at(i - 1);
+    auto dy = y_at(i) - y_at(i - 1);
+    std::size_t run = 1;
+    while (i + run < last
+           && x_at(i + run) - x_at(i + run - 1) == dx
+           && y_at(i + run) - y_at(i + run - 1) == dy) {
+      ++run;
+    }
+    _write_move(out, dx, dy, run);
+    i += run;
+  }
+  if (closed)
+    out.write(" z");
+  out.put('\n');
+}
+
+}
+
+void write_compact_xy(const IO::RecordView& record, IO::Writer& out)
+{
+  if (record.size % 8 != 0)
+    throw std::runtime_error("XY data is corrupted");
+  out.write(std::get<0>(SPEC::tagname_map.at(record.tag)));
+  out.put(':');
+  _write_compact(record.size / 8,
+    [&record](std::size_t i) {
+      return static_cast<int64_t>(static_cast<int32_t>(load_be32(record.body + i * 8)));
+    },
+    [&record](std::size_t i) {
+      return static_cast<int64_t>(static_cast<int32_t>(load_be32(record.body + i * 8 + 4)));
+    },
+    out);
+}
+
+void write_compact_points(const std::vector<Point>& points, IO::Writer& out)
+{
+  out.write("XY:");
+  _write_compact(points.size(),
+    [&points](std::size_t i) { return static_cast<int64_t>(points[i].x); },
+    [&points](std::size_t i) { return static_cast<int64_t>(points[i].y); },
+    out);
+}
+
+}
@@ -0,0 +1,43 @@
+#ifndef __DIALECT__H__
+#define __DIALECT__H__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "Reader.hpp"
+#include "Writer.hpp"
+#include "Element.hpp"
+
+// Compact text dialect, announced by the first line "#dialect:compact-1".
+// Every record stays a TAG:values line except XY, whose points become
+//   XY:x0,y0 tok tok ...
+// where each token moves from the previous point:
+//   dx,dy    any move
+//   h<dx>    horizontal move, y repeats
+//   v<dy>    vertical move, x repeats
+//   z        back to the first point, only as the last token
+// and any token may carry *N when the same move repeats N times, e.g. a
+// Manhattan rectangle is "XY:0,0 h100 v50 h-100 z". encode_record() and
+// encode_batch() in Codec.hpp read these lines when asked to.
+
+namespace GDSTXT {
+
+enum class TextDialect {
+  plain,
+  compact
+};
+
+extern const char compact_dialect_header[];
+
+// plain for lines that aren't a dialect header
+TextDialect parse_dialect_header(const std::string& line);
+void write_dialect_header(TextDialect dialect, IO::Writer& out);
+
+// XY:... line for the record, newline included
+void write_compact_xy(const IO::RecordView& record, IO::Writer& out);
+// same line for decoded points
+void write_compact_points(const std::vector<Point>& points, IO::Writer& out);
+
+}
+
+#endif //__DIALECT__H__
@@ -0,0 +1,245 @@
+#include "Diff.hpp"
+#include "SPEC.hpp"
+#include "TextFormat.hpp"
+#include "test_config.h"
+#include "test_fixtures.h"
+#include <cstring>
+#include <unordered_map>
+
+namespace GDSTXT {
+
+namespace {
+
+bool _element_begin(unsigned char tag) noexcept
+{
+  switch (static_cast<SPEC::Tag>(tag)) {
+    case SPEC::Tag::BOUNDARY:
+    case SPEC::Tag::PATH:
+    case SPEC::Tag::SREF:
+    case SPEC::Tag::AREF:
+    case SPEC::Tag::TEXT:
+    case SPEC::Tag::NODE:
+    case SPEC::Tag::BOX:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// end of the structure-free records ahead of the first BGNSTR
+uint64_t _header_end(std::size_t size, const std::vector<StructureSpan>& spans)
+{
+  return spans.empty() ? size : spans.front().begin;
+}
+
+}
+
+LibraryDiff::LibraryDiff(const unsigned char* old_data, std::size_t old_size,
+                         const unsigned char* new_data, std::size_t new_size, unsigned threads)
+  : _old(old_data), _old_size(old_size), _new(new_data), _new_size(new_size)
+{
+  auto old_spans = scan_structures(old_data, old_size);
+  auto new_spans = scan_structures(new_data, new_size);
+
+  std::unordered_map<std::string, std::size_t> new_index;
+  for (std::size_t i = 0; i < new_spans.size(); ++i)
+    new_index.emplace(new_spans[i].name, i);
+
+  // (old, new) pairs present in both files
+  std::vector<std::pair<std::size_t, std::size_t>> common;
+  std::vector<bool> matched(new_spans.size(), false);
+  for (std::size_t i = 0; i < old_spans.size(); ++i) {
+    auto found = new_index.find(old_spans[i].name);
+    if (found == new_index.end()) {
+      _removed.push_back(old_spans[i].name);
+      continue;
+    }
+    common.emplace_back(i, found->second);
+    matched[found->second] = true;
+  }
+  for (std::size_t i = 0; i < new_spans.size(); ++i) {
+    if (!matched[i])
+      _added.push_back(new_spans[i].name);
+  }
+
+  // bytes first, elements only for the cells whose bodies differ
+  std::vector<Change> changes(common.size() + 1);
+  parallel_for(common.size() + 1, threads, [&](std::size_t i) {
+    if (i == common.size()) {
+      _compare(0, _header_end(old_size, old_spans), 0, _header_end(new_size, new_spans), changes[i]);
+      return;
+    }
+    const auto& l = old_spans[common[i].first];
+    const auto& r = new_spans[common[i].second];
+    auto old_body = old_data + l.body;
+    auto new_body = new_data + r.body;
+    if (l.end - l.body == r.end - r.body && std::memcmp(old_body, new_body, l.end - l.body) == 0)
+      return;
+    changes[i].name = l.name;
+    _compare(l.body, l.end, r.body, r.end, changes[i]);
+  });
+
+  auto& header = changes.back();
+  if (!header.removed.empty() || !header.added.empty())
+    _changed.push_back(std::move(header));
+  changes.pop_back();
+  for (auto& change : changes) {
+    if (!change.removed.empty() || !change.added.empty())
+      _changed.push_back(std::move(change));
+  }
+}
+
+void LibraryDiff::_compare(uint64_t old_begin, uint64_t old_end, uint64_t new_begin, uint64_t new_end,
+                           Change& change) const
+{
+  auto split = [](const unsigned char* data, uint64_t begin, uint64_t end, std::vector<Group>& groups) {
+    IO::RecordCursor cursor(data, end, begin);
+    IO::RecordView record;
+    auto offset = cursor.offset();
+    auto group_begin = offset;
+    bool in_element = false;
+    while (cursor.next(record)) {
+      auto tag = static_cast<SPEC::Tag>(record.tag);
+      if (!in_element && _element_begin(record.tag)) {
+        in_element = true;
+        group_begin = offset;
+      } else if (!in_element && tag != SPEC::Tag::BGNLIB && tag != SPEC::Tag::ENDSTR) {
+        groups.push_back(Group {offset, cursor.offset()});
+      } else if (in_element && tag == SPEC::Tag::ENDEL) {
+        in_element = false;
+        groups.push_back(Group {group_begin, cursor.offset()});
+      }
+      offset = cursor.offset();
+    }
+  };
+  std::vector<Group> old_groups, new_groups;
+  split(_old, old_begin, old_end, old_groups);
+  split(_new, new_begin, new_end, new_groups);
+
+  // multiset difference, each new group cancels one equal old group
+  std::unordered_map<uint64_t, std::vector<std::size_t>> unmatched;
+  for (std::size_t i = old_groups.size(); i-- > 0;) {
+    const auto& group = old_groups[i];
+    unmatched[hash64(_old + group.begin, group.end - group.begin)].push_back(i);
+  }
+  std::vector<bool> kept(old_groups.size(), false);
+  for (const auto& group : new_groups) {
+    auto size = group.end - group.begin;
+    auto found = unmatched.find(hash64(_new + group.begin, size));
+    bool same = false;
+    if (found != unmatched.end()) {
+      auto& candidates = found->second;
+      for (auto i = candidates.size(); i-- > 0;) {
+        const auto& old_group = old_groups[candidates[i]];
+        if (old_group.end - old_group.begin == size
+            && std::memcmp(_old + old_group.begin, _new + group.begin, size) == 0) {
+          kept[candidates[i]] = true;
+          candidates.erase(candidates.begin() + i);
+          same = true;
+          break;
+        }
+      }
+    }
+    if (!same)
+      change.added.push_back(group);
+  }
+  for (std::size_t i = 0; i < old_groups.size(); ++i) {
+    if (!kept[i])
+      change.removed.push_back(old_groups[i]);
+  }
+}
+
+bool LibraryDiff::empty() const noexcept
+{
+  return _removed.empty() && _added.empty() && _changed.empty();
+}
+
+void LibraryDiff::_write_groups(IO::Writer& out, char sign, const unsigned char* data,
+                                const std::vector<Group>& groups) const
+{
+  IO::RecordView record;
+  for (const auto& group : groups) {
+    IO::RecordCursor cursor(data, group.end, group.begin);
+    while (cursor.next(record)) {
+      out.put(sign);
+      write_record_text(record, out);
+    }
+  }
+}
+
+void LibraryDiff::write_report(IO::Writer& out) const
+{
+  for (const auto& name : _removed) {
+    out.write("- CELL ");
+    out.write(name);
+    out.put('\n');
+  }
+  for (const auto& name : _added) {
+    out.write("+ CELL ");
+    out.write(name);
+    out.put('\n');
+  }
+  for (const auto& change : _changed) {
+    if (change.name.empty()) {
+      out.write("~ LIBRARY -");
+    } else {
+      out.write("~ CELL ");
+      out.write(change.name);
+      out.write(" -");
+    }
+    out.write_int(static_cast<int64_t>(change.removed.size()));
+    out.write(" +");
+    out.write_int(static_cast<int64_t>(change.added.size()));
+    out.put('\n');
+    _write_groups(out, '-', _old, change.removed);
+    _write_groups(out, '+', _new, change.added);
+  }
+}
+
+TEST_CASE("testing LibraryDiff") {
+  auto build = [](const std::vector<std::pair<std::string, std::vector<int64_t>>>& cells) {
+    std::vector<unsigned char> gds;
+    test_record(gds, SPEC::Tag::HEADER, SPEC::TagDataType::INTEGER_2, {600});
+    for (const auto& cell : cells) {
+      test_record(gds, SPEC::Tag::BGNSTR, SPEC::TagDataType::INTEGER_2, std::vector<int64_t>(12, 0));
+      test_name(gds, SPEC::Tag::STRNAME, cell.first);
+      for (auto layer : cell.second) {
+        test_record(gds, SPEC::Tag::BOX, SPEC::TagDataType::NODATA);
+        test_record(gds, SPEC::Tag::LAYER, SPEC::TagDataType::INTEGER_2, {layer});
+        test_record(gds, SPEC::Tag::ENDEL, SPEC::TagDataType::NODATA);
+      }
+      test_record(gds, SPEC::Tag::ENDSTR, SPEC::TagDataType::NODATA);
+    }
+    test_record(gds, SPEC::Tag::ENDLIB, SPEC::TagDataType::NODATA);
+    return gds;
+  };
+  auto old_gds = build({{"A", {1, 2}}, {"B", {1}}, {"C", {3, 4, 5}}});
+  auto new_gds = build({{"A", {2, 1}}, {"C", {5, 3, 6}}, {"D", {1}}});
+
+  LibraryDiff diff(old_gds.data(), old_gds.size(), new_gds.data(), new_gds.size(), 2);
+  CHECK_FALSE(diff.empty());
+  std::vector<char> report;
+  IO::Writer out(std::unique_ptr<IO::OutputSink>(new IO::VectorSink(report, 1 << 16)), 1 << 16, "report");
+  diff.write_report(out);
+  out.close();
+  std::vector<std::string> lines;
+  std::string line;
+  for (auto c : report) {
+    if (c != '\n') {
+      line.push_back(c);
+      continue;
+    }
+    lines.push_back(line);
+    line.clear();
+  }
+  std::vector<std::string> expect {
+    "- CELL B", "+ CELL D", "~ CELL C -1 +1",
+    "-BOX", "-LAYER:4", "-ENDEL", "+BOX", "+LAYER:6", "+ENDEL"
+  };
+  CHECK(lines == expect);
+
+  LibraryDiff same(old_gds.data(), old_gds.size(), old_gds.data(), old_gds.size());
+  CHECK(same.empty());
+}
+
+}
@@ -0,0 +1,60 @@
+#ifndef __DIFF__H__
+#define __DIFF__H__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "Hash.hpp"
+#include "Writer.hpp"
+#include "Parallel.hpp"
+
+namespace GDSTXT {
+
+// Structure-level comparison of two gds images. Cells are matched by name
+// and their bodies compared byte for byte, BGNSTR dates and STRNAME left out;
+// only cells whose bodies differ are split into elements, which are
+// matched as whole record groups regardless of their order. The report is
+//   - CELL name            only in the old file
+//   + CELL name            only in the new file
+//   ~ CELL name -3 +1      changed, followed by the removed and added
+//   -BOUNDARY              elements as text records, one per line
+//   ...
+//   ~ LIBRARY -1 +1        header records other than BGNLIB that changed,
+//                          listed first, the same way
+class LibraryDiff {
+  public:
+    LibraryDiff(const unsigned char* old_data, std::size_t old_size,
+                const unsigned char* new_data, std::size_t new_size,
+                unsigned threads = default_thread_count());
+    bool empty() const noexcept;
+    void write_report(IO::Writer& out) const;
+  private:
+    // byte range of one element or of a record outside elements
+    struct Group {
+      uint64_t begin;
+      uint64_t end;
+    };
+    struct Change {
+      // empty for the library header
+      std::string name;
+      std::vector<Group> removed;
+      std::vector<Group> added;
+    };
+    void _compare(uint64_t old_begin, uint64_t old_end, uint64_t new_begin, uint64_t new_end,
+                  Change& change) const;
+    void _write_groups(IO::Writer& out, char sign, const unsigned char* data,
+                       const std::vector<Group>& groups) const;
+
+    const unsigned char* _old;
+    std::size_t _old_size;
+    const unsigned char* _new;
+    std::size_t _new_size;
+    std::vector<std::string> _removed;
+    std::vector<std::string> _added;
+    // header first when it differs, then cells in old file order
+    std::vector<Change> _changed;
+};
+
+}
+
+#endif //__DIFF__H__
@@ -0,0 +1,171 @@
+#include "Element.hpp"
+#include "convert_func.hpp"
+#include "test_config.h"
+#include <stdexcept>
+
+namespace GDSTXT {
+
+void Element::reset(ElementKind element_kind)
+{
+  kind = element_kind;
+  layer = datatype = pathtype = 0;
+  width = 0;
+  strans = 0;
+  mag = 1.0;
+  angle = 0.0;
+  columns = rows = 0;
+  sname.clear();
+  text.clear();
+  xy.clear();
+}
+
+const char* element_kind_name(ElementKind kind) noexcept
+{
+  switch (kind) {
+    case ElementKind::boundary: return "BOUNDARY";
+    case ElementKind::path:     return "PATH";
+    case ElementKind::sref:     return "SREF";
+    case ElementKind::aref:     return "AREF";
+    case ElementKind::text:     return "TEXT";
+    case ElementKind::node:     return "NODE";
+    case ElementKind::box:      return "BOX";
+  }
+  return "UNKNOW";
+}
+
+///////////////////////////////////////////
+
+static void _check_size(const IO::RecordView& record, std::size_t size)
+{
+  if (record.size < size)
+    throw std::runtime_error(std::get<0>(SPEC::tagname_map.at(record.tag)) + " data is corrupted");
+}
+
+int16_t record_int2(const IO::RecordView& record)
+{
+  _check_size(record, 2);
+  return static_cast<int16_t>(load_be16(record.body));
+}
+
+int32_t record_int4(const IO::RecordView& record)
+{
+  _check_size(record, 4);
+  return static_cast<int32_t>(load_be32(record.body));
+}
+
+double record_real8(const IO::RecordView& record)
+{
+  _check_size(record, 8);
+  return real8_to_double(record.body);
+}
+
+std::string record_string(const IO::RecordView& record)
+{
+  auto end = record.body + record.size;
+  while (end != record.body && *(end - 1) == '\0')
+    --end;
+  return std::string(record.body, end);
+}
+
+void record_points(const IO::RecordView& record, std::vector<Point>& points)
+{
+  if (record.size % 8 != 0)
+    throw std::runtime_error("XY data is corrupted");
+  auto count = record.size / 8;
+  auto offset = points.size();
+  points.resize(offset + count);
+  for (std::size_t i = 0; i < count; ++i) {
+    points[offset + i].x = static_cast<int32_t>(load_be32(record.body + i * 8));
+    points[offset + i].y = static_cast<int32_t>(load_be32(record.body + i * 8 + 4));
+  }
+}
+
+TEST_CASE("testing record_points") {
+  unsigned char data[] {
+    0x00, 0x00, 0x00, 0x01, 0xff, 0xff, 0xff, 0xfe,
+    0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00,
+  };
+  IO::RecordView record {0x10, 0x03, data, sizeof(data)};
+  std::vector<Point> points;
+  record_points(record, points);
+  CHECK(points.size() == 2);
+  CHECK(points[0].x == 1);
+  CHECK(points[0].y == -2);
+  CHECK(points[1].x == 256);
+  record.size = 6;
+  CHECK_THROWS_AS(record_points(record, points), std::exception);
+}
+
+///////////////////////////////////////////
+
+ElementDecoder::ElementDecoder(ElementHandler& handler)
+  : _handler(handler), _in_element(false), _in_structure(false)
+{}
+
+void ElementDecoder::feed(const IO::RecordView& record)
+{
+  auto tag = static_cast<SPEC::Tag>(record.tag);
+
+  if (_in_element) {
+    switch (tag) {
+      case SPEC::Tag::LAYER:    _element.layer = record_int2(record); break;
+      case SPEC::Tag::DATATYPE:
+      case SPEC::Tag::TEXTTYPE:
+      case SPEC::Tag::NODETYPE:
+      case SPEC::Tag::BOXTYPE:  _element.datatype = record_int2(record); break;
+      case SPEC::Tag::PATHTYPE: _element.pathtype = record_int2(record); break;
+      case SPEC::Tag::WIDTH:    _element.width = record_int4(record); break;
+      case SPEC::Tag::STRANS:   _element.strans = static_cast<uint16_t>(record_int2(record)); break;
+      case SPEC::Tag::MAG:      _element.mag = record_real8(record); break;
+      case SPEC::Tag::ANGLE:    _element.angle = record_real8(record); break;
+      case SPEC::Tag::SNAME:    _element.sname = record_string(record); break;
+      case SPEC::Tag::STRING:   _element.text = record_string(record); break;
+      case SPEC::Tag::XY:       record_points(record, _element.xy); break;
+      case SPEC::Tag::COLROW: {
+        _check_size(record, 4);
+        _element.columns = static_cast<int16_t>(load_be16(record.body));
+        _element.rows = static_cast<int16_t>(load_be16(record.body + 2));
+        break;
+      }
+      case SPEC::Tag::ENDEL: {
+        _in_element = false;
+        _handler.element(_element);
+        break;
+      }
+      default:
+        break;
+    }
+    return;
+  }
+
+  switch (tag) {
+    case SPEC::Tag::LIBNAME:  _handler.library(record_string(record)); break;
+    case SPEC::Tag::UNITS: {
+      _check_size(record, 16);
+      _handler.units(real8_to_double(record.body), real8_to_double(record.body + 8));
+      break;
+    }
+    case SPEC::Tag::STRNAME: {
+      _in_structure = true;
+      _handler.begin_structure(record_string(record));
+      break;
+    }
+    case SPEC::Tag::ENDSTR: {
+      if (_in_structure)
+        _handler.end_structure();
+      _in_structure = false;
+      break;
+    }
+    case SPEC::Tag::BOUNDARY: _in_element = true; _element.reset(ElementKind::boundary); break;
+    case SPEC::Tag::PATH:     _in_element = true; _element.reset(ElementKind::path); break;
+    case SPEC::Tag::SREF:     _in_element = true; _element.reset(ElementKind::sref); break;
+    case SPEC::Tag::AREF:     _in_element = true; _element.reset(ElementKind::aref); break;
+    case SPEC::Tag::TEXT:     _in_element = true; _element.reset(ElementKind::text); break;
+    case SPEC::Tag::NODE:     _in_element = true; _element.reset(ElementKind::node); break;
+    case SPEC::Tag::BOX:      _in_element = true; _element.reset(ElementKind::box); break;
+    default:
+      break;
+  }
+}
+
+}
@@ -0,0 +1,82 @@
+#ifndef __ELEMENT__H__
+#define __ELEMENT__H__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "Reader.hpp"
+#include "SPEC.hpp"
+
+namespace GDSTXT {
+
+struct Point {
+  int32_t x;
+  int32_t y;
+};
+
+enum class ElementKind : unsigned char {
+  boundary,
+  path,
+  sref,
+  aref,
+  text,
+  node,
+  box
+};
+
+// one BOUNDARY/PATH/SREF/AREF/TEXT/NODE/BOX ... ENDEL group,
+// datatype also carries TEXTTYPE, NODETYPE and BOXTYPE
+struct Element {
+  ElementKind kind = ElementKind::boundary;
+  int16_t layer = 0;
+  int16_t datatype = 0;
+  int16_t pathtype = 0;
+  int32_t width = 0;
+  uint16_t strans = 0;
+  double mag = 1.0;
+  double angle = 0.0;
+  int16_t columns = 0;
+  int16_t rows = 0;
+  std::string sname;
+  std::string text;
+  std::vector<Point> xy;
+
+  // back to defaults, keeps the capacity of xy and strings
+  void reset(ElementKind element_kind);
+};
+
+const char* element_kind_name(ElementKind kind) noexcept;
+
+class ElementHandler {
+  public:
+    virtual void library(const std::string&) {}
+    virtual void units(double, double) {}
+    virtual void begin_structure(const std::string&) {}
+    virtual void element(const Element& element) = 0;
+    virtual void end_structure() {}
+    virtual ~ElementHandler() = default;
+};
+
+// groups a record stream into elements without buffering more than one
+// element, properties and unknown records inside an element are skipped
+class ElementDecoder {
+  public:
+    explicit ElementDecoder(ElementHandler& handler);
+    void feed(const IO::RecordView& record);
+  private:
+    ElementHandler& _handler;
+    Element _element;
+    bool _in_element;
+    bool _in_structure;
+};
+
+// record decoding on raw big-endian bodies, throw on corrupted sizes
+int16_t record_int2(const IO::RecordView& record);
+int32_t record_int4(const IO::RecordView& record);
+double record_real8(const IO::RecordView& record);
+std::string record_string(const IO::RecordView& record);
+void record_points(const IO::RecordView& record, std::vector<Point>& points);
+
+}
+
+#endif //__ELEMENT__H__
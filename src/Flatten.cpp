@@ -0,0 +1,368 @@
+#include "Flatten.hpp"
+#include "Aref.hpp"
+#include "test_config.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+
+namespace GDSTXT {
+
+namespace {
+
+// enough tasks to balance threads, few enough to keep scheduling cheap
+constexpr std::size_t target_tasks = 256;
+constexpr std::size_t max_tasks = 4096;
+
+bool _is_reference(const Element& element) noexcept
+{
+  return element.kind == ElementKind::sref || element.kind == ElementKind::aref;
+}
+
+bool _is_geometry(const Element& element) noexcept
+{
+  return element.kind == ElementKind::boundary || element.kind == ElementKind::path
+    || element.kind == ElementKind::box;
+}
+
+}
+
+void transform_element(const Element& element, const Transform& transform, Element& out)
+{
+  out = element;
+  for (auto& point : out.xy)
+    point = transform.apply(point);
+  // negative width is absolute and stays as it is
+  if (out.width > 0)
+    out.width = static_cast<int32_t>(std::llround(out.width * transform.scale()));
+}
+
+Flattener::Flattener(const Library& library, unsigned threads)
+  : _library(library), _threads(threads)
+{}
+
+template<typename F>
+void Flattener::_for_each_placement(const Element& reference, const Transform& parent, F&& fn) const
+{
+  _for_each_placement(reference, parent, 0, INT32_MAX, std::forward<F>(fn));
+}
+
+template<typename F>
+void Flattener::_for_each_placement(const Element& reference, const Transform& parent,
+                                    int32_t row_begin, int32_t row_end, F&& fn) const
+{
+  auto child = _library.find(reference.sname);
+  if (child == nullptr)
+    throw std::runtime_error("structure " + reference.sname + " is referenced but not defined");
+  if (reference.xy.empty())
+    throw std::runtime_error("reference to " + reference.sname + " has no XY");
+
+  if (reference.kind == ElementKind::sref) {
+    fn(*child, parent * Transform::placement(reference, reference.xy[0]));
+    return;
+  }
+
+  // instances only differ by their origin, moved through the parent;
+  // one row of origins at a time keeps giant arrays out of memory
+  ArefLattice lattice(reference);
+  auto base = parent * Transform::placement(reference, Point {0, 0});
+  std::vector<int32_t> x(static_cast<std::size_t>(lattice.columns()));
+  std::vector<int32_t> y(x.size());
+  for (int32_t row = row_begin; row < std::min(row_end, lattice.rows()); ++row) {
+    lattice.row(row, x.data(), y.data());
+    for (std::size_t column = 0; column < x.size(); ++column) {
+      auto instance = base;
+      instance.tx += parent.a * x[column] + parent.b * y[column];
+      instance.ty += parent.c * x[column] + parent.d * y[column];
+      fn(*child, instance);
+    }
+  }
+}
+
+void Flattener::_run(const Task& task, std::vector<Element>& out) const
+{
+  auto place = [this, &out](const Structure& child, const Transform& transform) {
+    _run(Task {&child, transform, 0, child.elements.size()}, out);
+  };
+  const auto& elements = task.structure->elements;
+  if (task.row_end > 0) {
+    _for_each_placement(elements[task.begin], task.transform, task.row_begin, task.row_end, place);
+    return;
+  }
+  for (auto i = task.begin; i < task.end; ++i) {
+    const auto& element = elements[i];
+    if (_is_reference(element)) {
+      _for_each_placement(element, task.transform, place);
+    } else if (_is_geometry(element)) {
+      out.emplace_back();
+      transform_element(element, task.transform, out.back());
+    }
+  }
+}
+
+// replaces every task holding references by its pieces in the same order:
+// runs of local geometry stay with the parent, an SREF becomes a task and
+// an AREF a task of all its rows, which splits into one task per row and
+// a row into one task per placement
+bool Flattener::_split(std::vector<Task>& tasks) const
+{
+  std::vector<Task> next;
+  bool changed = false;
+  for (std::size_t t = 0; t < tasks.size(); ++t) {
+    const auto& task = tasks[t];
+    const auto& elements = task.structure->elements;
+    std::size_t pieces = 0;
+    if (task.row_end > 0) {
+      pieces = task.row_end - task.row_begin > 1
+        ? static_cast<std::size_t>(task.row_end - task.row_begin)
+        : static_cast<std::size_t>(ArefLattice(elements[task.begin]).columns());
+    } else {
+      for (auto i = task.begin; i < task.end; ++i) {
+        if (_is_reference(elements[i]))
+          pieces += 2;
+      }
+    }
+    if (pieces == 0 || next.size() + pieces + (tasks.size() - t) > max_tasks) {
+      next.push_back(task);
+      continue;
+    }
+
+    changed = true;
+    if (task.row_end - task.row_begin > 1) {
+      for (auto row = task.row_begin; row < task.row_end; ++row)
+        next.push_back(Task {task.structure, task.transform, task.begin, task.end, row, row + 1});
+      continue;
+    }
+    if (task.row_end > 0) {
+      _for_each_placement(elements[task.begin], task.transform, task.row_begin, task.row_end,
+        [&next](const Structure& child, const Transform& transform) {
+          next.push_back(Task {&child, transform, 0, child.elements.size()});
+        });
+      continue;
+    }
+    auto run_begin = task.begin;
+    for (auto i = task.begin; i < task.end; ++i) {
+      if (!_is_reference(elements[i]))
+        continue;
+      if (run_begin < i)
+        next.push_back(Task {task.structure, task.transform, run_begin, i});
+      run_begin = i + 1;
+      if (elements[i].kind == ElementKind::aref) {
+        auto rows = ArefLattice(elements[i]).rows();
+        next.push_back(Task {task.structure, task.transform, i, i + 1, 0, rows});
+        continue;
+      }
+      _for_each_placement(elements[i], task.transform,
+        [&next](const Structure& child, const Transform& transform) {
+          next.push_back(Task {&child, transform, 0, child.elements.size()});
+        });
+    }
+    if (run_begin < task.end)
+      next.push_back(Task {task.structure, task.transform, run_begin, task.end});
+  }
+  tasks.swap(next);
+  return changed;
+}
+
+void Flattener::check(const std::string& top) const
+{
+  enum class Mark : unsigned char { none, visiting, done };
+  std::vector<Mark> marks(_library.structures.size(), Mark::none);
+
+  auto root = _library.index_of(top);
+  if (root == Library::npos)
+    throw std::runtime_error("structure " + top + " is not defined");
+
+  // iterative depth-first walk, (structure, next element) pairs
+  std::vector<std::pair<std::size_t, std::size_t>> stack {{root, 0}};
+  marks[root] = Mark::visiting;
+  while (!stack.empty()) {
+    auto& frame = stack.back();
+    const auto& elements = _library.structures[frame.first].elements;
+    if (frame.second == elements.size()) {
+      marks[frame.first] = Mark::done;
+      stack.pop_back();
+      continue;
+    }
+    const auto& element = elements[frame.second++];
+    if (!_is_reference(element))
+      continue;
+    auto child = _library.index_of(element.sname);
+    if (child == Library::npos)
+      throw std::runtime_error("structure " + element.sname + " is referenced but not defined");
+    if (marks[child] == Mark::visiting)
+      throw std::runtime_error("reference cycle through " + element.sname);
+    if (marks[child] == Mark::none) {
+      marks[child] = Mark::visiting;
+      stack.emplace_back(child, 0);
+    }
+  }
+}
+
+FlatCount Flattener::count(const std::string& top) const
+{
+  check(top);
+  // per structure totals, children are always finished before their parents
+  std::vector<FlatCount> counts(_library.structures.size());
+  std::vector<bool> done(_library.structures.size(), false);
+  std::vector<std::pair<std::size_t, std::size_t>> stack {{_library.index_of(top), 0}};
+  while (!stack.empty()) {
+    auto& frame = stack.back();
+    const auto& elements = _library.structures[frame.first].elements;
+    if (frame.second == elements.size()) {
+      auto& total = counts[frame.first];
+      for (const auto& element : elements) {
+        if (_is_geometry(element))
+          ++total.elements;
+        if (!_is_reference(element))
+          continue;
+        auto instances = instance_count(element);
+        const auto& child = counts[_library.index_of(element.sname)];
+        total.instances += instances * (child.instances + 1);
+        total.elements += instances * child.elements;
+      }
+      done[frame.first] = true;
+      stack.pop_back();
+      continue;
+    }
+    const auto& element = elements[frame.second++];
+    if (!_is_reference(element))
+      continue;
+    auto child = _library.index_of(element.sname);
+    if (!done[child])
+      stack.emplace_back(child, 0);
+  }
+  return counts[_library.index_of(top)];
+}
+
+void Flattener::flatten(const std::string& top, ElementHandler& handler) const
+{
+  check(top);
+  auto root = _library.find(top);
+
+  std::vector<Task> tasks {Task {root, Transform(), 0, root->elements.size()}};
+  while (tasks.size() < target_tasks && _split(tasks)) {
+  }
+
+  handler.begin_structure(top);
+  // a window of tasks runs in parallel, then drains in order; row ranges
+  // left over from splitting go into the window a row at a time
+  auto window = std::max<std::size_t>(_threads * 4, 16);
+  std::vector<Task> running;
+  std::vector<std::vector<Element>> outputs(window);
+  std::size_t next = 0;
+  while (next < tasks.size()) {
+    running.clear();
+    while (running.size() < window && next < tasks.size()) {
+      auto& task = tasks[next];
+      if (task.row_end - task.row_begin > 1) {
+        running.push_back(task);
+        running.back().row_end = task.row_begin + 1;
+        ++task.row_begin;
+        continue;
+      }
+      running.push_back(task);
+      ++next;
+    }
+    parallel_for(running.size(), _threads, [this, &running, &outputs](std::size_t i) {
+      outputs[i].clear();
+      _run(running[i], outputs[i]);
+    });
+    for (std::size_t i = 0; i < running.size(); ++i) {
+      for (const auto& element : outputs[i])
+        handler.element(element);
+    }
+  }
+  handler.end_structure();
+}
+
+///////////////////////////////////////////
+
+namespace {
+
+class Collector: public ElementHandler {
+  public:
+    void element(const Element& element) override { elements.push_back(element); }
+    std::vector<Element> elements;
+};
+
+Structure _structure(const std::string& name, std::vector<Element> elements)
+{
+  Structure structure;
+  structure.name = name;
+  structure.elements = std::move(elements);
+  return structure;
+}
+
+}
+
+TEST_CASE("testing Flattener") {
+  Element box;
+  box.reset(ElementKind::boundary);
+  box.xy = {{0, 0}, {0, 1}, {1, 1}, {1, 0}, {0, 0}};
+  Element aref;
+  aref.reset(ElementKind::aref);
+  aref.sname = "A";
+  aref.columns = 2;
+  aref.rows = 1;
+  aref.xy = {{0, 0}, {20, 0}, {0, 5}};
+  Element sref;
+  sref.reset(ElementKind::sref);
+  sref.sname = "A";
+  sref.angle = 90;
+  sref.xy = {{100, 0}};
+
+  Library library;
+  library.add(_structure("A", {box}));
+  library.add(_structure("TOP", {aref, box, sref}));
+
+  auto count = Flattener(library).count("TOP");
+  CHECK(count.instances == 3);
+  CHECK(count.elements == 4);
+
+  for (unsigned threads : {1u, 3u}) {
+    Collector out;
+    Flattener(library, threads).flatten("TOP", out);
+    REQUIRE(out.elements.size() == 4);
+    CHECK(out.elements[0].xy[2].x == 1);
+    CHECK(out.elements[1].xy[2].x == 11);
+    CHECK(out.elements[2].xy[2].x == 1);
+    CHECK(out.elements[3].xy[2].x == 99);
+    CHECK(out.elements[3].xy[2].y == 1);
+  }
+
+  SUBCASE("an AREF past the task limit splits by rows and keeps its order") {
+    Element big = aref;
+    big.columns = 3;
+    big.rows = 3000;
+    big.xy = {{0, 0}, {30, 0}, {0, 30000}};
+    Library array;
+    array.add(_structure("A", {box}));
+    array.add(_structure("TOP", {box, big}));
+    CHECK(Flattener(array).count("TOP").elements == 9001);
+    for (unsigned threads : {1u, 4u}) {
+      Collector out;
+      Flattener(array, threads).flatten("TOP", out);
+      REQUIRE(out.elements.size() == 9001);
+      bool ordered = true;
+      for (std::size_t i = 0; i < 9000; ++i) {
+        const auto& origin = out.elements[i + 1].xy[0];
+        ordered = ordered && origin.x == static_cast<int32_t>(i % 3 * 10)
+          && origin.y == static_cast<int32_t>(i / 3 * 10);
+      }
+      CHECK(ordered);
+    }
+  }
+
+  SUBCASE("should throw on cycles and undefined cells") {
+    Collector out;
+    Library broken;
+    sref.sname = "LOOP";
+    broken.add(_structure("LOOP", {sref}));
+    CHECK_THROWS_AS(Flattener(broken).flatten("LOOP", out), std::exception);
+    CHECK_THROWS_AS(Flattener(library).flatten("NONE", out), std::exception);
+  }
+}
+
+}
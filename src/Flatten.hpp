@@ -0,0 +1,63 @@
+#ifndef __FLATTEN__H__
+#define __FLATTEN__H__
+
+#include <string>
+#include <vector>
+#include "Library.hpp"
+#include "Transform.hpp"
+#include "Parallel.hpp"
+
+namespace GDSTXT {
+
+// what flattening a top cell would produce, computed per structure
+struct FlatCount {
+  // SREF/AREF placements at every level
+  uint64_t instances = 0;
+  // BOUNDARY/PATH/BOX written to the flat cell
+  uint64_t elements = 0;
+};
+
+// Expands SREF/AREF below a top cell into transformed BOUNDARY/PATH/BOX.
+// The hierarchy is cut into subtree tasks that run on several threads;
+// every instance transforms the elements its structure decoded once.
+// AREFs are cut into row ranges, and rows are handed out one at a time
+// when written, so a giant array is never buffered whole.
+// Output follows the depth-first order whatever the thread count.
+class Flattener {
+  public:
+    explicit Flattener(const Library& library, unsigned threads = default_thread_count());
+    // handler sees begin_structure(top), the flat elements, end_structure()
+    void flatten(const std::string& top, ElementHandler& handler) const;
+    // totals without expanding anything, AREFs count as columns * rows
+    FlatCount count(const std::string& top) const;
+    // throws on undefined structures and reference cycles below top
+    void check(const std::string& top) const;
+  private:
+    // elements [begin, end) of structure, or with row_end > 0 the rows
+    // [row_begin, row_end) of the AREF at begin
+    struct Task {
+      const Structure* structure;
+      Transform transform;
+      std::size_t begin;
+      std::size_t end;
+      int32_t row_begin = 0;
+      int32_t row_end = 0;
+    };
+    void _run(const Task& task, std::vector<Element>& out) const;
+    bool _split(std::vector<Task>& tasks) const;
+    template<typename F>
+    void _for_each_placement(const Element& reference, const Transform& parent, F&& fn) const;
+    template<typename F>
+    void _for_each_placement(const Element& reference, const Transform& parent,
+                             int32_t row_begin, int32_t row_end, F&& fn) const;
+
+    const Library& _library;
+    unsigned _threads;
+};
+
+// copy of a BOUNDARY/PATH/BOX with its points and width transformed
+void transform_element(const Element& element, const Transform& transform, Element& out);
+
+}
+
+#endif //__FLATTEN__H__
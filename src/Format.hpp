@@ -0,0 +1,51 @@
+#ifndef __FORMAT__H__
+#define __FORMAT__H__
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+namespace GDSTXT {
+
+// longest output of format_int / format_real
+constexpr std::size_t max_number_width = 32;
+
+// decimal digits into out, returns one past the last char
+inline char* format_int(char* out, int64_t value) noexcept
+{
+  char digits[20];
+  int count = 0;
+  uint64_t magnitude = value < 0
+    ? 0 - static_cast<uint64_t>(value)
+    : static_cast<uint64_t>(value);
+  do {
+    digits[count++] = static_cast<char>('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude != 0);
+  if (value < 0)
+    *out++ = '-';
+  while (count > 0)
+    *out++ = digits[--count];
+  return out;
+}
+
+// %g with the given precision, precision 6 matches ostream << double
+inline char* format_real(char* out, double value, int precision = 6) noexcept
+{
+  auto count = std::snprintf(out, max_number_width, "%.*g", precision, value);
+  return out + (count > 0 ? count : 0);
+}
+
+// shortest of %.15g and %.17g that reads back as the same double
+inline char* format_real_exact(char* out, double value) noexcept
+{
+  auto end = format_real(out, value, 15);
+  *end = '\0';
+  if (std::strtod(out, nullptr) == value)
+    return end;
+  return format_real(out, value, 17);
+}
+
+}
+
+#endif //__FORMAT__H__
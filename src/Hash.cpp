@@ -0,0 +1,375 @@
+#include "Hash.hpp"
+#include "Element.hpp"
+#include "Library.hpp"
+#include "SPEC.hpp"
+#include "test_config.h"
+#include "test_fixtures.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+namespace GDSTXT {
+
+namespace {
+
+constexpr uint64_t prime1 = 11400714785074694791ULL;
+constexpr uint64_t prime2 = 14029467366897019727ULL;
+constexpr uint64_t prime3 = 1609587929392839161ULL;
+constexpr uint64_t prime4 = 9650029242287828579ULL;
+constexpr uint64_t prime5 = 2870177450012600261ULL;
+
+inline uint64_t _rotl(uint64_t value, int bits) noexcept
+{
+  return (value << bits) | (value >> (64 - bits));
+}
+
+inline uint64_t _load64(const unsigned char* p) noexcept
+{
+  uint64_t ret = 0;
+  for (int i = 7; i >= 0; --i)
+    ret = (ret << 8) | p[i];
+  return ret;
+}
+
+inline uint64_t _load32(const unsigned char* p) noexcept
+{
+  return uint64_t(p[0]) | uint64_t(p[1]) << 8 | uint64_t(p[2]) << 16 | uint64_t(p[3]) << 24;
+}
+
+inline uint64_t _round(uint64_t acc, uint64_t input) noexcept
+{
+  return _rotl(acc + input * prime2, 31) * prime1;
+}
+
+inline uint64_t _merge(uint64_t acc, uint64_t value) noexcept
+{
+  return (acc ^ _round(0, value)) * prime1 + prime4;
+}
+
+constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+bool _is(const IO::RecordView& record, SPEC::Tag tag) noexcept
+{
+  return record.tag == static_cast<unsigned char>(tag);
+}
+
+}
+
+uint64_t hash64(const unsigned char* data, std::size_t size, uint64_t seed) noexcept
+{
+  auto p = data;
+  auto end = data + size;
+  uint64_t h;
+  if (size >= 32) {
+    uint64_t v1 = seed + prime1 + prime2;
+    uint64_t v2 = seed + prime2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - prime1;
+    for (; p + 32 <= end; p += 32) {
+      v1 = _round(v1, _load64(p));
+      v2 = _round(v2, _load64(p + 8));
+      v3 = _round(v3, _load64(p + 16));
+      v4 = _round(v4, _load64(p + 24));
+    }
+    h = _rotl(v1, 1) + _rotl(v2, 7) + _rotl(v3, 12) + _rotl(v4, 18);
+    h = _merge(h, v1);
+    h = _merge(h, v2);
+    h = _merge(h, v3);
+    h = _merge(h, v4);
+  } else {
+    h = seed + prime5;
+  }
+  h += size;
+  for (; p + 8 <= end; p += 8)
+    h = _rotl(h ^ _round(0, _load64(p)), 27) * prime1 + prime4;
+  if (p + 4 <= end) {
+    h = _rotl(h ^ (_load32(p) * prime1), 23) * prime2 + prime3;
+    p += 4;
+  }
+  for (; p < end; ++p)
+    h = _rotl(h ^ (*p * prime5), 11) * prime1;
+  h ^= h >> 33;
+  h *= prime2;
+  h ^= h >> 29;
+  h *= prime3;
+  h ^= h >> 32;
+  return h;
+}
+
+TEST_CASE("testing hash64") {
+  auto text = [](const char* str) { return reinterpret_cast<const unsigned char*>(str); };
+  CHECK(hash64(text(""), 0) == 0xEF46DB3751D8E999ULL);
+  CHECK(hash64(text("abc"), 3) == 0x44BC2CF5AD770999ULL);
+  std::string long_text(100, 'x');
+  CHECK(hash64(text(long_text.c_str()), 100) != hash64(text(long_text.c_str()), 100, 1));
+}
+
+///////////////////////////////////////////
+
+std::vector<StructureSpan> scan_structures(const unsigned char* data, std::size_t size)
+{
+  std::vector<StructureSpan> ret;
+  IO::RecordCursor cursor(data, size);
+  IO::RecordView record;
+  auto offset = cursor.offset();
+  bool in_structure = false;
+  while (cursor.next(record)) {
+    if (_is(record, SPEC::Tag::BGNSTR)) {
+      ret.push_back(StructureSpan {"", offset, cursor.offset(), 0});
+      in_structure = true;
+    } else if (in_structure && _is(record, SPEC::Tag::STRNAME) && ret.back().name.empty()) {
+      ret.back().name = record_string(record);
+      ret.back().body = cursor.offset();
+    } else if (in_structure && _is(record, SPEC::Tag::ENDSTR)) {
+      ret.back().end = cursor.offset();
+      in_structure = false;
+    }
+    offset = cursor.offset();
+  }
+  if (in_structure)
+    throw std::runtime_error("structure " + ret.back().name + " has no ENDSTR");
+  return ret;
+}
+
+///////////////////////////////////////////
+
+StructureHashes::StructureHashes(const unsigned char* data, std::size_t size, unsigned threads)
+  : _data(data), _size(size), _spans(scan_structures(data, size))
+{
+  std::vector<std::string> names;
+  for (std::size_t i = 0; i < _spans.size(); ++i) {
+    if (!_index.emplace(_spans[i].name, i).second)
+      throw std::runtime_error("structure " + _spans[i].name + " is defined twice");
+    names.push_back(_spans[i].name);
+  }
+
+  // references first, undefined cells have no level to wait for
+  std::vector<std::vector<std::size_t>> children(_spans.size());
+  parallel_for(_spans.size(), threads, [this, &children](std::size_t i) {
+    IO::RecordCursor cursor(_data, _spans[i].end, _spans[i].body);
+    IO::RecordView record;
+    while (cursor.next(record)) {
+      if (!_is(record, SPEC::Tag::SNAME))
+        continue;
+      auto found = _index.find(record_string(record));
+      if (found != _index.end())
+        children[i].push_back(found->second);
+    }
+  });
+  auto levels = hierarchy_levels(children, names);
+  unsigned height = 0;
+  for (auto level : levels)
+    height = std::max(height, level);
+  std::vector<std::vector<std::size_t>> by_level(height + 1);
+  for (std::size_t i = 0; i < levels.size(); ++i)
+    by_level[levels[i]].push_back(i);
+
+  // a level only references lower levels, which are canonical already;
+  // identical cells share their level so grouping never crosses one
+  _hashes.resize(_spans.size());
+  _canonical.resize(_spans.size());
+  for (const auto& cells : by_level) {
+    parallel_for(cells.size(), threads, [this, &cells](std::size_t i) {
+      _hashes[cells[i]] = _hash(cells[i]);
+    });
+    std::unordered_map<uint64_t, std::vector<std::size_t>> seen;
+    for (auto i : cells) {
+      _canonical[i] = i;
+      auto& candidates = seen[_hashes[i]];
+      for (auto candidate : candidates) {
+        if (_same(candidate, i)) {
+          _canonical[i] = candidate;
+          break;
+        }
+      }
+      if (_canonical[i] == i)
+        candidates.push_back(i);
+    }
+  }
+}
+
+std::size_t StructureHashes::_target(const IO::RecordView& record) const
+{
+  auto found = _index.find(record_string(record));
+  return found == _index.end() ? npos : _canonical[found->second];
+}
+
+uint64_t StructureHashes::_hash(std::size_t i) const
+{
+  // runs between SNAME records are hashed in one go each
+  const auto& span = _spans[i];
+  uint64_t h = 0;
+  auto run = span.body;
+  IO::RecordCursor cursor(_data, span.end, span.body);
+  IO::RecordView record;
+  auto offset = cursor.offset();
+  while (cursor.next(record)) {
+    if (_is(record, SPEC::Tag::SNAME)) {
+      h = hash64(_data + run, offset - run, h);
+      auto target = _target(record);
+      if (target == npos) {
+        h = hash64(_data + offset, cursor.offset() - offset, h);
+      } else {
+        unsigned char id[8];
+        store_be32(id, static_cast<uint32_t>(_hashes[target] >> 32));
+        store_be32(id + 4, static_cast<uint32_t>(_hashes[target]));
+        h = hash64(id, sizeof(id), h);
+      }
+      run = cursor.offset();
+    }
+    offset = cursor.offset();
+  }
+  return hash64(_data + run, span.end - run, h);
+}
+
+bool StructureHashes::_same(std::size_t l, std::size_t r) const
+{
+  IO::RecordCursor left(_data, _spans[l].end, _spans[l].body);
+  IO::RecordCursor right(_data, _spans[r].end, _spans[r].body);
+  IO::RecordView a, b;
+  while (true) {
+    bool more_a = left.next(a);
+    bool more_b = right.next(b);
+    if (more_a != more_b)
+      return false;
+    if (!more_a)
+      return true;
+    if (a.tag != b.tag || a.data_type != b.data_type)
+      return false;
+    if (_is(a, SPEC::Tag::SNAME)) {
+      auto target_a = _target(a);
+      auto target_b = _target(b);
+      if (target_a != target_b || (target_a == npos && record_string(a) != record_string(b)))
+        return false;
+      continue;
+    }
+    if (a.size != b.size || std::memcmp(a.body, b.body, a.size) != 0)
+      return false;
+  }
+}
+
+std::vector<std::vector<std::size_t>> StructureHashes::duplicate_groups() const
+{
+  std::unordered_map<std::size_t, std::size_t> group_of;
+  std::vector<std::vector<std::size_t>> ret;
+  for (std::size_t i = 0; i < _spans.size(); ++i) {
+    if (_canonical[i] == i)
+      continue;
+    auto found = group_of.find(_canonical[i]);
+    if (found == group_of.end()) {
+      found = group_of.emplace(_canonical[i], ret.size()).first;
+      ret.push_back(std::vector<std::size_t> {_canonical[i]});
+    }
+    ret[found->second].push_back(i);
+  }
+  return ret;
+}
+
+void StructureHashes::write_duplicate_groups(IO::Writer& out) const
+{
+  for (const auto& group : duplicate_groups()) {
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(_hashes[group[0]]));
+    out.write(hex, 16);
+    for (auto i : group) {
+      out.put(' ');
+      out.write(_spans[i].name);
+    }
+    out.put('\n');
+  }
+}
+
+void StructureHashes::write_deduplicated(IO::Writer& out) const
+{
+  auto copy = [this, &out](uint64_t begin, uint64_t end) {
+    out.write(reinterpret_cast<const char*>(_data + begin), static_cast<std::size_t>(end - begin));
+  };
+
+  uint64_t position = 0;
+  for (std::size_t i = 0; i < _spans.size(); ++i) {
+    const auto& span = _spans[i];
+    copy(position, span.begin);
+    position = span.end;
+    if (_canonical[i] != i)
+      continue;
+
+    auto run = span.begin;
+    IO::RecordCursor cursor(_data, span.end, span.body);
+    IO::RecordView record;
+    auto offset = cursor.offset();
+    while (cursor.next(record)) {
+      std::size_t target;
+      if (_is(record, SPEC::Tag::SNAME) && (target = _target(record)) != npos
+          && _spans[target].name != record_string(record)) {
+        copy(run, offset);
+        auto name = _spans[target].name;
+        if (name.size() % 2)
+          name.push_back('\0');
+        unsigned char meta[4];
+        store_be16(meta, static_cast<uint16_t>(name.size() + 4));
+        meta[2] = record.tag;
+        meta[3] = record.data_type;
+        out.write(reinterpret_cast<const char*>(meta), 4);
+        out.write(name);
+        run = cursor.offset();
+      }
+      offset = cursor.offset();
+    }
+    copy(run, span.end);
+  }
+  copy(position, _size);
+}
+
+TEST_CASE("testing StructureHashes") {
+  std::vector<unsigned char> gds;
+  auto structure = [&gds](const std::string& str, int64_t date, const std::string& child, int64_t x) {
+    test_record(gds, SPEC::Tag::BGNSTR, SPEC::TagDataType::INTEGER_2, std::vector<int64_t>(12, date));
+    test_name(gds, SPEC::Tag::STRNAME, str);
+    if (child.empty())
+      test_record(gds, SPEC::Tag::BOUNDARY, SPEC::TagDataType::NODATA);
+    else {
+      test_record(gds, SPEC::Tag::SREF, SPEC::TagDataType::NODATA);
+      test_name(gds, SPEC::Tag::SNAME, child);
+    }
+    test_record(gds, SPEC::Tag::XY, SPEC::TagDataType::INTEGER_4, {x, 0});
+    test_record(gds, SPEC::Tag::ENDEL, SPEC::TagDataType::NODATA);
+    test_record(gds, SPEC::Tag::ENDSTR, SPEC::TagDataType::NODATA);
+  };
+  test_record(gds, SPEC::Tag::HEADER, SPEC::TagDataType::INTEGER_2, {600});
+  structure("A", 1, "", 5);
+  structure("A_COPY", 2, "", 5);
+  structure("B", 1, "", 6);
+  structure("TOP1", 1, "A", 0);
+  structure("TOP2", 3, "A_COPY", 0);
+  structure("TOP3", 1, "A_COPY", 9);
+  test_record(gds, SPEC::Tag::ENDLIB, SPEC::TagDataType::NODATA);
+
+  StructureHashes hashes(gds.data(), gds.size(), 2);
+  REQUIRE(hashes.spans().size() == 6);
+  CHECK(hashes.canonical(1) == 0);
+  CHECK(hashes.canonical(2) == 2);
+  CHECK(hashes.canonical(4) == 3);
+  CHECK(hashes.hash(0) != hashes.hash(2));
+  auto groups = hashes.duplicate_groups();
+  REQUIRE(groups.size() == 2);
+  CHECK(groups[0] == std::vector<std::size_t> {0, 1});
+
+  SUBCASE("deduplicated image keeps canonical cells only") {
+    std::vector<char> image;
+    IO::Writer writer(std::unique_ptr<IO::OutputSink>(new IO::VectorSink(image, 1 << 16)), 1 << 16, "image");
+    hashes.write_deduplicated(writer);
+    writer.close();
+    auto data = reinterpret_cast<const unsigned char*>(image.data());
+    auto spans = scan_structures(data, image.size());
+    REQUIRE(spans.size() == 4);
+    CHECK(spans[2].name == "TOP1");
+    IO::RecordCursor cursor(data, image.size(), spans[3].body);
+    IO::RecordView record;
+    while (cursor.next(record) && !_is(record, SPEC::Tag::SNAME)) {
+    }
+    CHECK(record_string(record) == "A");
+  }
+}
+
+}
@@ -0,0 +1,64 @@
+#ifndef __HASH__H__
+#define __HASH__H__
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include "Reader.hpp"
+#include "Writer.hpp"
+#include "Parallel.hpp"
+
+namespace GDSTXT {
+
+// XXH64 of data, chained runs pass the previous result as seed
+uint64_t hash64(const unsigned char* data, std::size_t size, uint64_t seed = 0) noexcept;
+
+// where one BGNSTR ... ENDSTR lives in a gds image
+struct StructureSpan {
+  std::string name;
+  // BGNSTR, first record after STRNAME, byte after ENDSTR
+  uint64_t begin;
+  uint64_t body;
+  uint64_t end;
+};
+
+// record-level scan, nothing is decoded besides STRNAME
+std::vector<StructureSpan> scan_structures(const unsigned char* data, std::size_t size);
+
+// content hash of every structure body, BGNSTR dates and STRNAME left
+// out. SNAME records count as the canonical cell they point to, so cells
+// that only differ by the names of identical children hash and compare
+// equal. Cells are hashed leaves first, a hierarchy level at a time on up
+// to threads threads; equal hashes are confirmed record by record.
+class StructureHashes {
+  public:
+    StructureHashes(const unsigned char* data, std::size_t size, unsigned threads = default_thread_count());
+    const std::vector<StructureSpan>& spans() const noexcept { return _spans; }
+    uint64_t hash(std::size_t i) const noexcept { return _hashes[i]; }
+    // first structure in file order with the same content
+    std::size_t canonical(std::size_t i) const noexcept { return _canonical[i]; }
+    // groups of two or more identical structures, canonical first
+    std::vector<std::vector<std::size_t>> duplicate_groups() const;
+    // "<hash> canonical duplicate ..." per group
+    void write_duplicate_groups(IO::Writer& out) const;
+    // the image with every duplicate structure dropped and SNAMEs
+    // pointing at its canonical cell instead
+    void write_deduplicated(IO::Writer& out) const;
+  private:
+    // canonical index of the SNAME target, npos for undefined cells
+    std::size_t _target(const IO::RecordView& record) const;
+    uint64_t _hash(std::size_t i) const;
+    bool _same(std::size_t l, std::size_t r) const;
+
+    const unsigned char* _data;
+    std::size_t _size;
+    std::vector<StructureSpan> _spans;
+    std::unordered_map<std::string, std::size_t> _index;
+    std::vector<uint64_t> _hashes;
+    std::vector<std::size_t> _canonical;
+};
+
+}
+
+#endif //__HASH__H__
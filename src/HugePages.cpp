@@ -0,0 +1,94 @@
+#include "HugePages.hpp"
+#include "test_config.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <unistd.h>
+#include <sys/mman.h>
+
+namespace GDSTXT {
+namespace IO {
+
+HugeBuffer::HugeBuffer(std::size_t size)
+  : _data(nullptr), _size(0), _hugetlb(false)
+{
+  _size = (std::max<std::size_t>(size, 1) + huge_page_size - 1) / huge_page_size * huge_page_size;
+  void* ptr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  ptr = ::mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (ptr != MAP_FAILED) {
+    _data = static_cast<char*>(ptr);
+    _hugetlb = true;
+    return;
+  }
+#endif
+  // one huge page more than needed, trimmed to a 2M aligned stretch
+  auto mapped = _size + huge_page_size;
+  ptr = ::mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED)
+    throw std::runtime_error("failed to map " + std::to_string(_size) + " bytes");
+  auto address = reinterpret_cast<uintptr_t>(ptr);
+  auto aligned = (address + huge_page_size - 1) / huge_page_size * huge_page_size;
+  if (aligned > address)
+    ::munmap(ptr, aligned - address);
+  auto tail = address + mapped - (aligned + _size);
+  if (tail > 0)
+    ::munmap(reinterpret_cast<void*>(aligned + _size), tail);
+  _data = reinterpret_cast<char*>(aligned);
+  advise_huge_pages(_data, _size);
+}
+
+HugeBuffer::HugeBuffer(HugeBuffer&& other) noexcept
+  : _data(other._data), _size(other._size), _hugetlb(other._hugetlb)
+{
+  other._data = nullptr;
+  other._size = 0;
+}
+
+HugeBuffer& HugeBuffer::operator=(HugeBuffer&& other) noexcept
+{
+  std::swap(_data, other._data);
+  std::swap(_size, other._size);
+  std::swap(_hugetlb, other._hugetlb);
+  return *this;
+}
+
+HugeBuffer::~HugeBuffer()
+{
+  if (_data != nullptr)
+    ::munmap(_data, _size);
+}
+
+bool advise_huge_pages(const void* data, std::size_t size) noexcept
+{
+#ifdef MADV_HUGEPAGE
+  static const auto page = static_cast<uintptr_t>(::sysconf(_SC_PAGESIZE));
+  auto begin = (reinterpret_cast<uintptr_t>(data) + page - 1) / page * page;
+  auto end = (reinterpret_cast<uintptr_t>(data) + size) / page * page;
+  if (end <= begin)
+    return false;
+  return ::madvise(reinterpret_cast<void*>(begin), end - begin, MADV_HUGEPAGE) == 0;
+#else
+  return false;
+#endif
+}
+
+TEST_CASE("testing HugeBuffer") {
+  HugeBuffer buffer(3 << 20);
+  REQUIRE(buffer.data() != nullptr);
+  CHECK(buffer.size() == 2 * huge_page_size);
+  CHECK(reinterpret_cast<uintptr_t>(buffer.data()) % huge_page_size == 0);
+  std::memset(buffer.data(), 7, buffer.size());
+  CHECK(buffer.data()[buffer.size() - 1] == 7);
+
+  HugeBuffer moved(std::move(buffer));
+  CHECK(buffer.data() == nullptr);
+  CHECK(moved.data()[0] == 7);
+  CHECK_FALSE(advise_huge_pages(moved.data() + 1, 16));
+}
+
+}
+}
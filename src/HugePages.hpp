@@ -0,0 +1,40 @@
+#ifndef __HUGE__PAGES__H__
+#define __HUGE__PAGES__H__
+
+#include <cstddef>
+
+namespace GDSTXT {
+namespace IO {
+
+constexpr std::size_t huge_page_size = 2 << 20;
+
+// Anonymous memory on 2M pages: explicit hugetlb pages while the kernel's
+// pool has enough, otherwise a 2M aligned mapping advised MADV_HUGEPAGE,
+// which the kernel may still back with 4K pages. The size is rounded up
+// to whole huge pages; throws only when no memory can be mapped at all.
+class HugeBuffer {
+  public:
+    HugeBuffer() noexcept : _data(nullptr), _size(0), _hugetlb(false) {}
+    explicit HugeBuffer(std::size_t size);
+    HugeBuffer(HugeBuffer&& other) noexcept;
+    HugeBuffer& operator=(HugeBuffer&& other) noexcept;
+    char* data() const noexcept { return _data; }
+    std::size_t size() const noexcept { return _size; }
+    // explicit huge pages rather than transparent ones
+    bool hugetlb() const noexcept { return _hugetlb; }
+    ~HugeBuffer();
+  private:
+    char* _data;
+    std::size_t _size;
+    bool _hugetlb;
+};
+
+// MADV_HUGEPAGE on the whole pages inside [data, data + size), for file
+// mappings and heap buffers; false where the kernel refuses, which only
+// costs the TLB misses it was meant to save
+bool advise_huge_pages(const void* data, std::size_t size) noexcept;
+
+}
+}
+
+#endif //__HUGE__PAGES__H__
@@ -0,0 +1,196 @@
+#include "Incremental.hpp"
+#include "Codec.hpp"
+#include "Dialect.hpp"
+#include "Hash.hpp"
+#include "test_config.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace GDSTXT {
+
+namespace {
+
+// start of the first line at or after from, itself a line start, that
+// begins with prefix; size when there is none
+std::size_t _find_line(const char* text, std::size_t size, std::size_t from, const std::string& prefix)
+{
+  if (from < size && size - from >= prefix.size() && std::memcmp(text + from, prefix.data(), prefix.size()) == 0)
+    return from;
+  auto needle = "\n" + prefix;
+  auto found = static_cast<const char*>(::memmem(text + from, size - std::min(from, size), needle.data(), needle.size()));
+  return found == nullptr ? size : found - text + 1;
+}
+
+// one past the newline ending the line at from, size for the last line
+std::size_t _line_end(const char* text, std::size_t size, std::size_t from)
+{
+  auto newline = static_cast<const char*>(std::memchr(text + from, '\n', size - from));
+  return newline == nullptr ? size : newline - text + 1;
+}
+
+std::string _line(const char* text, std::size_t size, std::size_t from)
+{
+  auto end = _line_end(text, size, from);
+  while (end > from && (text[end - 1] == '\n' || text[end - 1] == '\r'))
+    --end;
+  return std::string(text + from, text + end);
+}
+
+// dialect of a dump and where its records start
+TextDialect _dialect(const char* text, std::size_t size, std::size_t& first)
+{
+  first = 0;
+  if (size < 9 || std::memcmp(text, "#dialect:", 9) != 0)
+    return TextDialect::plain;
+  first = _line_end(text, size, 0);
+  return parse_dialect_header(_line(text, size, 0));
+}
+
+std::size_t _line_number(const char* text, std::size_t offset)
+{
+  return 1 + static_cast<std::size_t>(std::count(text, text + offset, '\n'));
+}
+
+// lines [begin, end) of text as gds records
+void _encode(const char* text, std::size_t begin, std::size_t end, TextDialect dialect,
+             std::vector<unsigned char>& gds, IO::Writer& output)
+{
+  gds.clear();
+  auto result = encode_batch(text + begin, end - begin, gds, dialect == TextDialect::compact);
+  if (result.status != Status::ok)
+    throw std::runtime_error("line " + std::to_string(_line_number(text, begin) + result.records) + ": "
+                             + status_message(result.status));
+  output.write(reinterpret_cast<const char*>(gds.data()), gds.size());
+}
+
+}
+
+std::vector<TextSpan> scan_text_structures(const char* text, std::size_t size)
+{
+  std::vector<TextSpan> ret;
+  std::size_t position = 0;
+  while (true) {
+    auto begin = _find_line(text, size, position, "BGNSTR:");
+    if (begin == size)
+      break;
+    // ENDSTR is the whole line, NODATA records take no values
+    auto end = begin;
+    do {
+      end = _find_line(text, size, end, "ENDSTR");
+      if (end == size)
+        throw std::runtime_error("line " + std::to_string(_line_number(text, begin)) + ": structure has no ENDSTR");
+      if (_line(text, size, end) == "ENDSTR")
+        break;
+      end = _line_end(text, size, end);
+    } while (true);
+    end = _line_end(text, size, end);
+
+    auto strname = _find_line(text, end, _line_end(text, size, begin), "STRNAME:");
+    if (strname == end)
+      throw std::runtime_error("line " + std::to_string(_line_number(text, begin)) + ": structure has no STRNAME");
+    ret.push_back(TextSpan {_line(text, end, strname).substr(8), begin, end});
+    position = end;
+  }
+  return ret;
+}
+
+IncrementalResult encode_incremental(const char* text, std::size_t size,
+                                     const char* baseline_text, std::size_t baseline_text_size,
+                                     const unsigned char* baseline_gds, std::size_t baseline_gds_size,
+                                     IO::Writer& output)
+{
+  std::size_t first = 0;
+  std::size_t baseline_first = 0;
+  auto dialect = _dialect(text, size, first);
+  if (_dialect(baseline_text, baseline_text_size, baseline_first) != dialect)
+    throw std::runtime_error("baseline text is in another dialect");
+
+  auto old_text = scan_text_structures(baseline_text, baseline_text_size);
+  auto old_gds = scan_structures(baseline_gds, baseline_gds_size);
+  if (old_text.size() != old_gds.size())
+    throw std::runtime_error("baseline text and gds have different structures");
+  std::unordered_map<std::string, std::size_t> baseline;
+  for (std::size_t i = 0; i < old_text.size(); ++i) {
+    if (old_text[i].name != old_gds[i].name)
+      throw std::runtime_error("baseline text and gds have different structures");
+    baseline.emplace(old_text[i].name, i);
+  }
+
+  IncrementalResult result {0, 0};
+  std::vector<unsigned char> gds;
+  auto position = first;
+  for (const auto& span : scan_text_structures(text, size)) {
+    _encode(text, position, span.begin, dialect, gds, output);
+    position = span.end;
+
+    auto found = baseline.find(span.name);
+    if (found != baseline.end()) {
+      const auto& old = old_text[found->second];
+      if (old.end - old.begin == span.end - span.begin
+          && std::memcmp(baseline_text + old.begin, text + span.begin, span.end - span.begin) == 0) {
+        const auto& bytes = old_gds[found->second];
+        output.write(reinterpret_cast<const char*>(baseline_gds + bytes.begin),
+                     static_cast<std::size_t>(bytes.end - bytes.begin));
+        ++result.copied;
+        continue;
+      }
+    }
+    _encode(text, span.begin, span.end, dialect, gds, output);
+    ++result.encoded;
+  }
+  _encode(text, position, size, dialect, gds, output);
+  return result;
+}
+
+TEST_CASE("testing encode_incremental") {
+  auto cell = [](const std::string& name, const std::string& xy) {
+    return "BGNSTR:1 2 3 4 5 6 1 2 3 4 5 6\nSTRNAME:" + name + "\nBOUNDARY\nLAYER:1\nDATATYPE:0\nXY:"
+      + xy + "\nENDEL\nENDSTR\n";
+  };
+  std::string header = "HEADER:600\nBGNLIB:1 2 3 4 5 6 1 2 3 4 5 6\nLIBNAME:LIB\nUNITS:0.001 1e-09\n";
+  auto baseline = header + cell("A", "0 0 0 1 1 1 1 0 0 0") + cell("B", "0 0 0 2 2 2 2 0 0 0") + "ENDLIB\n";
+  std::vector<unsigned char> baseline_gds;
+  REQUIRE(encode_batch(baseline.data(), baseline.size(), baseline_gds).status == Status::ok);
+
+  auto spans = scan_text_structures(baseline.data(), baseline.size());
+  REQUIRE(spans.size() == 2);
+  CHECK(spans[1].name == "B");
+  CHECK(baseline.compare(spans[1].begin, spans[1].end - spans[1].begin, cell("B", "0 0 0 2 2 2 2 0 0 0")) == 0);
+
+  // B edited, C added in front, A kept
+  auto edited = header + cell("C", "5 5 5 6 6 6 6 5 5 5") + cell("A", "0 0 0 1 1 1 1 0 0 0")
+    + cell("B", "0 0 0 3 3 3 3 0 0 0") + "ENDLIB\n";
+  std::vector<unsigned char> expected;
+  REQUIRE(encode_batch(edited.data(), edited.size(), expected).status == Status::ok);
+  auto encode = [&](const std::string& text, const std::string& baseline_text, std::vector<char>& gds) {
+    IO::Writer output(std::unique_ptr<IO::OutputSink>(new IO::VectorSink(gds, 1 << 16)), 1 << 16, "gds");
+    auto ret = encode_incremental(text.data(), text.size(), baseline_text.data(), baseline_text.size(),
+                                  baseline_gds.data(), baseline_gds.size(), output);
+    output.close();
+    return ret;
+  };
+  std::vector<char> written;
+  auto result = encode(edited, baseline, written);
+  CHECK(result.copied == 1);
+  CHECK(result.encoded == 2);
+  CHECK(std::vector<unsigned char>(written.begin(), written.end()) == expected);
+
+  SUBCASE("compact XY lines are encoded too") {
+    auto dialect = std::string(compact_dialect_header) + "\n";
+    auto compact_baseline = dialect + header + cell("A", "0,0 v1 h1 v-1 z") + cell("B", "0,0 v2 h2 v-2 z")
+      + "ENDLIB\n";
+    auto compact = dialect + header + cell("C", "5,5 v1 h1 v-1 z") + cell("A", "0,0 v1 h1 v-1 z")
+      + cell("B", "0,0 v3 h3 v-3 z") + "ENDLIB\n";
+    written.clear();
+    CHECK(encode(compact, compact_baseline, written).copied == 1);
+    CHECK(std::vector<unsigned char>(written.begin(), written.end()) == expected);
+  }
+
+  auto other = header + cell("B", "0 0 0 2 2 2 2 0 0 0") + "ENDLIB\n";
+  written.clear();
+  CHECK_THROWS_AS(encode(edited, other, written), std::runtime_error);
+}
+
+}
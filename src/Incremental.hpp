@@ -0,0 +1,44 @@
+#ifndef __INCREMENTAL__H__
+#define __INCREMENTAL__H__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "Writer.hpp"
+
+namespace GDSTXT {
+
+// where one BGNSTR ... ENDSTR lives in a text dump, end includes the
+// newline of the ENDSTR line
+struct TextSpan {
+  std::string name;
+  std::size_t begin;
+  std::size_t end;
+};
+
+// every structure of a plain or compact text dump, found from its BGNSTR,
+// STRNAME and ENDSTR lines without encoding anything
+std::vector<TextSpan> scan_text_structures(const char* text, std::size_t size);
+
+struct IncrementalResult {
+  // structures copied from the baseline gds and encoded from text
+  std::size_t copied;
+  std::size_t encoded;
+};
+
+// txt2gds of text against a baseline: a gds and the text dump it was
+// converted to. A structure whose lines are byte for byte the lines it has
+// in the baseline text is copied from the baseline gds, the others, the
+// records outside structures, and structures that are new, are encoded
+// from text. Structures come out in the order of text, so added, removed
+// and reordered cells need nothing special. Throws when the baseline
+// text and gds don't list the same structures or use another dialect
+// than text.
+IncrementalResult encode_incremental(const char* text, std::size_t size,
+                                     const char* baseline_text, std::size_t baseline_text_size,
+                                     const unsigned char* baseline_gds, std::size_t baseline_gds_size,
+                                     IO::Writer& output);
+
+}
+
+#endif //__INCREMENTAL__H__
@@ -0,0 +1,209 @@
+#include "JsonLines.hpp"
+#include "Format.hpp"
+#include "test_config.h"
+#include <limits>
+#include <vector>
+
+namespace GDSTXT {
+
+JsonLinesWriter::JsonLinesWriter(IO::Writer& out)
+  : _out(out)
+{}
+
+void JsonLinesWriter::_string(const std::string& str)
+{
+  static const char hex[] = "0123456789abcdef";
+  _out.put('"');
+  for (unsigned char c : str) {
+    if (c == '"' || c == '\\') {
+      _out.put('\\');
+      _out.put(static_cast<char>(c));
+    } else if (c < 0x20 || c >= 0x7f) {
+      // gds strings are plain bytes, anything outside ascii is read as latin-1
+      char escaped[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+      _out.write(escaped, sizeof(escaped));
+    } else {
+      _out.put(static_cast<char>(c));
+    }
+  }
+  _out.put('"');
+}
+
+void JsonLinesWriter::_real(double value)
+{
+  if (value != value || value - value != value - value) {
+    // nan and inf have no JSON spelling
+    _out.write("null");
+    return;
+  }
+  auto first = _out.reserve(max_number_width);
+  _out.commit(format_real_exact(first, value) - first);
+}
+
+void JsonLinesWriter::library(const std::string& name)
+{
+  _out.write("{\"type\":\"library\",\"name\":");
+  _string(name);
+  _out.write("}\n");
+}
+
+void JsonLinesWriter::units(double user_unit, double database_unit)
+{
+  _out.write("{\"type\":\"units\",\"user\":");
+  _real(user_unit);
+  _out.write(",\"database\":");
+  _real(database_unit);
+  _out.write("}\n");
+}
+
+void JsonLinesWriter::begin_structure(const std::string& name)
+{
+  _structure = name;
+  _out.write("{\"type\":\"structure\",\"name\":");
+  _string(name);
+  _out.write("}\n");
+}
+
+void JsonLinesWriter::end_structure()
+{
+  _out.write("{\"type\":\"endstructure\",\"name\":");
+  _string(_structure);
+  _out.write("}\n");
+}
+
+void JsonLinesWriter::element(const Element& element)
+{
+  _out.write("{\"type\":\"");
+  switch (element.kind) {
+    case ElementKind::boundary: _out.write("boundary\""); break;
+    case ElementKind::path:     _out.write("path\""); break;
+    case ElementKind::sref:     _out.write("sref\""); break;
+    case ElementKind::aref:     _out.write("aref\""); break;
+    case ElementKind::text:     _out.write("text\""); break;
+    case ElementKind::node:     _out.write("node\""); break;
+    case ElementKind::box:      _out.write("box\""); break;
+  }
+
+  switch (element.kind) {
+    case ElementKind::sref:
+    case ElementKind::aref: {
+      _out.write(",\"sname\":");
+      _string(element.sname);
+      break;
+    }
+    default: {
+      _out.write(",\"layer\":");
+      _out.write_int(element.layer);
+      switch (element.kind) {
+        case ElementKind::text: _out.write(",\"texttype\":"); break;
+        case ElementKind::node: _out.write(",\"nodetype\":"); break;
+        case ElementKind::box:  _out.write(",\"boxtype\":"); break;
+        default:                _out.write(",\"datatype\":"); break;
+      }
+      _out.write_int(element.datatype);
+      break;
+    }
+  }
+
+  if (element.kind == ElementKind::path) {
+    _out.write(",\"pathtype\":");
+    _out.write_int(element.pathtype);
+    _out.write(",\"width\":");
+    _out.write_int(element.width);
+  }
+  if (element.kind == ElementKind::text) {
+    _out.write(",\"string\":");
+    _string(element.text);
+  }
+  if (element.kind == ElementKind::sref || element.kind == ElementKind::aref
+      || element.kind == ElementKind::text) {
+    _out.write(",\"strans\":");
+    _out.write_int(element.strans);
+    _out.write(",\"mag\":");
+    _real(element.mag);
+    _out.write(",\"angle\":");
+    _real(element.angle);
+  }
+  if (element.kind == ElementKind::aref) {
+    _out.write(",\"columns\":");
+    _out.write_int(element.columns);
+    _out.write(",\"rows\":");
+    _out.write_int(element.rows);
+  }
+
+  _out.write(",\"xy\":[");
+  for (std::size_t i = 0; i < element.xy.size(); ++i) {
+    if (i != 0)
+      _out.put(',');
+    _out.put('[');
+    _out.write_int(element.xy[i].x);
+    _out.put(',');
+    _out.write_int(element.xy[i].y);
+    _out.put(']');
+  }
+  _out.write("]}\n");
+}
+
+TEST_CASE("testing JsonLinesWriter") {
+  std::vector<char> text;
+  IO::Writer out(std::unique_ptr<IO::OutputSink>(new IO::VectorSink(text, 1 << 16)), 1 << 16, "json");
+  JsonLinesWriter json(out);
+  auto lines = [&text, &out]() {
+    out.flush();
+    std::string result(text.begin(), text.end());
+    text.clear();
+    return result;
+  };
+
+  SUBCASE("strings escape quotes, backslashes, control and non-ascii bytes") {
+    json.library(std::string("a\"b\\c\x01\n\x1f\x7f\xe9\xff z", 13));
+    CHECK(lines() == "{\"type\":\"library\",\"name\":\"a\\\"b\\\\c\\u0001\\u000a\\u001f\\u007f\\u00e9\\u00ff z\"}\n");
+  }
+
+  SUBCASE("nan and inf are null") {
+    json.units(std::numeric_limits<double>::quiet_NaN(), std::numeric_limits<double>::infinity());
+    CHECK(lines() == "{\"type\":\"units\",\"user\":null,\"database\":null}\n");
+    json.units(0.001, -std::numeric_limits<double>::infinity());
+    CHECK(lines() == "{\"type\":\"units\",\"user\":0.001,\"database\":null}\n");
+  }
+
+  SUBCASE("element fields come in a fixed order") {
+    json.begin_structure("TOP");
+    Element element;
+    element.reset(ElementKind::boundary);
+    element.layer = 1;
+    element.datatype = 2;
+    element.xy = {{0, 0}, {10, -5}};
+    json.element(element);
+    element.reset(ElementKind::path);
+    element.layer = 3;
+    element.pathtype = 2;
+    element.width = -40;
+    element.xy = {{1, 2}};
+    json.element(element);
+    element.reset(ElementKind::text);
+    element.layer = 4;
+    element.datatype = 5;
+    element.text = "pin\t1";
+    element.strans = 0x8000;
+    element.mag = 0.5;
+    element.xy = {{7, 8}};
+    json.element(element);
+    element.reset(ElementKind::sref);
+    element.sname = "SUB";
+    element.angle = 90;
+    element.xy = {{5, 5}};
+    json.element(element);
+    json.end_structure();
+    CHECK(lines() ==
+          "{\"type\":\"structure\",\"name\":\"TOP\"}\n"
+          "{\"type\":\"boundary\",\"layer\":1,\"datatype\":2,\"xy\":[[0,0],[10,-5]]}\n"
+          "{\"type\":\"path\",\"layer\":3,\"datatype\":0,\"pathtype\":2,\"width\":-40,\"xy\":[[1,2]]}\n"
+          "{\"type\":\"text\",\"layer\":4,\"texttype\":5,\"string\":\"pin\\u00091\",\"strans\":32768,"
+          "\"mag\":0.5,\"angle\":0,\"xy\":[[7,8]]}\n"
+          "{\"type\":\"sref\",\"sname\":\"SUB\",\"strans\":0,\"mag\":1,\"angle\":90,\"xy\":[[5,5]]}\n"
+          "{\"type\":\"endstructure\",\"name\":\"TOP\"}\n");
+  }
+}
+
+}
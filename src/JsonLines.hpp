@@ -0,0 +1,37 @@
+#ifndef __JSON__LINES__H__
+#define __JSON__LINES__H__
+
+#include <string>
+#include "Element.hpp"
+#include "Writer.hpp"
+
+namespace GDSTXT {
+
+// one JSON object per line, emitted as soon as the element is complete:
+//   {"type":"library","name":"LIB"}
+//   {"type":"units","user":0.001,"database":1e-09}
+//   {"type":"structure","name":"TOP"}
+//   {"type":"boundary","layer":1,"datatype":0,"xy":[[0,0],[10,0],...]}
+//   {"type":"sref","sname":"SUB","strans":0,"mag":1,"angle":90,"xy":[[5,5]]}
+//   {"type":"endstructure","name":"TOP"}
+// element keys follow the record names in lower case, TEXTTYPE, NODETYPE
+// and BOXTYPE keep their own key names
+class JsonLinesWriter: public ElementHandler {
+  public:
+    explicit JsonLinesWriter(IO::Writer& out);
+    void library(const std::string& name) override;
+    void units(double user_unit, double database_unit) override;
+    void begin_structure(const std::string& name) override;
+    void element(const Element& element) override;
+    void end_structure() override;
+  private:
+    void _string(const std::string& str);
+    void _real(double value);
+
+    IO::Writer& _out;
+    std::string _structure;
+};
+
+}
+
+#endif //__JSON__LINES__H__
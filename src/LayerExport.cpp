@@ -0,0 +1,348 @@
+#include "LayerExport.hpp"
+#include "Writer.hpp"
+#include "Binary.hpp"
+#include "test_config.h"
+#include "test_fixtures.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace GDSTXT {
+
+namespace {
+
+const char layer_magic[8] = {'G', 'D', 'S', 'S', 'O', 'A', '1', '\0'};
+
+const char* column_names[] = {"x", "y", "rings", "kinds", "widths", "cells"};
+
+template<typename T>
+void _append_file(const std::string& path, const std::vector<T>& data)
+{
+  if (data.empty())
+    return;
+  int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0)
+    throw std::runtime_error("failed to open " + path);
+  auto first = reinterpret_cast<const char*>(data.data());
+  auto size = data.size() * sizeof(T);
+  while (size > 0) {
+    auto count = ::write(fd, first, size);
+    if (count < 0 && errno == EINTR)
+      continue;
+    if (count <= 0) {
+      ::close(fd);
+      throw std::runtime_error("failed to write " + path);
+    }
+    first += count;
+    size -= static_cast<std::size_t>(count);
+  }
+  if (::close(fd) != 0)
+    throw std::runtime_error("failed to write " + path);
+}
+
+template<typename T>
+void _release(std::vector<T>& data)
+{
+  std::vector<T>().swap(data);
+}
+
+// copies a spilled column then the buffered remainder, returns bytes written
+template<typename T>
+uint64_t _write_column(IO::Writer& writer, const std::string& spill_path, const std::vector<T>& data)
+{
+  uint64_t written = 0;
+  int fd = ::open(spill_path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0 && errno != ENOENT)
+    throw std::runtime_error("failed to open " + spill_path);
+  if (fd >= 0) {
+    // read straight into the writer's buffer
+    auto chunk = writer.max_reserve() / 2;
+    while (true) {
+      auto count = ::read(fd, writer.reserve(chunk), chunk);
+      if (count < 0 && errno == EINTR)
+        continue;
+      if (count < 0) {
+        ::close(fd);
+        throw std::runtime_error("failed to read " + spill_path);
+      }
+      if (count == 0)
+        break;
+      writer.commit(static_cast<std::size_t>(count));
+      written += static_cast<uint64_t>(count);
+    }
+    ::close(fd);
+    ::unlink(spill_path.c_str());
+  }
+  writer.write(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(T));
+  return written + data.size() * sizeof(T);
+}
+
+}
+
+std::size_t LayerExporter::Columns::bytes() const noexcept
+{
+  return x.size() * 4 + y.size() * 4 + rings.size() * 8
+    + kinds.size() + widths.size() * 4 + cells.size() * 4;
+}
+
+LayerExporter::LayerExporter(const std::string& directory, std::size_t memory_limit,
+                             const IO::WriterOptions& writer_options)
+  : _directory(directory), _memory_limit(memory_limit), _writer_options(writer_options),
+    _buffered(0), _closed(false)
+{
+  if (::mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST)
+    throw std::runtime_error("failed to create " + directory);
+}
+
+LayerExporter::~LayerExporter()
+{
+  if (!_closed) {
+    for (auto& i : _layers) {
+      for (auto name : column_names)
+        std::remove(_path(i.first, std::string(".") + name + ".tmp").c_str());
+    }
+  }
+}
+
+std::string LayerExporter::_path(const LayerKey& key, const std::string& suffix) const
+{
+  return _directory + "/L" + std::to_string(key.first) + "_D" + std::to_string(key.second) + suffix;
+}
+
+uint32_t LayerExporter::add_cell(const std::string& name)
+{
+  _cells.push_back(name);
+  return static_cast<uint32_t>(_cells.size() - 1);
+}
+
+void LayerExporter::begin_structure(const std::string& name)
+{
+  add_cell(name);
+}
+
+void LayerExporter::element(const Element& element)
+{
+  if (_cells.empty())
+    add_cell("");
+  add(element, static_cast<uint32_t>(_cells.size() - 1));
+}
+
+void LayerExporter::add(const Element& element, uint32_t cell)
+{
+  LayerRingKind kind;
+  switch (element.kind) {
+    case ElementKind::boundary: kind = LayerRingKind::boundary; break;
+    case ElementKind::box:      kind = LayerRingKind::box; break;
+    case ElementKind::path:     kind = LayerRingKind::path; break;
+    default:
+      return;
+  }
+
+  auto& columns = _layers[LayerKey(element.layer, element.datatype)];
+  auto before = columns.bytes();
+  columns.rings.push_back(columns.spilled_points + columns.x.size());
+  columns.kinds.push_back(static_cast<uint8_t>(kind));
+  columns.widths.push_back(kind == LayerRingKind::path ? element.width : 0);
+  columns.cells.push_back(cell);
+  for (const auto& point : element.xy) {
+    columns.x.push_back(point.x);
+    columns.y.push_back(point.y);
+  }
+  _buffered += columns.bytes() - before;
+  if (_buffered > _memory_limit)
+    _spill_largest();
+}
+
+void LayerExporter::_spill(const LayerKey& key, Columns& columns)
+{
+  _append_file(_path(key, ".x.tmp"), columns.x);
+  _append_file(_path(key, ".y.tmp"), columns.y);
+  _append_file(_path(key, ".rings.tmp"), columns.rings);
+  _append_file(_path(key, ".kinds.tmp"), columns.kinds);
+  _append_file(_path(key, ".widths.tmp"), columns.widths);
+  _append_file(_path(key, ".cells.tmp"), columns.cells);
+  _buffered -= columns.bytes();
+  columns.spilled_points += columns.x.size();
+  columns.spilled_rings += columns.kinds.size();
+  _release(columns.x);
+  _release(columns.y);
+  _release(columns.rings);
+  _release(columns.kinds);
+  _release(columns.widths);
+  _release(columns.cells);
+}
+
+void LayerExporter::_spill_largest()
+{
+  while (_buffered > _memory_limit / 2) {
+    auto largest = _layers.begin();
+    for (auto iter = _layers.begin(); iter != _layers.end(); ++iter) {
+      if (iter->second.bytes() > largest->second.bytes())
+        largest = iter;
+    }
+    if (largest == _layers.end() || largest->second.bytes() == 0)
+      return;
+    _spill(largest->first, largest->second);
+  }
+}
+
+void LayerExporter::_finish(const LayerKey& key, Columns& columns)
+{
+  LayerFileHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, layer_magic, sizeof(layer_magic));
+  header.version = 1;
+  header.byte_order = IO::binary_byte_order;
+  header.layer = key.first;
+  header.datatype = key.second;
+  header.point_count = columns.spilled_points + columns.x.size();
+  header.ring_count = columns.spilled_rings + columns.kinds.size();
+  columns.rings.push_back(header.point_count);
+
+  // columns are laid out first to know the offsets, then written in order
+  uint64_t position = sizeof(header);
+  auto place = [&position](uint64_t size) {
+    position += (8 - position % 8) % 8;
+    auto offset = position;
+    position += size;
+    return offset;
+  };
+  header.x_offset = place(header.point_count * 4);
+  header.y_offset = place(header.point_count * 4);
+  header.ring_offset = place((header.ring_count + 1) * 8);
+  header.kind_offset = place(header.ring_count);
+  header.width_offset = place(header.ring_count * 4);
+  header.cell_offset = place(header.ring_count * 4);
+
+  IO::Writer writer(_path(key, ".soa"), _writer_options);
+  writer.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  position = sizeof(header);
+  auto pad = [&writer, &position]() {
+    const char zeros[8] = {};
+    auto padding = (8 - position % 8) % 8;
+    writer.write(zeros, padding);
+    position += padding;
+  };
+  position += _write_column(writer, _path(key, ".x.tmp"), columns.x);
+  pad();
+  position += _write_column(writer, _path(key, ".y.tmp"), columns.y);
+  pad();
+  position += _write_column(writer, _path(key, ".rings.tmp"), columns.rings);
+  pad();
+  position += _write_column(writer, _path(key, ".kinds.tmp"), columns.kinds);
+  pad();
+  position += _write_column(writer, _path(key, ".widths.tmp"), columns.widths);
+  pad();
+  position += _write_column(writer, _path(key, ".cells.tmp"), columns.cells);
+  writer.close();
+}
+
+void LayerExporter::close()
+{
+  if (_closed)
+    return;
+  for (auto& i : _layers)
+    _finish(i.first, i.second);
+  _closed = true;
+
+  IO::Writer writer(_directory + "/cells.txt", _writer_options);
+  for (const auto& name : _cells) {
+    writer.write(name);
+    writer.put('\n');
+  }
+  writer.close();
+}
+
+TEST_CASE("testing LayerExporter spilling") {
+  TestDirectory directory;
+  auto read_back = [](const std::string& path) {
+    std::vector<char> data;
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    REQUIRE(fd >= 0);
+    char chunk[4096];
+    ssize_t count;
+    while ((count = ::read(fd, chunk, sizeof(chunk))) > 0)
+      data.insert(data.end(), chunk, chunk + count);
+    ::close(fd);
+    return data;
+  };
+  auto element = [](ElementKind kind, int16_t layer, int16_t datatype, int32_t width, std::size_t points) {
+    Element result;
+    result.reset(kind);
+    result.layer = layer;
+    result.datatype = datatype;
+    result.width = width;
+    for (std::size_t i = 0; i < points; ++i)
+      result.xy.push_back(Point {static_cast<int32_t>(i * 10), -static_cast<int32_t>(i)});
+    return result;
+  };
+
+  // 100 bytes hold two rings, the third spills L1_D0 and the rest stays buffered
+  LayerExporter exporter(directory.path("layers"), 100);
+  exporter.begin_structure("A");
+  exporter.element(element(ElementKind::boundary, 1, 0, 0, 4));
+  exporter.element(element(ElementKind::path, 1, 0, 10, 2));
+  exporter.element(element(ElementKind::sref, 1, 0, 0, 1));
+  exporter.begin_structure("B");
+  exporter.element(element(ElementKind::box, 1, 0, 0, 5));
+  CHECK(::access(directory.path("layers/L1_D0.x.tmp").c_str(), F_OK) == 0);
+  exporter.element(element(ElementKind::boundary, 2, 5, 0, 3));
+  exporter.element(element(ElementKind::boundary, 1, 0, 0, 3));
+  exporter.close();
+  CHECK(::access(directory.path("layers/L1_D0.x.tmp").c_str(), F_OK) != 0);
+
+  auto data = read_back(directory.path("layers/L1_D0.soa"));
+  REQUIRE(data.size() >= sizeof(LayerFileHeader));
+  LayerFileHeader header;
+  std::memcpy(&header, data.data(), sizeof(header));
+  CHECK(std::string(header.magic) == "GDSSOA1");
+  CHECK(header.version == 1);
+  CHECK(header.byte_order == IO::binary_byte_order);
+  CHECK(header.layer == 1);
+  CHECK(header.datatype == 0);
+  CHECK(header.point_count == 14);
+  CHECK(header.ring_count == 4);
+  REQUIRE(data.size() == header.cell_offset + header.ring_count * 4);
+  auto column = [&data](uint64_t offset, std::size_t count, std::size_t width) {
+    CHECK(offset % 8 == 0);
+    std::vector<int64_t> values;
+    for (std::size_t i = 0; i < count; ++i) {
+      int64_t value = 0;
+      if (width == 1)
+        value = static_cast<uint8_t>(data[offset + i]);
+      else if (width == 4) {
+        int32_t item;
+        std::memcpy(&item, &data[offset + i * 4], 4);
+        value = item;
+      } else {
+        uint64_t item;
+        std::memcpy(&item, &data[offset + i * 8], 8);
+        value = static_cast<int64_t>(item);
+      }
+      values.push_back(value);
+    }
+    return values;
+  };
+  CHECK(column(header.x_offset, 14, 4)
+        == std::vector<int64_t> {0, 10, 20, 30, 0, 10, 0, 10, 20, 30, 40, 0, 10, 20});
+  CHECK(column(header.y_offset, 3, 4) == std::vector<int64_t> {0, -1, -2});
+  // ring offsets continue across the spilled and the buffered part
+  CHECK(column(header.ring_offset, 5, 8) == std::vector<int64_t> {0, 4, 6, 11, 14});
+  CHECK(column(header.kind_offset, 4, 1) == std::vector<int64_t> {0, 2, 1, 0});
+  CHECK(column(header.width_offset, 4, 4) == std::vector<int64_t> {0, 10, 0, 0});
+  CHECK(column(header.cell_offset, 4, 4) == std::vector<int64_t> {0, 0, 1, 1});
+
+  auto other = read_back(directory.path("layers/L2_D5.soa"));
+  std::memcpy(&header, other.data(), sizeof(header));
+  CHECK(header.point_count == 3);
+  CHECK(header.ring_count == 1);
+
+  auto cells = read_back(directory.path("layers/cells.txt"));
+  CHECK(std::string(cells.begin(), cells.end()) == "A\nB\n");
+}
+
+}
@@ -0,0 +1,99 @@
+#ifndef __LAYER__EXPORT__H__
+#define __LAYER__EXPORT__H__
+
+#include <map>
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include "Element.hpp"
+#include "Writer.hpp"
+
+// One structure-of-arrays file per layer/datatype, native byte order:
+//
+//   LayerFileHeader   96 bytes
+//   x                 int32  [point_count]
+//   y                 int32  [point_count]
+//   ring offsets      uint64 [ring_count + 1], first point of each ring
+//   kinds             uint8  [ring_count], LayerRingKind
+//   widths            int32  [ring_count], path width, 0 for polygons
+//   cells             uint32 [ring_count], line number in cells.txt
+//
+// every column starts 8-byte aligned, so numpy can np.frombuffer them
+// straight out of an mmap
+
+namespace GDSTXT {
+
+struct LayerFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  int32_t layer;
+  int32_t datatype;
+  uint64_t ring_count;
+  uint64_t point_count;
+  uint64_t x_offset;
+  uint64_t y_offset;
+  uint64_t ring_offset;
+  uint64_t kind_offset;
+  uint64_t width_offset;
+  uint64_t cell_offset;
+  uint64_t reserved;
+};
+
+static_assert(sizeof(LayerFileHeader) == 96, "layer file header must stay 96 bytes");
+
+enum class LayerRingKind : uint8_t {
+  boundary = 0,
+  box = 1,
+  path = 2
+};
+
+// BOUNDARY, BOX and PATH centerlines go to <directory>/L<layer>_D<datatype>.soa,
+// columns are spilled to temporary files once memory_limit bytes are buffered,
+// layer files are written through writer_options' buffers one at a time
+class LayerExporter: public ElementHandler {
+  public:
+    LayerExporter(const std::string& directory, std::size_t memory_limit = 64 << 20,
+                  const IO::WriterOptions& writer_options = IO::WriterOptions());
+    LayerExporter(const LayerExporter&) = delete;
+    LayerExporter& operator=(const LayerExporter&) = delete;
+    void begin_structure(const std::string& name) override;
+    void element(const Element& element) override;
+    // writes every layer file and cells.txt
+    void close();
+    // append geometry of a cell that isn't announced through begin_structure
+    void add(const Element& element, uint32_t cell);
+    uint32_t add_cell(const std::string& name);
+    ~LayerExporter() override;
+  private:
+    struct Columns {
+      std::vector<int32_t> x;
+      std::vector<int32_t> y;
+      std::vector<uint64_t> rings;
+      std::vector<uint8_t> kinds;
+      std::vector<int32_t> widths;
+      std::vector<uint32_t> cells;
+      uint64_t spilled_points = 0;
+      uint64_t spilled_rings = 0;
+      std::size_t bytes() const noexcept;
+    };
+    using LayerKey = std::pair<int16_t, int16_t>;
+
+    std::string _path(const LayerKey& key, const std::string& suffix) const;
+    void _spill(const LayerKey& key, Columns& columns);
+    void _spill_largest();
+    void _finish(const LayerKey& key, Columns& columns);
+
+    std::string _directory;
+    std::size_t _memory_limit;
+    IO::WriterOptions _writer_options;
+    std::size_t _buffered;
+    std::map<LayerKey, Columns> _layers;
+    std::vector<std::string> _cells;
+    bool _closed;
+};
+
+}
+
+#endif //__LAYER__EXPORT__H__
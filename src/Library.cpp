@@ -0,0 +1,180 @@
+#include "Library.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace GDSTXT {
+
+constexpr std::size_t Library::npos;
+
+namespace {
+
+class LibraryBuilder: public ElementHandler {
+  public:
+    explicit LibraryBuilder(Library& library): _library(library) {}
+    void library(const std::string& name) override { _library.name = name; }
+    void units(double user_unit, double database_unit) override
+    {
+      _library.user_unit = user_unit;
+      _library.database_unit = database_unit;
+    }
+    void begin_structure(const std::string& name) override
+    {
+      _structure = Structure();
+      _structure.name = name;
+      _structure.bgnstr = _bgnstr;
+      _structure.begin = _bgnstr_begin;
+    }
+    void element(const Element& element) override
+    {
+      _structure.elements.push_back(element);
+      _structure.offsets.push_back(_element_begin);
+    }
+    void end_structure() override
+    {
+      _structure.end = _next;
+      _library.add(std::move(_structure));
+    }
+    void bgnstr(const IO::RecordView& record)
+    {
+      _bgnstr = RawRecord {record.tag, record.data_type,
+        std::vector<unsigned char>(record.body, record.body + record.size)};
+      _bgnstr_begin = _record_begin;
+    }
+    // offsets of the record about to be fed and of the one after it
+    void at(uint64_t record_begin, uint64_t next, bool element_begin)
+    {
+      _record_begin = record_begin;
+      _next = next;
+      if (element_begin)
+        _element_begin = record_begin;
+    }
+  private:
+    Library& _library;
+    Structure _structure;
+    RawRecord _bgnstr;
+    uint64_t _bgnstr_begin = 0;
+    uint64_t _record_begin = 0;
+    uint64_t _element_begin = 0;
+    uint64_t _next = 0;
+};
+
+bool _element_begin(SPEC::Tag tag) noexcept
+{
+  switch (tag) {
+    case SPEC::Tag::BOUNDARY:
+    case SPEC::Tag::PATH:
+    case SPEC::Tag::SREF:
+    case SPEC::Tag::AREF:
+    case SPEC::Tag::TEXT:
+    case SPEC::Tag::NODE:
+    case SPEC::Tag::BOX:
+      return true;
+    default:
+      return false;
+  }
+}
+
+}
+
+Library Library::load(IO::Reader& reader)
+{
+  Library library;
+  LibraryBuilder builder(library);
+  ElementDecoder decoder(builder);
+  bool in_header = true;
+  IO::RecordView record;
+  auto offset = reader.offset();
+  while (reader.readRecord(record)) {
+    auto tag = static_cast<SPEC::Tag>(record.tag);
+    builder.at(offset, reader.offset(), _element_begin(tag));
+    offset = reader.offset();
+    if (tag == SPEC::Tag::BGNSTR) {
+      in_header = false;
+      builder.bgnstr(record);
+    } else if (in_header && tag != SPEC::Tag::ENDLIB) {
+      library.header.push_back(RawRecord {record.tag, record.data_type,
+        std::vector<unsigned char>(record.body, record.body + record.size)});
+    }
+    decoder.feed(record);
+  }
+  return library;
+}
+
+void Library::add(Structure&& structure)
+{
+  auto found = _index.find(structure.name);
+  if (found != _index.end())
+    throw std::runtime_error("structure " + structure.name + " is defined twice");
+  _index.emplace(structure.name, structures.size());
+  structures.push_back(std::move(structure));
+}
+
+const Structure* Library::find(const std::string& name) const
+{
+  auto index = index_of(name);
+  return index == npos ? nullptr : &structures[index];
+}
+
+std::size_t Library::index_of(const std::string& name) const
+{
+  auto found = _index.find(name);
+  return found == _index.end() ? npos : found->second;
+}
+
+std::vector<unsigned> Library::levels() const
+{
+  std::vector<std::vector<std::size_t>> children(structures.size());
+  std::vector<std::string> names;
+  for (std::size_t i = 0; i < structures.size(); ++i) {
+    names.push_back(structures[i].name);
+    for (const auto& element : structures[i].elements) {
+      if (element.kind != ElementKind::sref && element.kind != ElementKind::aref)
+        continue;
+      auto child = index_of(element.sname);
+      if (child == npos)
+        throw std::runtime_error("structure " + element.sname + " is referenced but not defined");
+      children[i].push_back(child);
+    }
+  }
+  return hierarchy_levels(children, names);
+}
+
+std::vector<unsigned> hierarchy_levels(const std::vector<std::vector<std::size_t>>& children,
+                                       const std::vector<std::string>& names)
+{
+  enum class Mark : unsigned char { none, visiting, done };
+  std::vector<Mark> marks(children.size(), Mark::none);
+  std::vector<unsigned> ret(children.size(), 0);
+
+  // iterative depth-first walk, (node, next child) pairs
+  std::vector<std::pair<std::size_t, std::size_t>> stack;
+  for (std::size_t root = 0; root < children.size(); ++root) {
+    if (marks[root] != Mark::none)
+      continue;
+    marks[root] = Mark::visiting;
+    stack.emplace_back(root, 0);
+    while (!stack.empty()) {
+      auto& frame = stack.back();
+      if (frame.second == children[frame.first].size()) {
+        marks[frame.first] = Mark::done;
+        auto level = ret[frame.first];
+        stack.pop_back();
+        if (!stack.empty())
+          ret[stack.back().first] = std::max(ret[stack.back().first], level + 1);
+        continue;
+      }
+      auto child = children[frame.first][frame.second++];
+      if (marks[child] == Mark::visiting)
+        throw std::runtime_error("reference cycle through " + names[child]);
+      if (marks[child] == Mark::none) {
+        marks[child] = Mark::visiting;
+        stack.emplace_back(child, 0);
+      } else {
+        ret[frame.first] = std::max(ret[frame.first], ret[child] + 1);
+      }
+    }
+  }
+  return ret;
+}
+
+}
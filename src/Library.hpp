@@ -0,0 +1,65 @@
+#ifndef __LIBRARY__H__
+#define __LIBRARY__H__
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "Element.hpp"
+#include "Reader.hpp"
+
+namespace GDSTXT {
+
+struct RawRecord {
+  unsigned char tag;
+  unsigned char data_type;
+  std::vector<unsigned char> body;
+  IO::RecordView view() const noexcept
+  {
+    return IO::RecordView {tag, data_type, body.data(), body.size()};
+  }
+};
+
+struct Structure {
+  std::string name;
+  RawRecord bgnstr;
+  std::vector<Element> elements;
+  // file offsets of BGNSTR, of the byte after ENDSTR and of the first
+  // record of each element
+  uint64_t begin = 0;
+  uint64_t end = 0;
+  std::vector<uint64_t> offsets;
+};
+
+// whole library decoded into memory, each structure's elements are decoded
+// once and shared by every instance that references it
+class Library {
+  public:
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    static Library load(IO::Reader& reader);
+    const Structure* find(const std::string& name) const;
+    std::size_t index_of(const std::string& name) const;
+    void add(Structure&& structure);
+    // per structure, 0 for cells without references, otherwise one more
+    // than the highest cell it references; throws on cycles and undefined
+    // references
+    std::vector<unsigned> levels() const;
+
+    std::string name;
+    double user_unit = 1e-3;
+    double database_unit = 1e-9;
+    // records ahead of the first BGNSTR: HEADER, BGNLIB, LIBNAME, UNITS ...
+    std::vector<RawRecord> header;
+    std::vector<Structure> structures;
+  private:
+    std::unordered_map<std::string, std::size_t> _index;
+};
+
+// Library::levels() over any reference graph, children[i] holds the
+// indices node i references, names are only used in the cycle error
+std::vector<unsigned> hierarchy_levels(const std::vector<std::vector<std::size_t>>& children,
+                                       const std::vector<std::string>& names);
+
+}
+
+#endif //__LIBRARY__H__
@@ -0,0 +1,49 @@
+#include "MappedFile.hpp"
+#include "HugePages.hpp"
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace GDSTXT {
+namespace IO {
+
+MappedFile::MappedFile(const std::string& filename, bool huge_pages, AccessHint access)
+  : _data(nullptr), _size(0)
+{
+  int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    throw std::runtime_error("Failed to open " + filename);
+
+  struct stat info;
+  if (::fstat(fd, &info) != 0) {
+    ::close(fd);
+    throw std::runtime_error("Failed to stat " + filename);
+  }
+  _size = static_cast<std::size_t>(info.st_size);
+  if (_size > 0) {
+    void* ptr = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (ptr == MAP_FAILED) {
+      ::close(fd);
+      throw std::runtime_error("Failed to map " + filename);
+    }
+    _data = static_cast<const unsigned char*>(ptr);
+    if (huge_pages)
+      advise_huge_pages(_data, _size);
+    if (access == AccessHint::sequential)
+      ::madvise(ptr, _size, MADV_SEQUENTIAL);
+    else if (access == AccessHint::random)
+      ::madvise(ptr, _size, MADV_RANDOM);
+  }
+  ::close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+  if (_data != nullptr)
+    ::munmap(const_cast<unsigned char*>(_data), _size);
+}
+
+}
+}
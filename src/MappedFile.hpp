@@ -0,0 +1,32 @@
+#ifndef __MAPPED__FILE__H__
+#define __MAPPED__FILE__H__
+
+#include <string>
+#include <cstddef>
+#include "Backend.hpp"
+
+namespace GDSTXT {
+namespace IO {
+
+// read-only mapping of a whole file, empty files map to nullptr;
+// huge_pages advises the mapping MADV_HUGEPAGE, which the kernel only
+// honours for page cache that can be folded into 2M pages, access
+// becomes MADV_SEQUENTIAL or MADV_RANDOM
+class MappedFile {
+  public:
+    explicit MappedFile(const std::string& filename, bool huge_pages = false,
+                        AccessHint access = AccessHint::none);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    const unsigned char* data() const noexcept { return _data; }
+    std::size_t size() const noexcept { return _size; }
+    ~MappedFile();
+  private:
+    const unsigned char* _data;
+    std::size_t _size;
+};
+
+}
+}
+
+#endif //__MAPPED__FILE__H__
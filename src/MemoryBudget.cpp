@@ -0,0 +1,78 @@
+#include "MemoryBudget.hpp"
+#include "test_config.h"
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+namespace GDSTXT {
+
+constexpr std::size_t MemoryBudget::minimum;
+constexpr std::size_t MemoryBudget::max_text_line;
+
+std::size_t MemoryBudget::parse(const std::string& text)
+{
+  char* end = nullptr;
+  auto value = std::strtoull(text.c_str(), &end, 10);
+  std::size_t unit = 1;
+  if (end != text.c_str() && *end != '\0' && end[1] == '\0') {
+    switch (*end) {
+      case 'k': case 'K': unit = 1 << 10; ++end; break;
+      case 'm': case 'M': unit = 1 << 20; ++end; break;
+      case 'g': case 'G': unit = 1 << 30; ++end; break;
+    }
+  }
+  if (end == text.c_str() || *end != '\0')
+    throw std::runtime_error("memory limit " + text + " is not a size");
+  auto limit = static_cast<std::size_t>(value) * unit;
+  if (limit < minimum)
+    throw std::runtime_error("memory limit " + text + " is below 1M");
+  return limit;
+}
+
+MemoryBudget::MemoryBudget(std::size_t limit)
+  : _limit(std::max(limit, minimum))
+{}
+
+IO::ReaderOptions MemoryBudget::reader(IO::IOBackend backend) const noexcept
+{
+  // io_uring slots plus the parse buffer, which may grow to max_buffer;
+  // near the minimum the longest text line squeezes the slots
+  IO::ReaderOptions options;
+  options.backend = backend;
+  options.queue_depth = 2;
+  options.max_buffer = std::max(_limit / 8, max_text_line);
+  options.block_size = (_limit / 4 - options.max_buffer) / options.queue_depth / 4096 * 4096;
+  return options;
+}
+
+IO::WriterOptions MemoryBudget::writer(IO::IOBackend backend, bool direct) const noexcept
+{
+  IO::WriterOptions options;
+  options.backend = backend;
+  options.direct = direct;
+  options.queue_depth = 2;
+  options.buffer_size = _limit / 8;
+  return options;
+}
+
+TEST_CASE("testing MemoryBudget") {
+  CHECK(MemoryBudget::parse("64M") == 64u << 20);
+  CHECK(MemoryBudget::parse("2g") == std::size_t(2) << 30);
+  CHECK(MemoryBudget::parse("1048576") == 1u << 20);
+  CHECK_THROWS_AS(MemoryBudget::parse("512K"), std::runtime_error);
+  CHECK_THROWS_AS(MemoryBudget::parse("64MB"), std::runtime_error);
+  CHECK_THROWS_AS(MemoryBudget::parse("M"), std::runtime_error);
+
+  MemoryBudget budget(MemoryBudget::minimum);
+  auto reader = budget.reader(IO::IOBackend::uring);
+  CHECK(reader.queue_depth * reader.block_size + reader.max_buffer <= budget.limit() / 4);
+  CHECK(reader.max_buffer > 65535);
+  CHECK(reader.max_buffer >= MemoryBudget::max_text_line);
+  CHECK(reader.block_size > 0);
+  MemoryBudget large(64 << 20);
+  CHECK(large.reader(IO::IOBackend::uring).block_size == 4 << 20);
+  auto writer = budget.writer(IO::IOBackend::uring, false);
+  CHECK(writer.queue_depth * writer.buffer_size <= budget.limit() / 4);
+}
+
+}
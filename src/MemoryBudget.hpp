@@ -0,0 +1,37 @@
+#ifndef __MEMORY__BUDGET__H__
+#define __MEMORY__BUDGET__H__
+
+#include <string>
+#include <cstddef>
+#include "Reader.hpp"
+#include "Writer.hpp"
+
+namespace GDSTXT {
+
+// A memory cap shared out over the buffers of a streaming conversion: a
+// quarter each for reading and writing, io_uring queues included, and an
+// eighth for layer columns, whose vectors may hold twice what they use.
+// The rest is headroom for the element being decoded. A gds record is at
+// most 65535 bytes and the parse buffer is never smaller than the longest
+// line gds2txt writes, so the read share always holds a whole record or
+// line; a longer hand-written line throws instead of growing the buffer.
+class MemoryBudget {
+  public:
+    static constexpr std::size_t minimum = 1 << 20;
+    // an 8191 point XY of 11 char values, "XY:" and a separator each;
+    // compact XY lines of as many moves are no longer
+    static constexpr std::size_t max_text_line = 3 + 8191 * 2 * 12;
+    // bytes with an optional K, M or G suffix, throws below minimum
+    static std::size_t parse(const std::string& text);
+    explicit MemoryBudget(std::size_t limit);
+    std::size_t limit() const noexcept { return _limit; }
+    IO::ReaderOptions reader(IO::IOBackend backend) const noexcept;
+    IO::WriterOptions writer(IO::IOBackend backend, bool direct) const noexcept;
+    std::size_t layer_columns() const noexcept { return _limit / 8; }
+  private:
+    std::size_t _limit;
+};
+
+}
+
+#endif //__MEMORY__BUDGET__H__
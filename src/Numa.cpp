@@ -0,0 +1,115 @@
+#include "Numa.hpp"
+#include "test_config.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <dirent.h>
+#include <sched.h>
+#include <unistd.h>
+
+namespace GDSTXT {
+
+std::vector<unsigned> parse_cpu_list(const std::string& text)
+{
+  std::vector<unsigned> ret;
+  std::istringstream list(text);
+  std::string range;
+  while (std::getline(list, range, ',')) {
+    if (range.empty() || range == "\n")
+      continue;
+    unsigned first = 0;
+    unsigned last = 0;
+    char tail = 0;
+    auto fields = std::sscanf(range.c_str(), "%u-%u%c", &first, &last, &tail);
+    if (fields == 1)
+      last = first;
+    else if (fields != 2 && !(fields == 3 && tail == '\n'))
+      throw std::runtime_error("Invalid cpu list " + text);
+    if (last < first)
+      throw std::runtime_error("Invalid cpu list " + text);
+    for (auto cpu = first; cpu <= last; ++cpu)
+      ret.push_back(cpu);
+  }
+  return ret;
+}
+
+std::vector<std::vector<unsigned>> numa_nodes()
+{
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (::sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+      CPU_SET(cpu, &allowed);
+  }
+
+  std::vector<std::vector<unsigned>> ret;
+  if (auto directory = ::opendir("/sys/devices/system/node")) {
+    // sysfs lists nodes in no particular order, nodeN is probed up to the highest seen
+    unsigned highest = 0;
+    while (auto entry = ::readdir(directory)) {
+      unsigned node = 0;
+      if (std::sscanf(entry->d_name, "node%u", &node) == 1)
+        highest = std::max(highest, node + 1);
+    }
+    ::closedir(directory);
+    for (unsigned node = 0; node < highest; ++node) {
+      std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+      std::string text;
+      if (!std::getline(file, text))
+        continue;
+      std::vector<unsigned> cpus;
+      for (auto cpu : parse_cpu_list(text)) {
+        if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))
+          cpus.push_back(cpu);
+      }
+      if (!cpus.empty())
+        ret.push_back(std::move(cpus));
+    }
+  }
+  if (ret.empty()) {
+    ret.emplace_back();
+    for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &allowed))
+        ret.back().push_back(cpu);
+    }
+  }
+  return ret;
+}
+
+bool pin_thread(const std::vector<unsigned>& cpus) noexcept
+{
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (auto cpu : cpus) {
+    if (cpu < CPU_SETSIZE)
+      CPU_SET(cpu, &set);
+  }
+  return ::sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+void touch_pages(const unsigned char* data, std::size_t size) noexcept
+{
+  static const auto page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+  volatile unsigned char sink = 0;
+  for (std::size_t offset = 0; offset < size; offset += page)
+    sink = sink + data[offset];
+  if (size > 0)
+    sink = sink + data[size - 1];
+}
+
+TEST_CASE("testing numa_nodes") {
+  CHECK(parse_cpu_list("0-3,8,10-11\n") == std::vector<unsigned> {0, 1, 2, 3, 8, 10, 11});
+  CHECK(parse_cpu_list("5") == std::vector<unsigned> {5});
+  CHECK(parse_cpu_list("").empty());
+  CHECK_THROWS_AS(parse_cpu_list("3-1"), std::runtime_error);
+  CHECK_THROWS_AS(parse_cpu_list("a"), std::runtime_error);
+
+  auto nodes = numa_nodes();
+  REQUIRE_FALSE(nodes.empty());
+  for (const auto& cpus : nodes)
+    CHECK_FALSE(cpus.empty());
+}
+
+}
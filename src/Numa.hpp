@@ -0,0 +1,27 @@
+#ifndef __NUMA__H__
+#define __NUMA__H__
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace GDSTXT {
+
+// "0-3,8,10-11" as 0 1 2 3 8 10 11, the format of sysfs cpulist files
+std::vector<unsigned> parse_cpu_list(const std::string& text);
+
+// CPUs of every NUMA node that has any this process may run on, from
+// /sys/devices/system/node; a single node with every allowed CPU where
+// the kernel has no NUMA support
+std::vector<std::vector<unsigned>> numa_nodes();
+
+// keeps the calling thread on cpus, false when the kernel refuses
+bool pin_thread(const std::vector<unsigned>& cpus) noexcept;
+
+// reads a byte of every page of [data, data + size) so the pages are
+// faulted in, and placed, by the calling thread's node
+void touch_pages(const unsigned char* data, std::size_t size) noexcept;
+
+}
+
+#endif //__NUMA__H__
@@ -0,0 +1,62 @@
+#ifndef __PARALLEL__H__
+#define __PARALLEL__H__
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <exception>
+#include <mutex>
+#include <algorithm>
+
+namespace GDSTXT {
+
+inline unsigned default_thread_count() noexcept
+{
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// fn(i) for i in [0, count) on up to threads threads, indices are handed
+// out one at a time so uneven work still balances, the first exception
+// thrown by fn is rethrown once every thread has stopped
+template<typename F>
+void parallel_for(std::size_t count, unsigned threads, F&& fn)
+{
+  threads = static_cast<unsigned>(std::min<std::size_t>(std::max(threads, 1u), count));
+  if (threads <= 1) {
+    for (std::size_t i = 0; i < count; ++i)
+      fn(i);
+    return;
+  }
+
+  std::atomic<std::size_t> next(0);
+  std::exception_ptr error;
+  std::mutex error_mutex;
+  auto worker = [&]() {
+    while (true) {
+      auto i = next.fetch_add(1);
+      if (i >= count)
+        return;
+      try {
+        fn(i);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!error)
+          error = std::current_exception();
+        next = count;
+      }
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (unsigned i = 1; i < threads; ++i)
+    pool.emplace_back(worker);
+  worker();
+  for (auto& i : pool)
+    i.join();
+  if (error)
+    std::rethrow_exception(error);
+}
+
+}
+
+#endif //__PARALLEL__H__
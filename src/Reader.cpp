@@ -1,40 +1,215 @@
 #include "Reader.hpp"
+#include "HugePages.hpp"
 #include <exception>
+#include <stdexcept>
 #include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace GDSTXT {
 namespace IO {
 
-Reader::Reader(const std::string& filename, const FileType filetype)
-  : _file_type(filetype)
+Reader::Reader(const std::string& filename, const FileType filetype, const ReaderOptions& options)
+  : _fd(-1), _file_type(filetype), _max_buffer(options.max_buffer), _huge_pages(options.huge_pages),
+    _access(options.access), _drop_behind(options.drop_behind), _advised(0), _dropped(0), _begin(0), _end(0), _consumed(0),
+    _piece_left(0), _piece_tag(0), _piece_type(0), _piece_size(0), _eof(false), _binary_index(0)
 {
-  if (_file_type == FileType::gds) {
-    _file_stream = std::ifstream(filename, std::ios::binary);
-  } else if (_file_type == FileType::txt) {
-    _file_stream = std::ifstream(filename);
+  if (_file_type == FileType::bin) {
+    _binary.reset(new BinaryFile(filename));
+    _eof = true;
+    return;
   }
-  if (! _file_stream)
+  _fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  if (_fd < 0)
     throw std::runtime_error("Failed to open " + filename);
+  if (_access == AccessHint::sequential)
+    ::posix_fadvise(_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  else if (_access == AccessHint::random)
+    ::posix_fadvise(_fd, 0, 0, POSIX_FADV_RANDOM);
+  _source = make_input(_fd, options.backend, options.block_size, options.queue_depth, _huge_pages);
+  _buffer.resize(std::max<std::size_t>(options.block_size, 1 << 16));
+  if (_huge_pages)
+    advise_huge_pages(_buffer.data(), _buffer.size());
 }
 
-std::deque<unsigned char> Reader::readStream()
+Reader::~Reader()
 {
+  _source = nullptr;
+  // from the start, large folios straddling the earlier drops go too
+  if (_drop_behind && _fd >= 0)
+    ::posix_fadvise(_fd, 0, static_cast<off_t>(offset()), POSIX_FADV_DONTNEED);
+  if (_fd >= 0)
+    ::close(_fd);
+}
+
+bool Reader::_fill(std::size_t size)
+{
+  if (_end - _begin >= size)
+    return true;
+  if (_eof)
+    return false;
+
+  if (_begin + size > _buffer.size()) {
+    std::memmove(_buffer.data(), _buffer.data() + _begin, _end - _begin);
+    _consumed += _begin;
+    _end -= _begin;
+    _begin = 0;
+    if (size > _buffer.size()) {
+      if (_max_buffer > 0 && size > _max_buffer)
+        throw std::runtime_error("data at offset " + std::to_string(offset()) + " needs more than "
+                                 + std::to_string(_max_buffer) + " buffered bytes");
+      _buffer.resize(size);
+      if (_huge_pages)
+        advise_huge_pages(_buffer.data(), _buffer.size());
+    }
+  }
+  while (_end - _begin < size) {
+    auto count = _source->read(_buffer.data() + _end, _buffer.size() - _end);
+    if (count == 0) {
+      _eof = true;
+      return false;
+    }
+    _end += count;
+  }
+  _advise();
+  return true;
+}
+
+void Reader::_advise()
+{
+  // a few blocks at a time, not one call per record
+  auto window = static_cast<uint64_t>(std::max<std::size_t>(_buffer.size(), 1 << 20)) * 4;
+  uint64_t delivered = _consumed + _end;
+  if (_access == AccessHint::sequential && delivered + window / 2 > _advised) {
+    _advised = std::max(_advised, delivered);
+    ::posix_fadvise(_fd, static_cast<off_t>(_advised), static_cast<off_t>(window), POSIX_FADV_WILLNEED);
+    _advised += window;
+  }
+  // whole pages before the oldest byte still buffered
+  auto behind = _consumed / 4096 * 4096;
+  if (_drop_behind && behind >= _dropped + window) {
+    ::posix_fadvise(_fd, static_cast<off_t>(_dropped), static_cast<off_t>(behind - _dropped), POSIX_FADV_DONTNEED);
+    _dropped = behind;
+  }
+}
+
+bool Reader::readRecord(RecordView& record)
+{
+  if (_binary) {
+    if (_binary_index == _binary->size())
+      return false;
+    _binary->encode_gds(_binary_index, _binary_body);
+    record.tag = _binary->tag(_binary_index);
+    record.data_type = _binary->data_type(_binary_index);
+    record.body = _binary_body.data();
+    record.size = _binary_body.size();
+    ++_binary_index;
+    return true;
+  }
+
   if (this->is_read_done())
-    return std::move(std::deque<unsigned char>());
+    return false;
 
-  std::deque<unsigned char> meta_data(4);
-  _file_stream.read(reinterpret_cast<char*>(&meta_data[0]), 4);
+  if (!_fill(4))
+    throw std::runtime_error("record header at offset " + std::to_string(offset()) + " is truncated");
 
-  auto body_data_size = 
-    chars_to_bit_array(std::begin(meta_data), std::begin(meta_data)+2).at(0) - 4;
+  auto first = _buffer.data() + _begin;
+  std::size_t record_size = load_be16(first);
+  if (record_size < 4)
+    throw std::runtime_error("record length " + std::to_string(record_size) + " at offset "
+                             + std::to_string(offset()) + " is corrupted");
+  if (!_fill(record_size))
+    throw std::runtime_error("record body at offset " + std::to_string(offset()) + " is truncated");
 
-  std::deque<unsigned char> data(body_data_size + 2);
-  data[0] = meta_data[2];
-  data[1] = meta_data[3];
-  _file_stream.read(reinterpret_cast<char*>(&data[2]),body_data_size);
-  return std::move(data);
+  first = _buffer.data() + _begin;
+  record.tag = first[2];
+  record.data_type = first[3];
+  record.body = first + 4;
+  record.size = record_size - 4;
+  _begin += record_size;
+  return true;
 }
 
+bool Reader::readPiece(RecordPiece& piece)
+{
+  if (_binary || _piece_left == 0) {
+    RecordView record;
+    if (_binary) {
+      if (!readRecord(record))
+        return false;
+      piece = RecordPiece {record.tag, record.data_type, record.body, record.size, record.size, true, true};
+      return true;
+    }
+    if (this->is_read_done())
+      return false;
+    if (!_fill(4))
+      throw std::runtime_error("record header at offset " + std::to_string(offset()) + " is truncated");
+    auto first = _buffer.data() + _begin;
+    std::size_t record_size = load_be16(first);
+    if (record_size < 4)
+      throw std::runtime_error("record length " + std::to_string(record_size) + " at offset "
+                               + std::to_string(offset()) + " is corrupted");
+    _piece_tag = first[2];
+    _piece_type = first[3];
+    _piece_size = record_size - 4;
+    _piece_left = _piece_size;
+    _begin += 4;
+    piece.first = true;
+  } else {
+    piece.first = false;
+  }
+
+  piece.tag = _piece_tag;
+  piece.data_type = _piece_type;
+  piece.record_size = _piece_size;
+  piece.body = _buffer.data() + _begin;
+  piece.size = 0;
+  if (_piece_left > 0) {
+    if (!_fill(1))
+      throw std::runtime_error("record body at offset " + std::to_string(offset()) + " is truncated");
+    piece.body = _buffer.data() + _begin;
+    piece.size = std::min(_piece_left, _end - _begin);
+    _begin += piece.size;
+    _piece_left -= piece.size;
+  }
+  piece.last = _piece_left == 0;
+  return true;
+}
 
+bool RecordCursor::next(RecordView& record)
+{
+  if (_offset == _size)
+    return false;
+  if (_size - _offset < 4)
+    throw std::runtime_error("record header at offset " + std::to_string(_offset) + " is truncated");
+
+  auto first = _data + _offset;
+  std::size_t record_size = load_be16(first);
+  if (record_size < 4)
+    throw std::runtime_error("record length " + std::to_string(record_size) + " at offset "
+                             + std::to_string(_offset) + " is corrupted");
+  if (_size - _offset < record_size)
+    throw std::runtime_error("record body at offset " + std::to_string(_offset) + " is truncated");
+
+  record.tag = first[2];
+  record.data_type = first[3];
+  record.body = first + 4;
+  record.size = record_size - 4;
+  _offset += record_size;
+  return true;
+}
+
+std::deque<unsigned char> Reader::readStream()
+{
+  RecordView record;
+  if (!readRecord(record))
+    return std::deque<unsigned char>();
+
+  std::deque<unsigned char> data {record.tag, record.data_type};
+  data.insert(data.end(), record.body, record.body + record.size);
+  return data;
+}
+
+
+}
 }
-}
\ No newline at end of file
@@ -4,33 +4,129 @@
 #include <string>
 #include <utility>
 #include <deque>
-#include <fstream>
+#include <vector>
+#include <memory>
+#include <cstring>
 #include <exception>
 #include <iterator>
 #include "convert_func.hpp"
+#include "Backend.hpp"
+#include "Binary.hpp"
 
 namespace GDSTXT {
 namespace IO {
 
+// backend/queue_depth: io_uring keeps queue_depth reads of block_size
+//                      in flight ahead of the parser
+// max_buffer: most bytes the parse buffer may grow to for one record or
+//             text line, 0 for no limit; a longer one throws
+// huge_pages: parse buffer and io_uring blocks on huge pages where they
+//             span whole ones
+// access: posix_fadvise hint for the whole file, sequential also asks for
+//         the blocks ahead of the parser with WILLNEED
+// drop_behind: page cache behind the parser is released with DONTNEED,
+//              so a large conversion doesn't evict what other jobs use
+struct ReaderOptions {
+  IOBackend backend = IOBackend::sync;
+  std::size_t block_size = 1 << 20;
+  unsigned queue_depth = 4;
+  std::size_t max_buffer = 0;
+  bool huge_pages = false;
+  AccessHint access = AccessHint::none;
+  bool drop_behind = false;
+};
+
+// one gds record, body excludes length, tag and data type bytes and
+// stays valid until the next read
+struct RecordView {
+  unsigned char tag;
+  unsigned char data_type;
+  const unsigned char* body;
+  std::size_t size;
+};
+
+// a stretch of one record's body as read() returned it, without waiting
+// for the rest of the record; the first piece of a record has first set,
+// its last piece last, and size is 0 only for records without a body
+struct RecordPiece {
+  unsigned char tag;
+  unsigned char data_type;
+  const unsigned char* body;
+  std::size_t size;
+  // body bytes of the whole record
+  std::size_t record_size;
+  bool first;
+  bool last;
+};
+
 class Reader {
   public:
+    // bin is the column dump of BinaryWriter, read back as gds records
     enum class FileType {
       gds,
-      txt
+      txt,
+      bin
     };
-    Reader(const std::string& filename, const FileType filetype);
+    Reader(const std::string& filename, const FileType filetype,
+           const ReaderOptions& options = ReaderOptions());
     Reader(const Reader&) = delete;
     Reader& operator=(const Reader&) = delete;
     std::deque<unsigned char> readStream();
+    bool readRecord(RecordView& record);
+    // records in pieces, the buffer never has to hold a whole record;
+    // not to be mixed with readRecord() within a record
+    bool readPiece(RecordPiece& piece);
     inline std::string readText();
-    inline bool is_read_done() noexcept;
-    ~Reader()
-    {
-      _file_stream.close();
-    }
+    inline bool is_read_done();
+    // file offset of the next record, gds and txt files only
+    uint64_t offset() const noexcept { return _consumed + _begin; }
+    ~Reader();
   private:
-    std::ifstream _file_stream;
+    // make at least size unread bytes contiguous in _buffer,
+    // false if the file ends first
+    bool _fill(std::size_t size);
+    // WILLNEED ahead of and DONTNEED behind the bytes read so far
+    void _advise();
+
+    int _fd;
     FileType _file_type;
+    std::unique_ptr<InputSource> _source;
+    std::vector<unsigned char> _buffer;
+    std::size_t _max_buffer;
+    bool _huge_pages;
+    AccessHint _access;
+    bool _drop_behind;
+    // readahead asked for up to here, page cache dropped up to here
+    uint64_t _advised;
+    uint64_t _dropped;
+    std::size_t _begin;
+    std::size_t _end;
+    // bytes dropped from the front of _buffer so far
+    uint64_t _consumed;
+    // body bytes of the record readPiece() is in the middle of
+    std::size_t _piece_left;
+    unsigned char _piece_tag;
+    unsigned char _piece_type;
+    std::size_t _piece_size;
+    bool _eof;
+    std::unique_ptr<BinaryFile> _binary;
+    std::size_t _binary_index;
+    std::vector<unsigned char> _binary_body;
+};
+
+// records of a gds image already in memory, e.g. a MappedFile, the views
+// point into it; throws on truncated or corrupted lengths
+class RecordCursor {
+  public:
+    RecordCursor(const unsigned char* data, std::size_t size, uint64_t offset = 0) noexcept
+      : _data(data), _size(size), _offset(offset) {}
+    bool next(RecordView& record);
+    // offset of the next record
+    uint64_t offset() const noexcept { return _offset; }
+  private:
+    const unsigned char* _data;
+    std::size_t _size;
+    uint64_t _offset;
 };
 
 }
@@ -45,19 +141,35 @@ std::string Reader::readText()
   if (this->is_read_done())
     return "";
 
-  std::string line;
-  std::getline(_file_stream, line);
-  return std::move(line);
+  std::size_t scanned = 0;
+  while (true) {
+    auto first = _buffer.data() + _begin;
+    auto found = static_cast<unsigned char*>(
+      std::memchr(first + scanned, '\n', _end - _begin - scanned));
+    if (found != nullptr) {
+      std::string line(first, found);
+      _begin += found - first + 1;
+      return line;
+    }
+    scanned = _end - _begin;
+    if (!_fill(scanned + 1)) {
+      std::string line(_buffer.data() + _begin, _buffer.data() + _end);
+      _begin = _end;
+      return line;
+    }
+  }
 }
 
 inline
-bool Reader::is_read_done() noexcept
+bool Reader::is_read_done()
 {
-  return _file_stream.peek() == std::ifstream::traits_type::eof();
+  if (_binary)
+    return _binary_index == _binary->size();
+  return _begin == _end && !_fill(1);
 }
 
 
 }
 }
 
-#endif //__READER__H__
\ No newline at end of file
+#endif //__READER__H__
@@ -30,75 +30,13 @@ noexcept
 inline
 std::string StreamRecord::to_text() const
 {
-  SPEC::TagDataType tag_data_type = 
-    static_cast<SPEC::TagDataType>(_tag_data_type);
-
-  std::vector<std::string> data_str_vec;
-  auto data_to_str_func = [&data_str_vec](auto& data) {
-    std::for_each(data.begin(), data.end(), [&data_str_vec](auto& i){
-      if (typeid(i) == typeid(double)) {
-        std::ostringstream os;
-        os << i;
-        data_str_vec.emplace_back(os.str());
-      } else {
-        data_str_vec.emplace_back(std::to_string(i));
-      }
-    });
-  };
-
-  switch(tag_data_type) {
-    case SPEC::TagDataType::NODATA: {
-      break;
-    }
-    case SPEC::TagDataType::BITARRAY: {
-      auto data = chars_to_bit_array(_bytes_data->begin()+2, _bytes_data->end());
-      data_to_str_func(data);
-      break;
-    }
-    case SPEC::TagDataType::INTEGER_2: {
-      auto data = chars_to_int2(_bytes_data->begin()+2, _bytes_data->end());
-      data_to_str_func(data);
-      break;
-    }
-    case SPEC::TagDataType::INTEGER_4: {
-      auto data = chars_to_int4(_bytes_data->begin()+2, _bytes_data->end());
-      data_to_str_func(data);
-      break;
-    }
-    case SPEC::TagDataType::REAL_4: {
-      throw std::runtime_error("real4 is not supported");
-      break;
-    }
-    case SPEC::TagDataType::REAL_8: {
-      auto data = chars_to_real8(_bytes_data->begin()+2, _bytes_data->end());
-      data_to_str_func(data);
-      break;
-    }
-    case SPEC::TagDataType::ASCII: {
-      auto data = chars_to_string(_bytes_data->begin()+2, _bytes_data->end());
-      data_str_vec.emplace_back(data);
-      break;
-    }
-    case SPEC::TagDataType::BAD: {
-      throw std::runtime_error("bad data type");
-      break;
-    }
-    default: {
-      throw std::runtime_error("unknow data type");
-      break;
-    }
-  }
-
-  std::string ret_str = std::get<0>(SPEC::tagname_map.at(_tag_name));
-  if (!data_str_vec.empty()) {
-    ret_str.append(":");
-    for (const auto& i: data_str_vec) {
-      ret_str.append(i + " ");
-    }
-    ret_str.erase(ret_str.length() - 1);
-  }
-
-  return std::move(ret_str); 
+  // the deque holds tag and data type ahead of the body
+  std::vector<unsigned char> body(_bytes_data->begin() + 2, _bytes_data->end());
+  std::vector<char> text;
+  auto status = decode_record(_tag_name, _tag_data_type, body.data(), body.size(), text);
+  if (status != Status::ok)
+    throw std::runtime_error(status_message(status));
+  return std::string(text.begin(), text.end());
 }
 
 inline
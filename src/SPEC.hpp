@@ -4,73 +4,132 @@
 #include <unordered_map>
 #include <string>
 #include <tuple>
+#include <cstddef>
 
 namespace GDSTXT {
 namespace SPEC {
 
-static const std::unordered_map<unsigned char, std::tuple<std::string, unsigned char>> 
-tagname_map {
-  {0x00, {"HEADER", 0x02}},
-  {0x01, {"BGNLIB", 0x02}},
-  {0x02, {"LIBNAME", 0x06}},
-  {0x03, {"UNITS", 0x05}},
-  {0x04, {"ENDLIB", 0x00}},
-  {0x05, {"BGNSTR", 0x02}},
-  {0x06, {"STRNAME", 0x06}},
-  {0x07, {"ENDSTR", 0x00}},
-  {0x08, {"BOUNDARY", 0x00}},
-  {0x09, {"PATH", 0x00}},
-  {0x0a, {"SREF", 0x00}},
-  {0x0b, {"AREF", 0x00}},
-  {0x0c, {"TEXT", 0x00}},
-  {0x0d, {"LAYER", 0x02}},
-  {0x0e, {"DATATYPE", 0x02}},
-  {0x0f, {"WIDTH", 0x03}},
-  {0x10, {"XY", 0x03}},
-  {0x11, {"ENDEL", 0x00}},
-  {0x12, {"SNAME", 0x06}},
-  {0x13, {"CLOROW", 0x02}},
-  {0x14, {"TEXTNODE", 0x00}},
-  {0x15, {"NODE", 0x00}},
-  {0x16, {"TEXTTYPE", 0x02}},
-  {0x17, {"PRESENTATION", 0x01}},
-  {0x18, {"SPACING", 0xff}},
-  {0x19, {"STRING", 0x06}},
-  {0x1a, {"STRANS", 0x01}},
-  {0x1b, {"MAG", 0x05}},
-  {0x1c, {"ANGLE", 0x05}},
-  {0x1d, {"UINTEGER", 0xff}},
-  {0x1e, {"USTRING", 0xff}},
-  {0x1f, {"REFLIBS", 0x06}},
-  {0x20, {"FONTS", 0x06}},
-  {0x21, {"PATHTYPE", 0x02}},
-  {0x22, {"GENERATIONS", 0x02}},
-  {0x23, {"ATTRTABLE", 0x06}},
-  {0x24, {"STYPTABLE", 0x06}},
-  {0x25, {"STRTYPE", 0x02}},
-  {0x26, {"ELFLAGS", 0x01}},
-  {0x27, {"ELKEY", 0x03}},
-  {0x28, {"LINKTYPE", 0xff}},
-  {0x29, {"LINKKEYS", 0xff}},
-  {0x2a, {"NODETYPE", 0x02}},
-  {0x2b, {"PROPATTR", 0x02}},
-  {0x2c, {"PROPVALUE", 0x06}},
-  {0x2d, {"BOX", 0x00}},
-  {0x2e, {"BOXTYPE", 0x02}},
-  {0x2f, {"PLEX", 0x03}},
-  {0x30, {"BGNEXTN", 0x03}},
-  {0x31, {"ENDTEXTN", 0x04}},
-  {0x32, {"TAPENUM", 0x02}},
-  {0x33, {"TAPECODE", 0x02}},
-  {0x34, {"STRCLASS", 0x01}},
-  {0x35, {"RESERVED", 0x03}},
-  {0x36, {"FORMAT", 0x02}},
-  {0x37, {"MASK", 0x06}},
-  {0x38, {"ENDMASKS", 0x00}},
-  {0x39, {"LIBDIRSIZE", 0x02}},
-  {0x3a, {"SRFNAME", 0x06}},
-  {0x3b, {"LIBSECUR", 0x02}},
-  {0x3c, {"UNKNOW", 0xff}},
+struct TagSpec {
+  const char* name;
+  unsigned char data_type;
+};
+
+// name and data type by tag byte, 0xff where the spec gives none
+constexpr TagSpec tag_specs[] {
+  {"HEADER", 0x02},     // 0x00
+  {"BGNLIB", 0x02},     // 0x01
+  {"LIBNAME", 0x06},    // 0x02
+  {"UNITS", 0x05},      // 0x03
+  {"ENDLIB", 0x00},     // 0x04
+  {"BGNSTR", 0x02},     // 0x05
+  {"STRNAME", 0x06},    // 0x06
+  {"ENDSTR", 0x00},     // 0x07
+  {"BOUNDARY", 0x00},   // 0x08
+  {"PATH", 0x00},       // 0x09
+  {"SREF", 0x00},       // 0x0a
+  {"AREF", 0x00},       // 0x0b
+  {"TEXT", 0x00},       // 0x0c
+  {"LAYER", 0x02},      // 0x0d
+  {"DATATYPE", 0x02},   // 0x0e
+  {"WIDTH", 0x03},      // 0x0f
+  {"XY", 0x03},         // 0x10
+  {"ENDEL", 0x00},      // 0x11
+  {"SNAME", 0x06},      // 0x12
+  {"CLOROW", 0x02},     // 0x13
+  {"TEXTNODE", 0x00},   // 0x14
+  {"NODE", 0x00},       // 0x15
+  {"TEXTTYPE", 0x02},   // 0x16
+  {"PRESENTATION", 0x01},// 0x17
+  {"SPACING", 0xff},    // 0x18
+  {"STRING", 0x06},     // 0x19
+  {"STRANS", 0x01},     // 0x1a
+  {"MAG", 0x05},        // 0x1b
+  {"ANGLE", 0x05},      // 0x1c
+  {"UINTEGER", 0xff},   // 0x1d
+  {"USTRING", 0xff},    // 0x1e
+  {"REFLIBS", 0x06},    // 0x1f
+  {"FONTS", 0x06},      // 0x20
+  {"PATHTYPE", 0x02},   // 0x21
+  {"GENERATIONS", 0x02},// 0x22
+  {"ATTRTABLE", 0x06},  // 0x23
+  {"STYPTABLE", 0x06},  // 0x24
+  {"STRTYPE", 0x02},    // 0x25
+  {"ELFLAGS", 0x01},    // 0x26
+  {"ELKEY", 0x03},      // 0x27
+  {"LINKTYPE", 0xff},   // 0x28
+  {"LINKKEYS", 0xff},   // 0x29
+  {"NODETYPE", 0x02},   // 0x2a
+  {"PROPATTR", 0x02},   // 0x2b
+  {"PROPVALUE", 0x06},  // 0x2c
+  {"BOX", 0x00},        // 0x2d
+  {"BOXTYPE", 0x02},    // 0x2e
+  {"PLEX", 0x03},       // 0x2f
+  {"BGNEXTN", 0x03},    // 0x30
+  {"ENDTEXTN", 0x04},   // 0x31
+  {"TAPENUM", 0x02},    // 0x32
+  {"TAPECODE", 0x02},   // 0x33
+  {"STRCLASS", 0x01},   // 0x34
+  {"RESERVED", 0x03},   // 0x35
+  {"FORMAT", 0x02},     // 0x36
+  {"MASK", 0x06},       // 0x37
+  {"ENDMASKS", 0x00},   // 0x38
+  {"LIBDIRSIZE", 0x02}, // 0x39
+  {"SRFNAME", 0x06},    // 0x3a
+  {"LIBSECUR", 0x02},   // 0x3b
+  {"UNKNOW", 0xff},     // 0x3c
+};
+
+constexpr std::size_t tag_count = sizeof(tag_specs) / sizeof(tag_specs[0]);
+
+inline
+std::unordered_map<unsigned char, std::tuple<std::string, unsigned char>> _make_tagname_map()
+{
+  std::unordered_map<unsigned char, std::tuple<std::string, unsigned char>> map;
+  for (std::size_t tag = 0; tag < tag_count; ++tag)
+    map.emplace(static_cast<unsigned char>(tag), std::make_tuple(tag_specs[tag].name, tag_specs[tag].data_type));
+  return map;
+}
+
+static const std::unordered_map<unsigned char, std::tuple<std::string, unsigned char>>
+tagname_map = _make_tagname_map();
+
+enum class Tag : unsigned char {
+  HEADER       = 0x00,
+  BGNLIB       = 0x01,
+  LIBNAME      = 0x02,
+  UNITS        = 0x03,
+  ENDLIB       = 0x04,
+  BGNSTR       = 0x05,
+  STRNAME      = 0x06,
+  ENDSTR       = 0x07,
+  BOUNDARY     = 0x08,
+  PATH         = 0x09,
+  SREF         = 0x0a,
+  AREF         = 0x0b,
+  TEXT         = 0x0c,
+  LAYER        = 0x0d,
+  DATATYPE     = 0x0e,
+  WIDTH        = 0x0f,
+  XY           = 0x10,
+  ENDEL        = 0x11,
+  SNAME        = 0x12,
+  COLROW       = 0x13,
+  TEXTNODE     = 0x14,
+  NODE         = 0x15,
+  TEXTTYPE     = 0x16,
+  PRESENTATION = 0x17,
+  STRING       = 0x19,
+  STRANS       = 0x1a,
+  MAG          = 0x1b,
+  ANGLE        = 0x1c,
+  PATHTYPE     = 0x21,
+  ELFLAGS      = 0x26,
+  NODETYPE     = 0x2a,
+  PROPATTR     = 0x2b,
+  PROPVALUE    = 0x2c,
+  BOX          = 0x2d,
+  BOXTYPE      = 0x2e,
+  PLEX         = 0x2f,
 };
 
 enum class TagDataType {
@@ -0,0 +1,471 @@
+#include "Server.hpp"
+#include "Codec.hpp"
+#include "Hash.hpp"
+#include "MappedFile.hpp"
+#include "Reader.hpp"
+#include "SpatialIndex.hpp"
+#include "TextFormat.hpp"
+#include "Validate.hpp"
+#include "test_config.h"
+#include "test_fixtures.h"
+#include <cerrno>
+#include <cstring>
+#include <future>
+#include <stdexcept>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace GDSTXT {
+
+namespace {
+
+// output bytes per frame, one send(2) each
+constexpr std::size_t frame_size = 256 << 10;
+// longest request line taken before the connection is dropped
+constexpr std::size_t max_request = 64 << 10;
+
+void _send_all(int fd, const char* data, std::size_t size)
+{
+  while (size > 0) {
+    auto count = ::send(fd, data, size, MSG_NOSIGNAL);
+    if (count < 0 && errno == EINTR)
+      continue;
+    if (count <= 0)
+      throw std::runtime_error("connection closed while sending");
+    data += count;
+    size -= static_cast<std::size_t>(count);
+  }
+}
+
+// false at end of stream before the first byte
+bool _recv_all(int fd, char* data, std::size_t size)
+{
+  std::size_t done = 0;
+  while (done < size) {
+    auto count = ::recv(fd, data + done, size - done, 0);
+    if (count < 0 && errno == EINTR)
+      continue;
+    if (count == 0 && done == 0)
+      return false;
+    if (count <= 0)
+      throw std::runtime_error("connection closed while receiving");
+    done += static_cast<std::size_t>(count);
+  }
+  return true;
+}
+
+void _send_frame(int fd, const std::string& payload)
+{
+  unsigned char size[4];
+  store_be32(size, static_cast<uint32_t>(payload.size()));
+  _send_all(fd, reinterpret_cast<const char*>(size), 4);
+  _send_all(fd, payload.data(), payload.size());
+}
+
+// every Writer flush becomes one frame, the length written in front of
+// the staged bytes so header and body leave in one send
+class FrameSink: public IO::OutputSink {
+  public:
+    FrameSink(int fd, std::size_t capacity) : _fd(fd), _frame(capacity + 4) {}
+    char* buffer() override { return _frame.data() + 4; }
+    char* submit(std::size_t size) override
+    {
+      if (size > 0) {
+        store_be32(reinterpret_cast<unsigned char*>(_frame.data()), static_cast<uint32_t>(size));
+        _send_all(_fd, _frame.data(), size + 4);
+      }
+      return buffer();
+    }
+    void finish() override {}
+  private:
+    int _fd;
+    std::vector<char> _frame;
+};
+
+sockaddr_un _address(const std::string& path)
+{
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(address.sun_path))
+    throw std::runtime_error("socket path " + path + " is empty or too long");
+  std::memcpy(address.sun_path, path.c_str(), path.size());
+  return address;
+}
+
+int _connect(const std::string& path)
+{
+  auto address = _address(path);
+  int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    throw std::runtime_error("Failed to create a socket");
+  if (::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+struct FileStamp {
+  uint64_t size;
+  int64_t mtime;
+  uint64_t inode;
+  bool operator==(const FileStamp& other) const noexcept
+  {
+    return size == other.size && mtime == other.mtime && inode == other.inode;
+  }
+};
+
+FileStamp _stamp(const std::string& path)
+{
+  struct stat info;
+  if (::stat(path.c_str(), &info) != 0)
+    throw std::runtime_error("Failed to open " + path);
+  return FileStamp {static_cast<uint64_t>(info.st_size),
+    static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec,
+    static_cast<uint64_t>(info.st_ino)};
+}
+
+}
+
+///////////////////////////////////////////
+
+// one gds as of stamp, what a command builds from it is kept for the next
+struct Server::Entry {
+  Entry(const std::string& path, const FileStamp& stamp) : path(path), stamp(stamp), gds(path) {}
+
+  const SpatialIndex& spatial_index(unsigned threads)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!index)
+      index.reset(new SpatialIndex(SpatialIndex::open(path, IO::ReaderOptions(), threads)));
+    return *index;
+  }
+
+  const StructureHashes& structure_hashes(unsigned threads)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!hashes)
+      hashes.reset(new StructureHashes(gds.data(), gds.size(), threads));
+    return *hashes;
+  }
+
+  std::string path;
+  FileStamp stamp;
+  // Server::_uses at the last request for it
+  uint64_t used = 0;
+  IO::MappedFile gds;
+  std::mutex mutex;
+  std::unique_ptr<SpatialIndex> index;
+  std::unique_ptr<StructureHashes> hashes;
+};
+
+Server::Server(const std::string& socket_path, unsigned threads)
+  : _socket_path(socket_path), _listen(-1), _threads(std::max(threads, 1u)),
+    _stopping(false), _uses(0), _pool(threads)
+{
+  auto address = _address(socket_path);
+  struct stat info;
+  if (::lstat(socket_path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+    int probe = _connect(socket_path);
+    if (probe >= 0) {
+      ::close(probe);
+      throw std::runtime_error("a server already listens on " + socket_path);
+    }
+    ::unlink(socket_path.c_str());
+  }
+
+  _listen = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (_listen < 0)
+    throw std::runtime_error("Failed to create a socket");
+  if (::bind(_listen, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+      || ::listen(_listen, SOMAXCONN) != 0) {
+    ::close(_listen);
+    throw std::runtime_error("Failed to listen on " + socket_path);
+  }
+}
+
+Server::~Server()
+{
+  ::close(_listen);
+  ::unlink(_socket_path.c_str());
+}
+
+void Server::stop() noexcept
+{
+  _stopping = true;
+  // wakes the accept() serve() blocks in
+  ::shutdown(_listen, SHUT_RDWR);
+}
+
+void Server::serve()
+{
+  while (!_stopping) {
+    int fd = ::accept4(_listen, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (_stopping)
+        break;
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      throw std::runtime_error("Failed to accept on " + _socket_path);
+    }
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _connections.insert(fd);
+    }
+    // waits on the client between requests, _connection() removes fd
+    // and signals _closed as its last step
+    std::thread(&Server::_connection, this, fd).detach();
+  }
+
+  // requests under way finish, the next read of each connection sees
+  // the end of the stream
+  std::unique_lock<std::mutex> lock(_mutex);
+  for (auto fd : _connections)
+    ::shutdown(fd, SHUT_RD);
+  _closed.wait(lock, [this]() { return _connections.empty(); });
+}
+
+std::shared_ptr<Server::Entry> Server::_entry(const std::string& path)
+{
+  auto stamp = _stamp(path);
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto found = _entries.find(path);
+  if (found != _entries.end() && found->second->stamp == stamp) {
+    found->second->used = ++_uses;
+    return found->second;
+  }
+  // requests still holding an old or evicted entry keep its mapping alive
+  auto entry = std::make_shared<Entry>(path, stamp);
+  entry->used = ++_uses;
+  _entries[path] = entry;
+  if (_entries.size() > max_entries) {
+    auto oldest = _entries.begin();
+    for (auto i = _entries.begin(); i != _entries.end(); ++i) {
+      if (i->second->used < oldest->second->used)
+        oldest = i;
+    }
+    _entries.erase(oldest);
+  }
+  return entry;
+}
+
+void Server::_connection(int fd)
+{
+  std::string pending;
+  char chunk[4096];
+  try {
+    while (true) {
+      auto newline = pending.find('\n');
+      if (newline == std::string::npos) {
+        if (pending.size() > max_request)
+          break;
+        auto count = ::recv(fd, chunk, sizeof(chunk), 0);
+        if (count < 0 && errno == EINTR)
+          continue;
+        if (count <= 0)
+          break;
+        pending.append(chunk, static_cast<std::size_t>(count));
+        continue;
+      }
+
+      std::vector<std::string> fields;
+      std::size_t first = 0;
+      while (true) {
+        auto tab = pending.find('\t', first);
+        if (tab == std::string::npos || tab > newline) {
+          fields.push_back(pending.substr(first, newline - first));
+          break;
+        }
+        fields.push_back(pending.substr(first, tab - first));
+        first = tab + 1;
+      }
+      pending.erase(0, newline + 1);
+
+      // only the request itself takes a pool worker
+      std::promise<std::string> answered;
+      auto outcome = answered.get_future();
+      _pool.submit([this, fd, &fields, &answered](unsigned) {
+        try {
+          std::string outcome;
+          IO::Writer output(std::unique_ptr<IO::OutputSink>(new FrameSink(fd, frame_size)), frame_size, "connection");
+          try {
+            outcome = _answer(fields, output) ? "ok" : "fail";
+            output.close();
+          } catch (const std::exception& e) {
+            outcome = std::string("error: ") + e.what();
+          }
+          answered.set_value(outcome);
+        } catch (...) {
+          answered.set_exception(std::current_exception());
+        }
+      });
+      auto result = outcome.get();
+      _send_frame(fd, "");
+      _send_frame(fd, result);
+    }
+  } catch (const std::exception&) {
+    // the client went away, nobody is left to tell
+  }
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _connections.erase(fd);
+    _closed.notify_all();
+  }
+  // the server may be gone from here on
+  ::close(fd);
+}
+
+bool Server::_answer(const std::vector<std::string>& fields, IO::Writer& output)
+{
+  const auto& command = fields[0];
+  if (command != "txt" && command != "bbox" && command != "window"
+      && command != "validate" && command != "duplicates")
+    throw std::runtime_error("unknown command " + command);
+  std::size_t expected = command == "window" ? 3 : 2;
+  if (fields.size() != expected)
+    throw std::runtime_error(command + " takes " + std::to_string(expected - 1) + " argument(s)");
+
+  auto entry = _entry(fields[1]);
+  auto data = entry->gds.data();
+  auto size = entry->gds.size();
+
+  if (command == "txt") {
+    IO::RecordCursor cursor(data, size);
+    IO::RecordView record;
+    while (cursor.next(record))
+      write_record_text(record, output);
+    return true;
+  }
+
+  if (command == "bbox") {
+    for (const auto& cell : entry->spatial_index(_threads).cells()) {
+      output.write(cell.name);
+      if (cell.box.empty()) {
+        output.write(" empty\n");
+        continue;
+      }
+      for (auto value : {cell.box.x_min, cell.box.y_min, cell.box.x_max, cell.box.y_max}) {
+        output.put(' ');
+        output.write_int(value);
+      }
+      output.put('\n');
+    }
+    return true;
+  }
+
+  if (command == "window") {
+    Box window;
+    if (!parse_window(fields[2], window))
+      throw std::runtime_error("window expects x1,y1,x2,y2");
+    for_each_window_record(entry->spatial_index(_threads), data, size, window,
+      [&output](const IO::RecordView& record) { write_record_text(record, output); });
+    return true;
+  }
+
+  if (command == "validate") {
+    auto issues = validate_gds(data, size);
+    write_issues(issues, output);
+    return issues.empty();
+  }
+
+  entry->structure_hashes(_threads).write_duplicate_groups(output);
+  return true;
+}
+
+///////////////////////////////////////////
+
+std::string send_request(const std::string& socket_path, const std::string& request, IO::Writer& output)
+{
+  int fd = _connect(socket_path);
+  if (fd < 0)
+    throw std::runtime_error("no server listens on " + socket_path);
+
+  std::vector<char> frame;
+  try {
+    _send_all(fd, (request + '\n').data(), request.size() + 1);
+    unsigned char header[4];
+    // the output frames, then the empty one
+    while (true) {
+      if (!_recv_all(fd, reinterpret_cast<char*>(header), 4))
+        throw std::runtime_error("server closed the connection");
+      auto size = load_be32(header);
+      if (size == 0)
+        break;
+      frame.resize(size);
+      _recv_all(fd, frame.data(), size);
+      output.write(frame.data(), size);
+    }
+    if (!_recv_all(fd, reinterpret_cast<char*>(header), 4))
+      throw std::runtime_error("server closed the connection");
+    frame.resize(load_be32(header));
+    _recv_all(fd, frame.data(), frame.size());
+  } catch (const std::exception&) {
+    ::close(fd);
+    throw;
+  }
+  ::close(fd);
+  return std::string(frame.begin(), frame.end());
+}
+
+TEST_CASE("testing Server") {
+  std::string lines =
+    "HEADER:600\nBGNLIB:1 2 3 4 5 6 1 2 3 4 5 6\nLIBNAME:LIB\nUNITS:0.001 1e-09\n"
+    "BGNSTR:1 2 3 4 5 6 1 2 3 4 5 6\nSTRNAME:A\n"
+    "BOUNDARY\nLAYER:1\nDATATYPE:0\nXY:0 0 0 10 10 10 10 0 0 0\nENDEL\n"
+    "BOUNDARY\nLAYER:2\nDATATYPE:0\nXY:100 100 100 110 110 110 110 100 100 100\nENDEL\n"
+    "ENDSTR\nENDLIB\n";
+  std::vector<unsigned char> gds;
+  REQUIRE(encode_batch(lines.data(), lines.size(), gds).status == Status::ok);
+  TestDirectory directory;
+  auto path = directory.path("server.gds");
+  {
+    IO::Writer writer(path);
+    writer.write(reinterpret_cast<const char*>(gds.data()), gds.size());
+    writer.close();
+  }
+
+  auto socket_path = directory.path("server.sock");
+  Server server(socket_path, 2);
+  CHECK_THROWS_AS(Server(socket_path, 1), std::runtime_error);
+  std::thread serving([&server]() { server.serve(); });
+
+  auto ask = [&socket_path](const std::string& request, std::string& outcome) {
+    std::vector<char> text;
+    IO::Writer output(std::unique_ptr<IO::OutputSink>(new IO::VectorSink(text, 1 << 16)), 1 << 16, "reply");
+    outcome = send_request(socket_path, request, output);
+    output.close();
+    return std::string(text.begin(), text.end());
+  };
+  std::string outcome;
+  CHECK(ask("txt\t" + path, outcome) == lines);
+  CHECK(outcome == "ok");
+  CHECK(ask("bbox\t" + path, outcome) == "A 0 0 110 110\n");
+  CHECK(ask("window\t" + path + "\t-5,-5,5,5", outcome).find("XY:100 100") == std::string::npos);
+  CHECK(outcome == "ok");
+  CHECK(ask("validate\t" + path, outcome).empty());
+  CHECK(outcome == "ok");
+  ask("bbox\t" + path + ".missing", outcome);
+  CHECK(outcome == "error: Failed to open " + path + ".missing");
+  ask("convert\t" + path, outcome);
+  CHECK(outcome == "error: unknown command convert");
+
+  SUBCASE("an idle connection holds no pool worker") {
+    // more idle clients than workers, a request still gets through
+    std::vector<int> idle;
+    for (int i = 0; i < 4; ++i)
+      idle.push_back(_connect(socket_path));
+    CHECK(ask("validate\t" + path, outcome).empty());
+    CHECK(outcome == "ok");
+    for (auto fd : idle)
+      ::close(fd);
+  }
+
+  server.stop();
+  serving.join();
+}
+
+}
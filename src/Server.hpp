@@ -0,0 +1,73 @@
+#ifndef __SERVER__H__
+#define __SERVER__H__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ThreadPool.hpp"
+#include "Writer.hpp"
+
+namespace GDSTXT {
+
+// Long running gds2txt answering requests over a Unix domain socket. A
+// request is one line of tab separated fields: the command, the absolute
+// path of a gds and the command's argument if it takes one.
+//   txt         the library as plain text
+//   bbox        "name x_min y_min x_max y_max" per structure, as --bbox
+//   window      records intersecting the x1,y1,x2,y2 argument, plain text
+//   validate    the problems --validate reports
+//   duplicates  groups of identical structures, as --duplicates
+// A file stays mapped, and its spatial index and structure hashes stay
+// built after the first request that needs them, until its size, mtime
+// or inode changes or it is the least recently used of more than
+// max_entries files. The output streams back in frames of a 4 byte
+// big-endian length and that many bytes; an empty frame ends it and one
+// more frame holds the outcome: "ok", "fail" when a check found
+// something, or "error: " and the message.
+class Server {
+  public:
+    // replaces a socket file nobody listens on, throws if a server does
+    Server(const std::string& socket_path, unsigned threads = default_thread_count());
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+    ~Server();
+    static constexpr std::size_t max_entries = 64;
+    // answers connections until stop(), each one on a thread of its own
+    // that hands every request it reads to a pool worker, so idle clients
+    // hold no worker
+    void serve();
+    // async-signal-safe, serve() returns once open connections are done
+    void stop() noexcept;
+  private:
+    struct Entry;
+    std::shared_ptr<Entry> _entry(const std::string& path);
+    void _connection(int fd);
+    bool _answer(const std::vector<std::string>& fields, IO::Writer& output);
+
+    std::string _socket_path;
+    int _listen;
+    unsigned _threads;
+    std::atomic<bool> _stopping;
+    std::mutex _mutex;
+    std::unordered_map<std::string, std::shared_ptr<Entry>> _entries;
+    // _entry() calls so far, the clock for least recently used
+    uint64_t _uses;
+    std::set<int> _connections;
+    // signalled whenever a connection closes
+    std::condition_variable _closed;
+    ThreadPool _pool;
+};
+
+// sends request, the fields without newline, and writes the streamed
+// output to output; returns the outcome frame
+std::string send_request(const std::string& socket_path, const std::string& request, IO::Writer& output);
+
+}
+
+#endif //__SERVER__H__
@@ -0,0 +1,587 @@
+#include "SpatialIndex.hpp"
+#include "Aref.hpp"
+#include "Flatten.hpp"
+#include "MappedFile.hpp"
+#include "Writer.hpp"
+#include "test_config.h"
+#include "test_fixtures.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace GDSTXT {
+
+namespace {
+
+const char index_magic[8] = {'G', 'D', 'S', 'I', 'D', 'X', '1', '\0'};
+constexpr uint32_t index_version = 1;
+constexpr std::size_t fanout = 16;
+
+Box _union(const RTreeEntry* entries, std::size_t count)
+{
+  Box ret;
+  for (std::size_t i = 0; i < count; ++i)
+    ret.extend(entries[i].box);
+  return ret;
+}
+
+Box _union(const RTreeNode* nodes, std::size_t count)
+{
+  Box ret;
+  for (std::size_t i = 0; i < count; ++i)
+    ret.extend(nodes[i].box);
+  return ret;
+}
+
+// Sort-Tile-Recursive order: vertical slices by x center, each by y center
+template<typename T>
+void _tile(std::vector<T>& items)
+{
+  auto center_x = [](const T& item) { return int64_t(item.box.x_min) + item.box.x_max; };
+  auto center_y = [](const T& item) { return int64_t(item.box.y_min) + item.box.y_max; };
+  std::sort(items.begin(), items.end(),
+    [&center_x](const T& l, const T& r) { return center_x(l) < center_x(r); });
+  auto groups = (items.size() + fanout - 1) / fanout;
+  auto slices = static_cast<std::size_t>(std::ceil(std::sqrt(static_cast<double>(groups))));
+  auto slice_size = slices * fanout;
+  for (std::size_t i = 0; i < items.size(); i += slice_size) {
+    auto end = std::min(items.size(), i + slice_size);
+    std::sort(items.begin() + i, items.begin() + end,
+      [&center_y](const T& l, const T& r) { return center_y(l) < center_y(r); });
+  }
+}
+
+// entries are reordered, nodes get leaves first and the root last
+void _pack(std::vector<RTreeEntry>& entries, std::vector<RTreeNode>& nodes)
+{
+  if (entries.empty())
+    return;
+  _tile(entries);
+  std::vector<RTreeNode> level;
+  for (std::size_t i = 0; i < entries.size(); i += fanout) {
+    auto count = std::min(fanout, entries.size() - i);
+    level.push_back(RTreeNode {_union(&entries[i], count),
+      static_cast<uint32_t>(i), static_cast<uint32_t>(count), 1, 0});
+  }
+  while (level.size() > 1) {
+    _tile(level);
+    auto base = nodes.size();
+    nodes.insert(nodes.end(), level.begin(), level.end());
+    std::vector<RTreeNode> parents;
+    for (std::size_t i = 0; i < level.size(); i += fanout) {
+      auto count = std::min(fanout, level.size() - i);
+      parents.push_back(RTreeNode {_union(&level[i], count),
+        static_cast<uint32_t>(base + i), static_cast<uint32_t>(count), 0, 0});
+    }
+    level.swap(parents);
+  }
+  nodes.push_back(level[0]);
+}
+
+// what an element covers in its structure, TEXT and NODE by their points
+// so they can be picked by a window too
+Box _entry_box(const Element& element, const Library& library, const std::vector<Box>& boxes)
+{
+  switch (element.kind) {
+    case ElementKind::sref:
+    case ElementKind::aref:
+      return reference_box(element, boxes[library.index_of(element.sname)]);
+    case ElementKind::text:
+    case ElementKind::node:
+      return points_box(element.xy.data(), element.xy.size());
+    default:
+      return element_box(element);
+  }
+}
+
+bool _stat(const std::string& path, uint64_t& size, int64_t& mtime)
+{
+  struct stat info;
+  if (::stat(path.c_str(), &info) != 0)
+    return false;
+  size = static_cast<uint64_t>(info.st_size);
+  mtime = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+  return true;
+}
+
+}
+
+///////////////////////////////////////////
+
+void SpatialIndex::_add(const std::string& name, uint64_t begin, uint64_t end, const Box& box,
+                        std::vector<RTreeEntry>& entries)
+{
+  std::vector<RTreeNode> nodes;
+  _pack(entries, nodes);
+  _index.emplace(name, _cells.size());
+  _cells.push_back(Cell {name, begin, end, box,
+    _entries.size(), entries.size(), _nodes.size(), nodes.size()});
+  _entries.insert(_entries.end(), entries.begin(), entries.end());
+  _nodes.insert(_nodes.end(), nodes.begin(), nodes.end());
+}
+
+SpatialIndex SpatialIndex::build(const Library& library, unsigned threads)
+{
+  auto boxes = structure_boxes(library, threads);
+  std::vector<std::vector<RTreeEntry>> entries(library.structures.size());
+  parallel_for(entries.size(), threads, [&library, &boxes, &entries](std::size_t i) {
+    const auto& structure = library.structures[i];
+    for (std::size_t j = 0; j < structure.elements.size(); ++j) {
+      auto box = _entry_box(structure.elements[j], library, boxes);
+      if (!box.empty())
+        entries[i].push_back(RTreeEntry {box, structure.offsets[j]});
+    }
+  });
+
+  SpatialIndex ret;
+  for (std::size_t i = 0; i < entries.size(); ++i) {
+    const auto& structure = library.structures[i];
+    ret._add(structure.name, structure.begin, structure.end, boxes[i], entries[i]);
+  }
+  return ret;
+}
+
+std::string SpatialIndex::sidecar_path(const std::string& gds_path)
+{
+  return gds_path + ".gdsidx";
+}
+
+SpatialIndex SpatialIndex::open(const std::string& gds_path, const IO::ReaderOptions& options, unsigned threads)
+{
+  uint64_t size = 0;
+  int64_t mtime = 0;
+  if (!_stat(gds_path, size, mtime))
+    throw std::runtime_error("Failed to open " + gds_path);
+
+  SpatialIndex ret;
+  if (ret.load(sidecar_path(gds_path), size, mtime))
+    return ret;
+
+  IO::Reader reader(gds_path, IO::Reader::FileType::gds, options);
+  ret = build(Library::load(reader), threads);
+  try {
+    ret.save(sidecar_path(gds_path), size, mtime);
+  } catch (const std::exception&) {
+    // read-only directory, the index still serves this run
+  }
+  return ret;
+}
+
+void SpatialIndex::save(const std::string& path, uint64_t input_size, int64_t input_mtime) const
+{
+  std::string names;
+  std::vector<IndexStructure> structures;
+  for (const auto& cell : _cells) {
+    structures.push_back(IndexStructure {cell.begin, cell.end, cell.box,
+      names.size(), static_cast<uint32_t>(cell.name.size()), 0,
+      cell.first_entry, cell.entry_count, cell.first_node, cell.node_count});
+    names += cell.name;
+  }
+
+  IndexFileHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, index_magic, sizeof(index_magic));
+  header.version = index_version;
+  header.byte_order = IO::binary_byte_order;
+  header.input_size = input_size;
+  header.input_mtime = input_mtime;
+  header.structure_count = structures.size();
+  header.entry_count = _entries.size();
+  header.node_count = _nodes.size();
+  header.names_size = names.size();
+  header.structures_offset = sizeof(header);
+  header.entries_offset = header.structures_offset + structures.size() * sizeof(IndexStructure);
+  header.nodes_offset = header.entries_offset + _entries.size() * sizeof(RTreeEntry);
+  header.names_offset = header.nodes_offset + _nodes.size() * sizeof(RTreeNode);
+
+  // unique per process and thread like ConversionCache::store, so a run
+  // reading the sidecar never sees it half written
+  auto staging = path + "." + std::to_string(::getpid()) + "."
+    + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+  try {
+    // every section is a multiple of 8 bytes, no padding needed
+    IO::Writer writer(staging);
+    writer.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writer.write(reinterpret_cast<const char*>(structures.data()), structures.size() * sizeof(IndexStructure));
+    writer.write(reinterpret_cast<const char*>(_entries.data()), _entries.size() * sizeof(RTreeEntry));
+    writer.write(reinterpret_cast<const char*>(_nodes.data()), _nodes.size() * sizeof(RTreeNode));
+    writer.write(names);
+    writer.close();
+  } catch (const std::exception&) {
+    std::remove(staging.c_str());
+    throw;
+  }
+  if (std::rename(staging.c_str(), path.c_str()) != 0) {
+    std::remove(staging.c_str());
+    throw std::runtime_error("Failed to store " + path);
+  }
+}
+
+bool SpatialIndex::load(const std::string& path, uint64_t input_size, int64_t input_mtime)
+{
+  uint64_t size = 0;
+  int64_t mtime = 0;
+  if (!_stat(path, size, mtime) || size < sizeof(IndexFileHeader))
+    return false;
+
+  IO::MappedFile file(path);
+  IndexFileHeader header;
+  std::memcpy(&header, file.data(), sizeof(header));
+  if (std::memcmp(header.magic, index_magic, sizeof(index_magic)) != 0
+      || header.version != index_version || header.byte_order != IO::binary_byte_order
+      || header.input_size != input_size || header.input_mtime != input_mtime)
+    return false;
+  // counts are bounded before they are multiplied, nothing here can overflow
+  auto fits = [&file](uint64_t offset, uint64_t count, std::size_t width) {
+    return count <= file.size() / width && offset <= file.size() && count * width <= file.size() - offset;
+  };
+  if (!fits(header.structures_offset, header.structure_count, sizeof(IndexStructure))
+      || !fits(header.entries_offset, header.entry_count, sizeof(RTreeEntry))
+      || !fits(header.nodes_offset, header.node_count, sizeof(RTreeNode))
+      || !fits(header.names_offset, header.names_size, 1))
+    return false;
+
+  std::vector<IndexStructure> structures(header.structure_count);
+  std::memcpy(structures.data(), file.data() + header.structures_offset, structures.size() * sizeof(IndexStructure));
+  _entries.resize(header.entry_count);
+  std::memcpy(_entries.data(), file.data() + header.entries_offset, _entries.size() * sizeof(RTreeEntry));
+  _nodes.resize(header.node_count);
+  std::memcpy(_nodes.data(), file.data() + header.nodes_offset, _nodes.size() * sizeof(RTreeNode));
+  auto names = reinterpret_cast<const char*>(file.data() + header.names_offset);
+
+  _cells.clear();
+  _index.clear();
+  auto within = [](uint64_t first, uint64_t count, uint64_t size) {
+    return first <= size && count <= size - first;
+  };
+  for (const auto& structure : structures) {
+    if (!within(structure.name_offset, structure.name_size, header.names_size)
+        || !within(structure.first_entry, structure.entry_count, _entries.size())
+        || !within(structure.first_node, structure.node_count, _nodes.size()))
+      return false;
+    // query() follows children without checks: leaves have to stay in the
+    // structure's entries, inner nodes point at earlier nodes of the same
+    // structure, which also rules out cycles
+    for (uint64_t i = 0; i < structure.node_count; ++i) {
+      const auto& node = _nodes[structure.first_node + i];
+      if (node.leaf ? !within(node.first, node.count, structure.entry_count) : !within(node.first, node.count, i))
+        return false;
+    }
+    std::string name(names + structure.name_offset, structure.name_size);
+    _index.emplace(name, _cells.size());
+    _cells.push_back(Cell {name, structure.begin, structure.end, structure.box,
+      structure.first_entry, structure.entry_count, structure.first_node, structure.node_count});
+  }
+  return true;
+}
+
+std::size_t SpatialIndex::index_of(const std::string& name) const
+{
+  auto found = _index.find(name);
+  return found == _index.end() ? Library::npos : found->second;
+}
+
+void SpatialIndex::query(std::size_t cell, const Box& window, std::vector<uint64_t>& offsets) const
+{
+  offsets.clear();
+  const auto& info = _cells[cell];
+  if (info.node_count == 0)
+    return;
+  auto entries = _entries.data() + info.first_entry;
+  auto nodes = _nodes.data() + info.first_node;
+
+  std::vector<uint32_t> stack {static_cast<uint32_t>(info.node_count - 1)};
+  while (!stack.empty()) {
+    const auto& node = nodes[stack.back()];
+    stack.pop_back();
+    if (!node.box.intersects(window))
+      continue;
+    for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+      if (!node.leaf)
+        stack.push_back(i);
+      else if (entries[i].box.intersects(window))
+        offsets.push_back(entries[i].offset);
+    }
+  }
+  std::sort(offsets.begin(), offsets.end());
+}
+
+///////////////////////////////////////////
+
+bool parse_window(const std::string& text, Box& window)
+{
+  long long values[4];
+  char tail;
+  if (std::sscanf(text.c_str(), "%lld,%lld,%lld,%lld%c", &values[0], &values[1], &values[2], &values[3], &tail) != 4)
+    return false;
+  for (auto value : values) {
+    if (value < std::numeric_limits<int32_t>::min() || value > std::numeric_limits<int32_t>::max())
+      return false;
+  }
+  window = Box();
+  window.extend(Point {static_cast<int32_t>(values[0]), static_cast<int32_t>(values[1])});
+  window.extend(Point {static_cast<int32_t>(values[2]), static_cast<int32_t>(values[3])});
+  return true;
+}
+
+void decode_element(const unsigned char* data, std::size_t size, uint64_t offset, Element& element)
+{
+  class Capture: public ElementHandler {
+    public:
+      explicit Capture(Element& out): out(out), done(false) {}
+      void element(const Element& element) override { out = element; done = true; }
+      Element& out;
+      bool done;
+  } capture(element);
+
+  ElementDecoder decoder(capture);
+  IO::RecordCursor cursor(data, size, offset);
+  IO::RecordView record;
+  while (!capture.done && cursor.next(record))
+    decoder.feed(record);
+  if (!capture.done)
+    throw std::runtime_error("element at offset " + std::to_string(offset) + " is truncated");
+}
+
+WindowFlattener::WindowFlattener(const SpatialIndex& index, const unsigned char* data, std::size_t size)
+  : _index(index), _data(data), _size(size)
+{}
+
+const Element& WindowFlattener::_element(uint64_t offset)
+{
+  auto found = _decoded.find(offset);
+  if (found != _decoded.end())
+    return found->second;
+  auto& element = _decoded[offset];
+  decode_element(_data, _size, offset, element);
+  return element;
+}
+
+void WindowFlattener::flatten(const std::string& top, const Box& window, ElementHandler& handler)
+{
+  auto cell = _index.index_of(top);
+  if (cell == Library::npos)
+    throw std::runtime_error("structure " + top + " is not defined");
+  handler.begin_structure(top);
+  _cell(cell, Transform(), window, handler);
+  handler.end_structure();
+}
+
+void WindowFlattener::_cell(std::size_t cell, const Transform& transform, const Box& window, ElementHandler& handler)
+{
+  // window in cell coordinates, one unit wider for rounding
+  auto local = transform_box(window, transform.inverse());
+  local.x_min = local.x_min == std::numeric_limits<int32_t>::min() ? local.x_min : local.x_min - 1;
+  local.y_min = local.y_min == std::numeric_limits<int32_t>::min() ? local.y_min : local.y_min - 1;
+  local.x_max = local.x_max == std::numeric_limits<int32_t>::max() ? local.x_max : local.x_max + 1;
+  local.y_max = local.y_max == std::numeric_limits<int32_t>::max() ? local.y_max : local.y_max + 1;
+
+  std::vector<uint64_t> offsets;
+  _index.query(cell, local, offsets);
+  for (auto offset : offsets) {
+    const auto& element = _element(offset);
+    switch (element.kind) {
+      case ElementKind::boundary:
+      case ElementKind::path:
+      case ElementKind::box: {
+        transform_element(element, transform, _transformed);
+        if (element_box(_transformed).intersects(window))
+          handler.element(_transformed);
+        break;
+      }
+      case ElementKind::sref:
+      case ElementKind::aref: {
+        _instance(element, transform, window, handler);
+        break;
+      }
+      default:
+        break;
+    }
+  }
+}
+
+void WindowFlattener::_instance(const Element& reference, const Transform& transform, const Box& window,
+                                ElementHandler& handler)
+{
+  auto child = _index.index_of(reference.sname);
+  if (child == Library::npos)
+    throw std::runtime_error("structure " + reference.sname + " is referenced but not defined");
+  const auto& child_box = _index.cells()[child].box;
+  if (reference.kind == ElementKind::sref) {
+    _cell(child, transform * Transform::placement(reference, reference.xy[0]), window, handler);
+    return;
+  }
+
+  ArefLattice lattice(reference);
+  int32_t column_begin = 0, column_end = lattice.columns();
+  int32_t row_begin = 0, row_end = lattice.rows();
+
+  // origins whose instance can reach the window, mapped back to lattice
+  // indices; skipped for degenerate lattices, every instance is tested
+  auto local = transform_box(window, transform.inverse());
+  auto placed = transform_box(child_box, Transform::placement(reference, Point {0, 0}));
+  auto origin = lattice.origin(0, 0);
+  double ux = lattice.columns() > 1 ? lattice.origin(1, 0).x - origin.x : 0;
+  double uy = lattice.columns() > 1 ? lattice.origin(1, 0).y - origin.y : 0;
+  double vx = lattice.rows() > 1 ? lattice.origin(0, 1).x - origin.x : 0;
+  double vy = lattice.rows() > 1 ? lattice.origin(0, 1).y - origin.y : 0;
+  auto det = ux * vy - uy * vx;
+  if (!local.empty() && !placed.empty() && det != 0.0) {
+    double low_x = double(local.x_min) - placed.x_max - origin.x;
+    double high_x = double(local.x_max) - placed.x_min - origin.x;
+    double low_y = double(local.y_min) - placed.y_max - origin.y;
+    double high_y = double(local.y_max) - placed.y_min - origin.y;
+    double column_low = 1e300, column_high = -1e300, row_low = 1e300, row_high = -1e300;
+    for (auto x : {low_x, high_x}) {
+      for (auto y : {low_y, high_y}) {
+        auto column = (x * vy - y * vx) / det;
+        auto row = (ux * y - uy * x) / det;
+        column_low = std::min(column_low, column);
+        column_high = std::max(column_high, column);
+        row_low = std::min(row_low, row);
+        row_high = std::max(row_high, row);
+      }
+    }
+    auto clamp = [](double value, int32_t limit) {
+      return static_cast<int32_t>(std::max(0.0, std::min(static_cast<double>(limit), value)));
+    };
+    column_begin = clamp(std::floor(column_low) - 1, lattice.columns());
+    column_end = clamp(std::ceil(column_high) + 2, lattice.columns());
+    row_begin = clamp(std::floor(row_low) - 1, lattice.rows());
+    row_end = clamp(std::ceil(row_high) + 2, lattice.rows());
+  }
+
+  for (auto row = row_begin; row < row_end; ++row) {
+    for (auto column = column_begin; column < column_end; ++column) {
+      auto instance = transform * Transform::placement(reference, lattice.origin(column, row));
+      if (transform_box(child_box, instance).intersects(window))
+        _cell(child, instance, window, handler);
+    }
+  }
+}
+
+TEST_CASE("testing SpatialIndex window queries") {
+  // A: one 10x10 square; TOP: a 100x100 AREF of A at pitch 20 plus a
+  // square of its own far away
+  std::vector<unsigned char> gds;
+  auto square = [&gds](int64_t x, int64_t y) {
+    test_record(gds, SPEC::Tag::BOUNDARY, SPEC::TagDataType::NODATA);
+    test_record(gds, SPEC::Tag::LAYER, SPEC::TagDataType::INTEGER_2, {1});
+    test_record(gds, SPEC::Tag::DATATYPE, SPEC::TagDataType::INTEGER_2, {0});
+    test_record(gds, SPEC::Tag::XY, SPEC::TagDataType::INTEGER_4,
+                {x, y, x, y + 10, x + 10, y + 10, x + 10, y, x, y});
+    test_record(gds, SPEC::Tag::ENDEL, SPEC::TagDataType::NODATA);
+  };
+  std::vector<int64_t> date(12, 1);
+  test_record(gds, SPEC::Tag::HEADER, SPEC::TagDataType::INTEGER_2, {600});
+  test_record(gds, SPEC::Tag::BGNSTR, SPEC::TagDataType::INTEGER_2, date);
+  test_name(gds, SPEC::Tag::STRNAME, "A");
+  square(0, 0);
+  test_record(gds, SPEC::Tag::ENDSTR, SPEC::TagDataType::NODATA);
+  test_record(gds, SPEC::Tag::BGNSTR, SPEC::TagDataType::INTEGER_2, date);
+  test_name(gds, SPEC::Tag::STRNAME, "TOP");
+  test_record(gds, SPEC::Tag::AREF, SPEC::TagDataType::NODATA);
+  test_name(gds, SPEC::Tag::SNAME, "A");
+  test_record(gds, SPEC::Tag::COLROW, SPEC::TagDataType::INTEGER_2, {100, 100});
+  test_record(gds, SPEC::Tag::XY, SPEC::TagDataType::INTEGER_4, {0, 0, 2000, 0, 0, 2000});
+  test_record(gds, SPEC::Tag::ENDEL, SPEC::TagDataType::NODATA);
+  square(50000, 50000);
+  test_record(gds, SPEC::Tag::ENDSTR, SPEC::TagDataType::NODATA);
+  test_record(gds, SPEC::Tag::ENDLIB, SPEC::TagDataType::NODATA);
+
+  TestDirectory directory;
+  auto path = directory.path("index.gds");
+  {
+    IO::Writer writer(path);
+    writer.write(reinterpret_cast<const char*>(gds.data()), gds.size());
+    writer.close();
+  }
+  IO::Reader reader(path, IO::Reader::FileType::gds);
+  auto index = SpatialIndex::build(Library::load(reader), 2);
+
+  class Collector: public ElementHandler {
+    public:
+      void element(const Element& element) override { elements.push_back(element); }
+      std::vector<Element> elements;
+  };
+
+  SUBCASE("flattened window reaches only the instances it covers") {
+    Collector out;
+    WindowFlattener(index, gds.data(), gds.size()).flatten("TOP", Box {25, 25, 45, 45}, out);
+    REQUIRE(out.elements.size() == 4);
+    CHECK(out.elements[0].xy[0].x == 20);
+    CHECK(out.elements[3].xy[0].y == 40);
+  }
+  SUBCASE("local window keeps the AREF and drops the far square") {
+    std::vector<uint64_t> offsets;
+    index.query(index.index_of("TOP"), Box {0, 0, 5, 5}, offsets);
+    CHECK(offsets.size() == 1);
+    index.query(index.index_of("TOP"), Box {49000, 49000, 60000, 60000}, offsets);
+    CHECK(offsets.size() == 1);
+  }
+  SUBCASE("saved index loads back for the same input only") {
+    index.save(path + ".gdsidx", gds.size(), 7);
+    SpatialIndex loaded;
+    CHECK_FALSE(loaded.load(path + ".gdsidx", gds.size(), 8));
+    REQUIRE(loaded.load(path + ".gdsidx", gds.size(), 7));
+    std::vector<uint64_t> offsets;
+    loaded.query(loaded.index_of("TOP"), Box {0, 0, 5, 5}, offsets);
+    CHECK(offsets.size() == 1);
+    CHECK(loaded.cells()[1].box.x_max == 50010);
+  }
+  SUBCASE("damaged index with a current stamp is rebuilt") {
+    index.save(path + ".gdsidx", gds.size(), 7);
+    std::vector<unsigned char> image;
+    {
+      IO::MappedFile file(path + ".gdsidx");
+      image.assign(file.data(), file.data() + file.size());
+    }
+    IndexFileHeader header;
+    std::memcpy(&header, image.data(), sizeof(header));
+    auto loads = [&](std::size_t offset, uint64_t value, std::size_t width) {
+      auto damaged = image;
+      std::memcpy(damaged.data() + offset, &value, width);
+      IO::Writer writer(path + ".gdsidx");
+      writer.write(reinterpret_cast<const char*>(damaged.data()), damaged.size());
+      writer.close();
+      SpatialIndex loaded;
+      return loaded.load(path + ".gdsidx", gds.size(), 7);
+    };
+    auto structure = [&header](std::size_t i) { return header.structures_offset + i * sizeof(IndexStructure); };
+    auto node = [&header](std::size_t i) { return header.nodes_offset + i * sizeof(RTreeNode); };
+    // the untouched image
+    CHECK(loads(0, 0, 0));
+    // counts that would wrap once multiplied by the element size
+    CHECK_FALSE(loads(offsetof(IndexFileHeader, node_count), (UINT64_MAX / sizeof(RTreeNode)) + 2, 8));
+    CHECK_FALSE(loads(offsetof(IndexFileHeader, entries_offset), UINT64_MAX - 8, 8));
+    CHECK_FALSE(loads(structure(1) + offsetof(IndexStructure, first_entry), UINT64_MAX, 8));
+    // TOP's root is the last node, its children have to stay inside TOP
+    auto root = header.node_count - 1;
+    CHECK_FALSE(loads(node(root) + offsetof(RTreeNode, count), 1000, 4));
+    CHECK_FALSE(loads(node(root) + offsetof(RTreeNode, first), 0xfffffff0, 4));
+    CHECK_FALSE(loads(node(root) + offsetof(RTreeNode, leaf), 0, 4));
+  }
+}
+
+TEST_CASE("testing parse_window") {
+  Box window;
+  REQUIRE(parse_window("10,-20,-30,40", window));
+  CHECK(window.x_min == -30);
+  CHECK(window.y_min == -20);
+  CHECK(window.x_max == 10);
+  CHECK(window.y_max == 40);
+  CHECK(parse_window("-2147483648,0,2147483647,1", window));
+  CHECK_FALSE(parse_window("0,0,4294967296,1000", window));
+  CHECK_FALSE(parse_window("0,-2147483649,1,1", window));
+  CHECK_FALSE(parse_window("0,0,1", window));
+  CHECK_FALSE(parse_window("0,0,1,1,", window));
+}
+
+}
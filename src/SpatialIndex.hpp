@@ -0,0 +1,184 @@
+#ifndef __SPATIAL__INDEX__H__
+#define __SPATIAL__INDEX__H__
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include "BoundingBox.hpp"
+#include "Library.hpp"
+#include "Reader.hpp"
+
+// Structure index with one packed R-tree per structure, kept next to the
+// gds file as "<gds>.gdsidx", native byte order:
+//
+//   IndexFileHeader   96 bytes
+//   structures        IndexStructure [structure_count]
+//   entries           RTreeEntry [entry_count], every tree's leaves
+//   nodes             RTreeNode [node_count]
+//   names             char [names_size], structure names back to back
+//
+// a structure owns a contiguous range of entries and of nodes, node
+// children are relative to those ranges and its root is its last node.
+// Entries hold an element's box in structure coordinates (SREF/AREF: all
+// placed instances) and the file offset of its first record. The input
+// size and mtime in the header tell whether the index is still current.
+
+namespace GDSTXT {
+
+struct IndexFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t input_size;
+  int64_t input_mtime;
+  uint64_t structure_count;
+  uint64_t entry_count;
+  uint64_t node_count;
+  uint64_t names_size;
+  uint64_t structures_offset;
+  uint64_t entries_offset;
+  uint64_t nodes_offset;
+  uint64_t names_offset;
+};
+
+static_assert(sizeof(IndexFileHeader) == 96, "index file header must stay 96 bytes");
+
+struct IndexStructure {
+  uint64_t begin;
+  uint64_t end;
+  Box box;
+  uint64_t name_offset;
+  uint32_t name_size;
+  uint32_t reserved;
+  uint64_t first_entry;
+  uint64_t entry_count;
+  uint64_t first_node;
+  uint64_t node_count;
+};
+
+static_assert(sizeof(IndexStructure) == 80, "index structure must stay 80 bytes");
+
+struct RTreeEntry {
+  Box box;
+  uint64_t offset;
+};
+
+struct RTreeNode {
+  Box box;
+  uint32_t first;
+  uint32_t count;
+  uint32_t leaf;
+  uint32_t reserved;
+};
+
+class SpatialIndex {
+  public:
+    struct Cell {
+      std::string name;
+      // BGNSTR and the byte after ENDSTR
+      uint64_t begin;
+      uint64_t end;
+      // whole hierarchy below the structure
+      Box box;
+      uint64_t first_entry;
+      uint64_t entry_count;
+      uint64_t first_node;
+      uint64_t node_count;
+    };
+
+    // every structure's elements bulk-loaded with Sort-Tile-Recursive
+    static SpatialIndex build(const Library& library, unsigned threads = default_thread_count());
+    // the sidecar of gds_path when it matches the file, otherwise a fresh
+    // build that is saved for next time if the directory is writable
+    static SpatialIndex open(const std::string& gds_path, const IO::ReaderOptions& options,
+                             unsigned threads = default_thread_count());
+    static std::string sidecar_path(const std::string& gds_path);
+
+    void save(const std::string& path, uint64_t input_size, int64_t input_mtime) const;
+    // false when the file is missing, malformed or made for another input
+    bool load(const std::string& path, uint64_t input_size, int64_t input_mtime);
+
+    std::size_t index_of(const std::string& name) const;
+    const std::vector<Cell>& cells() const noexcept { return _cells; }
+    // offsets of the cell's elements whose box intersects window, in file order
+    void query(std::size_t cell, const Box& window, std::vector<uint64_t>& offsets) const;
+  private:
+    void _add(const std::string& name, uint64_t begin, uint64_t end, const Box& box,
+              std::vector<RTreeEntry>& entries);
+
+    std::vector<Cell> _cells;
+    std::vector<RTreeEntry> _entries;
+    std::vector<RTreeNode> _nodes;
+    std::unordered_map<std::string, std::size_t> _index;
+};
+
+// the single element starting at offset of a gds image
+void decode_element(const unsigned char* data, std::size_t size, uint64_t offset, Element& element);
+
+// BOUNDARY/PATH/BOX of top's flattened hierarchy whose transformed box
+// intersects window, only the subtrees and AREF instances the window
+// reaches are decoded
+class WindowFlattener {
+  public:
+    WindowFlattener(const SpatialIndex& index, const unsigned char* data, std::size_t size);
+    void flatten(const std::string& top, const Box& window, ElementHandler& handler);
+  private:
+    void _cell(std::size_t cell, const Transform& transform, const Box& window, ElementHandler& handler);
+    void _instance(const Element& reference, const Transform& transform, const Box& window, ElementHandler& handler);
+    const Element& _element(uint64_t offset);
+
+    const SpatialIndex& _index;
+    const unsigned char* _data;
+    std::size_t _size;
+    // instances of one cell reuse its decoded hits
+    std::unordered_map<uint64_t, Element> _decoded;
+    Element _transformed;
+};
+
+// "x1,y1,x2,y2" into window, false unless all four fit in int32
+bool parse_window(const std::string& text, Box& window);
+
+// sink(record) for the header records, then for each structure its
+// BGNSTR, STRNAME, the records of elements intersecting window (in that
+// structure's own coordinates) and ENDSTR, then ENDLIB
+template<typename F>
+void for_each_window_record(const SpatialIndex& index, const unsigned char* data, std::size_t size,
+                            const Box& window, F&& sink)
+{
+  auto tag_of = [](const IO::RecordView& record) { return static_cast<SPEC::Tag>(record.tag); };
+  IO::RecordView record;
+  IO::RecordCursor header(data, size);
+  while (header.next(record) && tag_of(record) != SPEC::Tag::BGNSTR) {
+    if (tag_of(record) != SPEC::Tag::ENDLIB)
+      sink(record);
+  }
+
+  std::vector<uint64_t> offsets;
+  for (std::size_t i = 0; i < index.cells().size(); ++i) {
+    const auto& cell = index.cells()[i];
+    IO::RecordCursor head(data, size, cell.begin);
+    while (head.next(record)) {
+      sink(record);
+      if (tag_of(record) == SPEC::Tag::STRNAME)
+        break;
+    }
+    index.query(i, window, offsets);
+    for (auto offset : offsets) {
+      IO::RecordCursor body(data, size, offset);
+      while (body.next(record)) {
+        sink(record);
+        if (tag_of(record) == SPEC::Tag::ENDEL)
+          break;
+      }
+    }
+    record = IO::RecordView {static_cast<unsigned char>(SPEC::Tag::ENDSTR), 0, nullptr, 0};
+    sink(record);
+  }
+  record = IO::RecordView {static_cast<unsigned char>(SPEC::Tag::ENDLIB), 0, nullptr, 0};
+  sink(record);
+}
+
+}
+
+#endif //__SPATIAL__INDEX__H__
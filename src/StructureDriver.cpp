@@ -0,0 +1,205 @@
+#include "StructureDriver.hpp"
+#include "Codec.hpp"
+#include "Numa.hpp"
+#include "test_config.h"
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+#include <stdexcept>
+
+namespace GDSTXT {
+
+void StructureDriver::Arena::element(const Element& element)
+{
+  // assigned over the last structure's elements, their buffers are reused
+  if (used == elements.size())
+    elements.push_back(element);
+  else
+    elements[used] = element;
+  ++used;
+}
+
+StructureDriver::StructureDriver(const unsigned char* data, std::size_t size, ThreadPool& pool)
+  : _data(data), _size(size), _pool(pool), _workers(pool.size())
+{
+  if (_pool.pinned()) {
+    for (unsigned i = 0; i < _pool.size(); ++i) {
+      _pool.submit(i, [this](unsigned worker) {
+        auto begin = _size * worker / _pool.size();
+        auto end = _size * (worker + 1) / _pool.size();
+        touch_pages(_data + begin, end - begin);
+      });
+    }
+    _pool.wait();
+  }
+  _spans = scan_structures(data, size);
+}
+
+unsigned StructureDriver::_owner(uint64_t offset) const noexcept
+{
+  return static_cast<unsigned>(offset * _pool.size() / std::max<std::size_t>(_size, 1));
+}
+
+void StructureDriver::run(const Visit& visit)
+{
+  std::vector<uint64_t> sizes;
+  for (const auto& span : _spans)
+    sizes.push_back(span.end - span.begin);
+  std::function<unsigned(std::size_t)> owner;
+  if (_pool.pinned())
+    owner = [this](std::size_t i) { return _owner(_spans[i].begin); };
+  _pool.submit_largest_first(sizes, [this, &visit](std::size_t i) -> ThreadPool::Task {
+    return [this, &visit, i](unsigned worker) {
+      // each slot is only ever touched by its own worker
+      if (!_workers[worker])
+        _workers[worker].reset(new Worker());
+      auto& state = *_workers[worker];
+      state.arena.used = 0;
+      const auto& span = _spans[i];
+      IO::RecordCursor cursor(_data, static_cast<std::size_t>(span.end), span.begin);
+      IO::RecordView record;
+      while (cursor.next(record))
+        state.decoder.feed(record);
+      visit(i, state.arena.elements.data(), state.arena.used);
+    };
+  }, owner);
+  _pool.wait();
+}
+
+LayerFilter parse_layer_filter(const std::string& text)
+{
+  LayerFilter ret;
+  std::istringstream list(text);
+  std::string item;
+  while (std::getline(list, item, ',')) {
+    int layer = 0;
+    int datatype = -1;
+    char tail = 0;
+    auto fields = std::sscanf(item.c_str(), "%d/%d%c", &layer, &datatype, &tail);
+    if (fields == 1 && item.find('/') != std::string::npos)
+      fields = 0;
+    if ((fields != 1 && fields != 2) || layer < 0 || layer > 32767 || datatype < -1 || datatype > 32767)
+      throw std::runtime_error("Invalid layer filter " + item + ", expected LAYER or LAYER/DATATYPE");
+    ret.emplace_back(static_cast<int16_t>(layer), static_cast<int16_t>(datatype));
+  }
+  if (ret.empty())
+    throw std::runtime_error("Empty layer filter");
+  return ret;
+}
+
+namespace {
+
+bool _kept(const Element& element, const LayerFilter& filter) noexcept
+{
+  if (filter.empty() || element.kind == ElementKind::sref || element.kind == ElementKind::aref)
+    return true;
+  for (const auto& layer : filter) {
+    if (layer.first == element.layer && (layer.second < 0 || layer.second == element.datatype))
+      return true;
+  }
+  return false;
+}
+
+}
+
+std::vector<StructureStats> structure_stats(StructureDriver& driver, const LayerFilter& filter)
+{
+  const auto& spans = driver.spans();
+  std::vector<StructureStats> ret(spans.size());
+  driver.run([&](std::size_t structure, const Element* elements, std::size_t count) {
+    auto& stats = ret[structure];
+    for (std::size_t i = 0; i < count; ++i) {
+      const auto& element = elements[i];
+      if (!_kept(element, filter))
+        continue;
+      ++stats.kinds[static_cast<std::size_t>(element.kind)];
+      stats.points += element.xy.size();
+      stats.box.extend(element_box(element));
+    }
+    const auto& span = spans[structure];
+    stats.hash = hash64(driver.data() + span.body, static_cast<std::size_t>(span.end - span.body));
+  });
+  return ret;
+}
+
+void write_stats(const std::vector<StructureSpan>& spans, const std::vector<StructureStats>& stats,
+                 IO::Writer& out)
+{
+  char line[128];
+  for (std::size_t i = 0; i < spans.size(); ++i) {
+    const auto& cell = stats[i];
+    out.write(spans[i].name);
+    for (auto count : cell.kinds) {
+      out.write(" ");
+      out.write_int(static_cast<int64_t>(count));
+    }
+    out.write(" ");
+    out.write_int(static_cast<int64_t>(cell.points));
+    if (cell.box.empty())
+      out.write(" empty");
+    else {
+      auto size = std::snprintf(line, sizeof(line), " %d %d %d %d", cell.box.x_min, cell.box.y_min,
+                                cell.box.x_max, cell.box.y_max);
+      out.write(line, static_cast<std::size_t>(size));
+    }
+    auto size = std::snprintf(line, sizeof(line), " %016llx\n", static_cast<unsigned long long>(cell.hash));
+    out.write(line, static_cast<std::size_t>(size));
+  }
+}
+
+TEST_CASE("testing StructureDriver") {
+  std::string lines = "HEADER:600\nBGNLIB:1 2 3 4 5 6 1 2 3 4 5 6\nLIBNAME:LIB\nUNITS:0.001 1e-09\n"
+    "BGNSTR:1 2 3 4 5 6 1 2 3 4 5 6\nSTRNAME:A\n"
+    "BOUNDARY\nLAYER:1\nDATATYPE:0\nXY:0 0 0 10 10 10 10 0 0 0\nENDEL\n"
+    "BOUNDARY\nLAYER:2\nDATATYPE:3\nXY:-5 -5 -5 1 1 1 1 -5 -5 -5\nENDEL\n"
+    "TEXT\nLAYER:1\nTEXTTYPE:0\nXY:3 3\nSTRING:pin\nENDEL\nENDSTR\n"
+    "BGNSTR:1 2 3 4 5 6 1 2 3 4 5 6\nSTRNAME:B\nSREF\nSNAME:A\nXY:100 100\nENDEL\nENDSTR\n"
+    "BGNSTR:6 5 4 3 2 1 6 5 4 3 2 1\nSTRNAME:C\n"
+    "BOUNDARY\nLAYER:1\nDATATYPE:0\nXY:0 0 0 10 10 10 10 0 0 0\nENDEL\n"
+    "BOUNDARY\nLAYER:2\nDATATYPE:3\nXY:-5 -5 -5 1 1 1 1 -5 -5 -5\nENDEL\n"
+    "TEXT\nLAYER:1\nTEXTTYPE:0\nXY:3 3\nSTRING:pin\nENDEL\nENDSTR\nENDLIB\n";
+  std::vector<unsigned char> gds;
+  REQUIRE(encode_batch(lines.data(), lines.size(), gds).status == Status::ok);
+
+  ThreadPool pool(2);
+  StructureDriver driver(gds.data(), gds.size(), pool);
+  REQUIRE(driver.spans().size() == 3);
+  auto stats = structure_stats(driver);
+  CHECK(stats[0].kinds[static_cast<std::size_t>(ElementKind::boundary)] == 2);
+  CHECK(stats[0].kinds[static_cast<std::size_t>(ElementKind::text)] == 1);
+  CHECK(stats[0].points == 11);
+  CHECK(stats[0].box.x_min == -5);
+  CHECK(stats[0].box.x_max == 10);
+  CHECK(stats[1].kinds[static_cast<std::size_t>(ElementKind::sref)] == 1);
+  CHECK(stats[1].box.empty());
+  // same body under other dates and name
+  CHECK(stats[0].hash == stats[2].hash);
+  CHECK(stats[0].hash != stats[1].hash);
+
+  // a second run reuses the arenas of the first
+  auto layer1 = structure_stats(driver, parse_layer_filter("1"));
+  CHECK(layer1[0].kinds[static_cast<std::size_t>(ElementKind::boundary)] == 1);
+  CHECK(layer1[0].kinds[static_cast<std::size_t>(ElementKind::text)] == 1);
+  CHECK(layer1[0].box.x_min == 0);
+  CHECK(layer1[1].kinds[static_cast<std::size_t>(ElementKind::sref)] == 1);
+  auto exact = structure_stats(driver, parse_layer_filter("1/5,2/3"));
+  CHECK(exact[2].kinds[static_cast<std::size_t>(ElementKind::boundary)] == 1);
+  CHECK(exact[2].kinds[static_cast<std::size_t>(ElementKind::text)] == 0);
+  CHECK_THROWS_AS(parse_layer_filter("1/"), std::runtime_error);
+  CHECK_THROWS_AS(parse_layer_filter("x"), std::runtime_error);
+  CHECK_THROWS_AS(parse_layer_filter(""), std::runtime_error);
+
+  std::vector<char> text;
+  IO::Writer out(std::unique_ptr<IO::OutputSink>(new IO::VectorSink(text, 1 << 16)), 1 << 16, "stats");
+  write_stats(driver.spans(), stats, out);
+  out.close();
+  std::istringstream report(std::string(text.begin(), text.end()));
+  std::string first;
+  std::getline(report, first);
+  CHECK(first.substr(0, first.rfind(' ')) == "A 2 0 0 0 1 0 0 11 -5 -5 10 10");
+  std::string second;
+  std::getline(report, second);
+  CHECK(second.substr(0, second.rfind(' ')) == "B 0 0 1 0 0 0 0 1 empty");
+}
+
+}
@@ -0,0 +1,93 @@
+#ifndef __STRUCTURE__DRIVER__H__
+#define __STRUCTURE__DRIVER__H__
+
+#include <array>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <cstdint>
+#include "BoundingBox.hpp"
+#include "Element.hpp"
+#include "Hash.hpp"
+#include "ThreadPool.hpp"
+#include "Writer.hpp"
+
+namespace GDSTXT {
+
+// Whole structures of a gds image decoded in parallel. scan_structures
+// finds every BGNSTR ... ENDSTR, structures are queued on the pool so
+// every worker starts on the largest of its own and steals the small
+// ones left at the end, and each worker decodes into an arena of
+// elements it keeps from one structure to the next, xy and string
+// capacity included. An analysis sees one structure's elements at a
+// time and writes into that structure's slot of its result, so nothing
+// is shared between workers.
+//
+// On a pool pinned to NUMA nodes every worker first faults in its own
+// contiguous share of the image, before the scan reads it, and decodes
+// the structures starting in that share; arenas are allocated by the
+// worker using them. Input pages and element buffers then stay on the
+// node that works on them, only stolen structures cross over.
+class StructureDriver {
+  public:
+    // elements [0, count) stay valid during the call
+    using Visit = std::function<void(std::size_t structure, const Element* elements, std::size_t count)>;
+
+    StructureDriver(const unsigned char* data, std::size_t size, ThreadPool& pool);
+    const std::vector<StructureSpan>& spans() const noexcept { return _spans; }
+    const unsigned char* data() const noexcept { return _data; }
+    // visit for every structure, rethrows the first exception one threw
+    void run(const Visit& visit);
+  private:
+    class Arena: public ElementHandler {
+      public:
+        void element(const Element& element) override;
+        std::vector<Element> elements;
+        std::size_t used = 0;
+    };
+    struct Worker {
+      Worker() : decoder(arena) {}
+      Arena arena;
+      ElementDecoder decoder;
+    };
+
+    // worker whose share of the image holds offset
+    unsigned _owner(uint64_t offset) const noexcept;
+
+    const unsigned char* _data;
+    std::size_t _size;
+    ThreadPool& _pool;
+    std::vector<StructureSpan> _spans;
+    std::vector<std::unique_ptr<Worker>> _workers;
+};
+
+// layer and datatype pairs an analysis keeps, datatype -1 for all of a layer
+using LayerFilter = std::vector<std::pair<int16_t, int16_t>>;
+
+// "5,7/2" as {5, -1}, {7, 2}
+LayerFilter parse_layer_filter(const std::string& text);
+
+struct StructureStats {
+  // elements per ElementKind
+  std::array<uint64_t, 7> kinds {};
+  uint64_t points = 0;
+  // own BOUNDARY/BOX/PATH extent, references not followed
+  Box box;
+  // XXH64 of the records after STRNAME
+  uint64_t hash = 0;
+};
+
+// per structure in file order; with a filter only elements on its layers
+// count, references always do, the hash always covers the whole body
+std::vector<StructureStats> structure_stats(StructureDriver& driver, const LayerFilter& filter = LayerFilter());
+
+// "name boundary path sref aref text node box points x_min y_min x_max
+// y_max hash" per structure, "empty" in place of the box without geometry
+void write_stats(const std::vector<StructureSpan>& spans, const std::vector<StructureStats>& stats,
+                 IO::Writer& out);
+
+}
+
+#endif //__STRUCTURE__DRIVER__H__
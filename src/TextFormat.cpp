@@ -0,0 +1,199 @@
+#include "TextFormat.hpp"
+#include "SPEC.hpp"
+#include "convert_func.hpp"
+#include "test_config.h"
+#include "test_fixtures.h"
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+namespace GDSTXT {
+
+TEST_CASE("testing format_int and format_real") {
+  char buf[max_number_width];
+  CHECK(std::string(buf, format_int(buf, 0)) == "0");
+  CHECK(std::string(buf, format_int(buf, -2147483648LL)) == "-2147483648");
+  CHECK(std::string(buf, format_int(buf, 65535)) == "65535");
+  SUBCASE("format_real should match ostream << double") {
+    for (double value : {1.0, 0.001, 1e-9, -2.5, 123456789.0}) {
+      std::ostringstream os;
+      os << value;
+      CHECK(std::string(buf, format_real(buf, value)) == os.str());
+    }
+  }
+}
+
+///////////////////////////////////////////
+
+void write_record_text(const IO::RecordView& record, IO::Writer& out)
+{
+  auto codec = record_codec(record.tag, record.data_type, record.size);
+  if (!codec)
+    throw std::runtime_error(std::string(status_message(codec.status())) + " in record with tag "
+                             + std::to_string(record.tag));
+  auto bound = codec.value().text_bound(record.size) + 1;
+  if (bound > out.max_reserve()) {
+    std::vector<char> text(bound);
+    auto last = codec.value().write_text(record.body, record.size, text.data());
+    *last++ = '\n';
+    out.write(text.data(), last - text.data());
+    return;
+  }
+  auto first = out.reserve(bound);
+  auto last = codec.value().write_text(record.body, record.size, first);
+  *last++ = '\n';
+  out.commit(last - first);
+}
+
+void write_record_piece(const IO::RecordPiece& piece, RecordTextStream& stream, IO::Writer& out)
+{
+  // most records arrive whole
+  if (piece.first && piece.last) {
+    write_record_text(IO::RecordView {piece.tag, piece.data_type, piece.body, piece.size}, out);
+    return;
+  }
+  if (piece.first) {
+    auto status = stream.begin(piece.tag, piece.data_type, piece.record_size);
+    if (status != Status::ok)
+      throw std::runtime_error(std::string(status_message(status)) + " in record with tag "
+                               + std::to_string(piece.tag));
+  }
+  // a slice formats to at most half the room reserve() promises, 8 bytes hold
+  // a value of any width
+  auto slice = std::max<std::size_t>(out.max_reserve() / 2 / (max_number_width + 1), 8);
+  for (std::size_t done = 0; done < piece.size; done += slice) {
+    auto count = std::min(slice, piece.size - done);
+    auto first = out.reserve(stream.feed_bound(count));
+    out.commit(stream.feed(piece.body + done, count, first) - first);
+  }
+  if (!piece.last)
+    return;
+  auto bound = stream.end_bound();
+  if (bound > out.max_reserve()) {
+    std::vector<char> text(bound);
+    out.write(text.data(), stream.end(text.data()) - text.data());
+    return;
+  }
+  auto first = out.reserve(bound);
+  out.commit(stream.end(first) - first);
+}
+
+TEST_CASE("testing write_record_piece") {
+  // a full 8191 point XY that straddles the end of the 64KB read buffer,
+  // so it arrives as two pieces
+  std::vector<unsigned char> gds {0, 6, 0x0d, 0x02, 0, 1, 0xff, 0xfc, 0x10, 0x03};
+  for (int32_t i = 0; i < 8191 * 2; ++i) {
+    unsigned char value[4];
+    store_be32(value, static_cast<uint32_t>(i * 1000 - 7));
+    gds.insert(gds.end(), value, value + 4);
+  }
+  gds.insert(gds.end(), {0, 4, 0x11, 0x00});
+  TestDirectory directory;
+  auto path = directory.path("piece.gds");
+  {
+    IO::Writer file(path);
+    file.write(reinterpret_cast<const char*>(gds.data()), gds.size());
+    file.close();
+  }
+
+  auto text = [&path](bool pieces) {
+    IO::ReaderOptions reader_options;
+    reader_options.block_size = 1 << 16;
+    IO::Reader reader(path, IO::Reader::FileType::gds, reader_options);
+    // an XY line is longer than the writer's buffer
+    std::vector<char> text;
+    {
+      IO::Writer out(std::unique_ptr<IO::OutputSink>(new IO::VectorSink(text, 8192)), 8192, "text");
+      if (pieces) {
+        IO::RecordPiece piece;
+        RecordTextStream stream;
+        std::size_t count = 0;
+        while (reader.readPiece(piece)) {
+          write_record_piece(piece, stream, out);
+          ++count;
+        }
+        CHECK(count == 4);
+      } else {
+        IO::RecordView record;
+        while (reader.readRecord(record))
+          write_record_text(record, out);
+      }
+      out.close();
+    }
+    return std::string(text.begin(), text.end());
+  };
+  auto whole = text(false);
+  CHECK(whole.compare(0, 17, "LAYER:1\nXY:-7 993") == 0);
+  CHECK(text(true) == whole);
+}
+
+///////////////////////////////////////////
+
+TextElementWriter::TextElementWriter(IO::Writer& out, TextDialect dialect)
+  : _out(out), _dialect(dialect)
+{}
+
+template<std::size_t N>
+void TextElementWriter::_int(const char (&tag)[N], int64_t value)
+{
+  _out.write(tag);
+  _out.put(':');
+  _out.write_int(value);
+  _out.put('\n');
+}
+
+void TextElementWriter::begin_structure(const std::string& name)
+{
+  _out.write("STRNAME:");
+  _out.write(name);
+  _out.put('\n');
+}
+
+void TextElementWriter::end_structure()
+{
+  _out.write("ENDSTR\n");
+}
+
+void TextElementWriter::element(const Element& element)
+{
+  switch (element.kind) {
+    case ElementKind::boundary: {
+      _out.write("BOUNDARY\n");
+      _int("LAYER", element.layer);
+      _int("DATATYPE", element.datatype);
+      break;
+    }
+    case ElementKind::path: {
+      _out.write("PATH\n");
+      _int("LAYER", element.layer);
+      _int("DATATYPE", element.datatype);
+      _int("PATHTYPE", element.pathtype);
+      _int("WIDTH", element.width);
+      break;
+    }
+    case ElementKind::box: {
+      _out.write("BOX\n");
+      _int("LAYER", element.layer);
+      _int("BOXTYPE", element.datatype);
+      break;
+    }
+    default:
+      return;
+  }
+
+  if (_dialect == TextDialect::compact) {
+    write_compact_points(element.xy, _out);
+  } else {
+    _out.write("XY");
+    for (std::size_t i = 0; i < element.xy.size(); ++i) {
+      _out.put(i == 0 ? ':' : ' ');
+      _out.write_int(element.xy[i].x);
+      _out.put(' ');
+      _out.write_int(element.xy[i].y);
+    }
+    _out.put('\n');
+  }
+  _out.write("ENDEL\n");
+}
+
+}
@@ -0,0 +1,40 @@
+#ifndef __TEXT__FORMAT__H__
+#define __TEXT__FORMAT__H__
+
+#include "Reader.hpp"
+#include "Writer.hpp"
+#include "Element.hpp"
+#include "Dialect.hpp"
+#include "Codec.hpp"
+
+namespace GDSTXT {
+
+// same line StreamRecord::to_text() gives, formatted straight into the
+// writer buffer without temporary strings, newline included
+void write_record_text(const IO::RecordView& record, IO::Writer& out);
+
+// the same line built piece by piece through stream, formatted in slices
+// that fit the writer buffer, so neither side holds the whole record
+void write_record_piece(const IO::RecordPiece& piece, RecordTextStream& stream, IO::Writer& out);
+
+// decoded BOUNDARY/PATH/BOX back to text lines, the element records in
+// the order GDS puts them, other kinds are skipped; begin_structure and
+// end_structure give STRNAME and ENDSTR, BGNSTR is up to the caller
+class TextElementWriter: public ElementHandler {
+  public:
+    explicit TextElementWriter(IO::Writer& out, TextDialect dialect = TextDialect::plain);
+    void begin_structure(const std::string& name) override;
+    void element(const Element& element) override;
+    void end_structure() override;
+  private:
+    // "TAG:value" line
+    template<std::size_t N>
+    void _int(const char (&tag)[N], int64_t value);
+
+    IO::Writer& _out;
+    TextDialect _dialect;
+};
+
+}
+
+#endif //__TEXT__FORMAT__H__
@@ -0,0 +1,215 @@
+#include "ThreadPool.hpp"
+#include "Numa.hpp"
+#include "test_config.h"
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+namespace GDSTXT {
+
+namespace {
+
+// worker index of the calling thread in the pool it belongs to
+thread_local const ThreadPool* _current_pool = nullptr;
+thread_local unsigned _current_worker = 0;
+
+}
+
+ThreadPool::ThreadPool(unsigned threads, Placement placement)
+  : _nodes(std::max(threads, 1u), 0), _pinned(false), _queued(0), _pending(0), _next(0), _stop(false)
+{
+  threads = std::max(threads, 1u);
+  std::vector<std::vector<unsigned>> nodes;
+  if (placement == Placement::numa)
+    nodes = numa_nodes();
+  _pinned = nodes.size() > 1;
+  for (unsigned i = 0; i < threads; ++i) {
+    _queues.emplace_back(new Queue);
+    if (_pinned)
+      _nodes[i] = static_cast<unsigned>(static_cast<std::size_t>(i) * nodes.size() / threads);
+  }
+  for (unsigned i = 0; i < threads; ++i) {
+    std::vector<unsigned> cpus;
+    if (_pinned)
+      cpus = nodes[_nodes[i]];
+    _threads.emplace_back([this, i, cpus]() {
+      // an unpinned worker still runs, only slower across nodes
+      if (!cpus.empty())
+        pin_thread(cpus);
+      _run(i);
+    });
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _work.notify_all();
+  for (auto& thread : _threads)
+    thread.join();
+}
+
+void ThreadPool::submit(Task task)
+{
+  auto worker = _current_pool == this
+    ? _current_worker
+    : _next.fetch_add(1) % size();
+  submit(worker, std::move(task));
+}
+
+void ThreadPool::submit(unsigned worker, Task task)
+{
+  worker %= size();
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    ++_pending;
+  }
+  {
+    std::lock_guard<std::mutex> lock(_queues[worker]->mutex);
+    _queues[worker]->tasks.push_back(std::move(task));
+  }
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    ++_queued;
+  }
+  _work.notify_one();
+}
+
+void ThreadPool::submit_largest_first(const std::vector<uint64_t>& sizes,
+                                      const std::function<Task(std::size_t)>& make_task,
+                                      const std::function<unsigned(std::size_t)>& owner)
+{
+  std::vector<std::size_t> order(sizes.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(),
+                   [&sizes](std::size_t l, std::size_t r) { return sizes[l] < sizes[r]; });
+  for (auto i : order) {
+    if (owner)
+      submit(owner(i), make_task(i));
+    else
+      submit(make_task(i));
+  }
+}
+
+void ThreadPool::wait()
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  _idle.wait(lock, [this]() { return _pending == 0; });
+  if (_error) {
+    auto error = _error;
+    _error = nullptr;
+    std::rethrow_exception(error);
+  }
+}
+
+bool ThreadPool::_take(unsigned worker, Task& task)
+{
+  {
+    auto& own = *_queues[worker];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      --_queued;
+      return true;
+    }
+  }
+  for (unsigned i = 1; i < size(); ++i) {
+    auto& other = *_queues[(worker + i) % size()];
+    std::lock_guard<std::mutex> lock(other.mutex);
+    if (!other.tasks.empty()) {
+      task = std::move(other.tasks.front());
+      other.tasks.pop_front();
+      --_queued;
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::_run(unsigned worker)
+{
+  _current_pool = this;
+  _current_worker = worker;
+  Task task;
+  while (true) {
+    if (_take(worker, task)) {
+      std::exception_ptr error;
+      try {
+        task(worker);
+      } catch (...) {
+        error = std::current_exception();
+      }
+      task = nullptr;
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (error && !_error)
+        _error = error;
+      if (--_pending == 0)
+        _idle.notify_all();
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(_mutex);
+    _work.wait(lock, [this]() { return _stop || _queued > 0; });
+    if (_stop && _queued <= 0)
+      return;
+  }
+}
+
+TEST_CASE("testing ThreadPool") {
+  ThreadPool pool(3);
+  std::vector<std::atomic<int>> runs(64);
+  for (auto& count : runs)
+    count = 0;
+
+  SUBCASE("tasks submitted from tasks run before wait returns") {
+    for (std::size_t i = 0; i < 32; ++i) {
+      pool.submit([&runs, &pool, i](unsigned) {
+        ++runs[i];
+        pool.submit([&runs, i](unsigned worker) {
+          CHECK(worker < 3);
+          ++runs[i + 32];
+        });
+      });
+    }
+    pool.wait();
+    for (auto& count : runs)
+      CHECK(count == 1);
+  }
+  SUBCASE("the first exception comes out of wait and the pool stays usable") {
+    pool.submit([](unsigned) { throw std::runtime_error("task failed"); });
+    pool.submit([&runs](unsigned) { ++runs[0]; });
+    CHECK_THROWS_AS(pool.wait(), std::runtime_error);
+    CHECK(runs[0] == 1);
+    pool.submit([&runs](unsigned) { ++runs[1]; });
+    pool.wait();
+    CHECK(runs[1] == 1);
+  }
+  SUBCASE("largest first submission runs the largest item first") {
+    ThreadPool single(1);
+    std::vector<std::size_t> order;
+    // queued from inside a task, so nothing runs before all are queued
+    single.submit([&single, &order](unsigned) {
+      single.submit_largest_first({3, 1, 2, 3}, [&order](std::size_t i) -> ThreadPool::Task {
+        return [&order, i](unsigned) { order.push_back(i); };
+      });
+    });
+    single.wait();
+    CHECK(order == std::vector<std::size_t> {3, 0, 2, 1});
+  }
+  SUBCASE("tasks queued on a worker run there unless stolen") {
+    ThreadPool placed(2, ThreadPool::Placement::numa);
+    for (unsigned i = 0; i < 2; ++i)
+      CHECK(placed.node(i) < numa_nodes().size());
+    CHECK(placed.pinned() == (numa_nodes().size() > 1));
+    for (std::size_t i = 0; i < 16; ++i)
+      placed.submit(static_cast<unsigned>(i % 2), [&runs, i](unsigned) { ++runs[i]; });
+    placed.wait();
+    for (std::size_t i = 0; i < 16; ++i)
+      CHECK(runs[i] == 1);
+  }
+}
+
+}
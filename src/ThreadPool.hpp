@@ -0,0 +1,83 @@
+#ifndef __THREAD__POOL__H__
+#define __THREAD__POOL__H__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Parallel.hpp"
+
+namespace GDSTXT {
+
+// Long lived workers with one task deque each. A worker runs tasks from
+// the back of its own deque and, once that is empty, steals from the
+// front of the others', so work queued unevenly still keeps every worker
+// busy. Tasks get the index of the worker running them, for per-worker
+// scratch buffers that live as long as the pool.
+//
+// With numa placement the workers are spread over the NUMA nodes in
+// blocks, worker i on node i * nodes / threads, each pinned to the CPUs of
+// its node. Memory a worker touches first then comes from its own node;
+// on a single node nothing is pinned.
+class ThreadPool {
+  public:
+    using Task = std::function<void(unsigned worker)>;
+    enum class Placement {
+      any,
+      numa
+    };
+
+    explicit ThreadPool(unsigned threads = default_thread_count(), Placement placement = Placement::any);
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool();
+    unsigned size() const noexcept { return static_cast<unsigned>(_threads.size()); }
+    // node the worker runs on, 0 unless placed on several nodes
+    unsigned node(unsigned worker) const noexcept { return _nodes[worker]; }
+    bool pinned() const noexcept { return _pinned; }
+    // queue on the calling worker's own deque from inside a task, round
+    // robin over the deques otherwise
+    void submit(Task task);
+    // queue on worker's deque, for tasks whose memory that worker touched
+    void submit(unsigned worker, Task task);
+    // queues make_task(i) for every item i, smallest sizes[i] first, so
+    // each worker starts on the largest items of its deque and steals the
+    // small ones left at the end; with owner, on worker owner(i)'s deque
+    void submit_largest_first(const std::vector<uint64_t>& sizes, const std::function<Task(std::size_t)>& make_task,
+                              const std::function<unsigned(std::size_t)>& owner = nullptr);
+    // until every submitted task has run, rethrows the first exception
+    // a task let out
+    void wait();
+  private:
+    struct Queue {
+      std::mutex mutex;
+      std::deque<Task> tasks;
+    };
+    bool _take(unsigned worker, Task& task);
+    void _run(unsigned worker);
+
+    std::vector<unsigned> _nodes;
+    bool _pinned;
+    std::vector<std::unique_ptr<Queue>> _queues;
+    std::vector<std::thread> _threads;
+    std::mutex _mutex;
+    std::condition_variable _work;
+    std::condition_variable _idle;
+    // tasks in the deques, may dip below zero while a submit is under way
+    std::atomic<long> _queued;
+    // tasks submitted and not finished yet
+    std::size_t _pending;
+    std::atomic<unsigned> _next;
+    bool _stop;
+    std::exception_ptr _error;
+};
+
+}
+
+#endif //__THREAD__POOL__H__
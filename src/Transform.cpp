@@ -0,0 +1,129 @@
+#include "Transform.hpp"
+#include "test_config.h"
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace GDSTXT {
+
+namespace {
+
+// exact values on multiples of 90 degrees keep Manhattan cells on grid
+void _cos_sin(double angle, double& cos_value, double& sin_value)
+{
+  auto quarter = angle / 90.0;
+  if (quarter == std::floor(quarter)) {
+    static const double table[4][2] {{1, 0}, {0, 1}, {-1, 0}, {0, -1}};
+    auto index = ((static_cast<long long>(quarter) % 4) + 4) % 4;
+    cos_value = table[index][0];
+    sin_value = table[index][1];
+    return;
+  }
+  auto radian = angle * std::acos(-1.0) / 180.0;
+  cos_value = std::cos(radian);
+  sin_value = std::sin(radian);
+}
+
+int32_t _round(double value) noexcept
+{
+  auto rounded = std::llround(value);
+  if (rounded > std::numeric_limits<int32_t>::max())
+    return std::numeric_limits<int32_t>::max();
+  if (rounded < std::numeric_limits<int32_t>::min())
+    return std::numeric_limits<int32_t>::min();
+  return static_cast<int32_t>(rounded);
+}
+
+}
+
+Transform Transform::placement(const Element& reference, Point origin)
+{
+  double cos_value, sin_value;
+  _cos_sin(reference.angle, cos_value, sin_value);
+  double mag = reference.mag;
+  double flip = (reference.strans & 0x8000) ? -1.0 : 1.0;
+
+  Transform ret;
+  ret.a = mag * cos_value;
+  ret.b = -mag * sin_value * flip;
+  ret.c = mag * sin_value;
+  ret.d = mag * cos_value * flip;
+  ret.tx = origin.x;
+  ret.ty = origin.y;
+  return ret;
+}
+
+Transform Transform::operator*(const Transform& inner) const noexcept
+{
+  Transform ret;
+  ret.a = a * inner.a + b * inner.c;
+  ret.b = a * inner.b + b * inner.d;
+  ret.c = c * inner.a + d * inner.c;
+  ret.d = c * inner.b + d * inner.d;
+  ret.tx = a * inner.tx + b * inner.ty + tx;
+  ret.ty = c * inner.tx + d * inner.ty + ty;
+  return ret;
+}
+
+Point Transform::apply(Point point) const noexcept
+{
+  return Point {
+    _round(a * point.x + b * point.y + tx),
+    _round(c * point.x + d * point.y + ty)
+  };
+}
+
+Transform Transform::inverse() const
+{
+  auto det = a * d - b * c;
+  if (det == 0.0)
+    throw std::runtime_error("placement with zero magnification can't be inverted");
+  Transform ret;
+  ret.a = d / det;
+  ret.b = -b / det;
+  ret.c = -c / det;
+  ret.d = a / det;
+  ret.tx = -(ret.a * tx + ret.b * ty);
+  ret.ty = -(ret.c * tx + ret.d * ty);
+  return ret;
+}
+
+double Transform::scale() const noexcept
+{
+  return std::sqrt(std::fabs(a * d - b * c));
+}
+
+TEST_CASE("testing Transform") {
+  Element reference;
+  reference.reset(ElementKind::sref);
+  SUBCASE("rotate 90 then move") {
+    reference.angle = 90;
+    auto t = Transform::placement(reference, Point {10, 0});
+    auto p = t.apply(Point {1, 0});
+    CHECK(p.x == 10);
+    CHECK(p.y == 1);
+  }
+  SUBCASE("reflect happens before rotation") {
+    reference.strans = 0x8000;
+    reference.angle = 90;
+    auto p = Transform::placement(reference, Point {0, 0}).apply(Point {0, 1});
+    CHECK(p.x == 1);
+    CHECK(p.y == 0);
+  }
+  SUBCASE("composition applies the inner placement first") {
+    reference.mag = 2;
+    auto outer = Transform::placement(reference, Point {100, 0});
+    reference.mag = 1;
+    reference.angle = 180;
+    auto inner = Transform::placement(reference, Point {5, 5});
+    auto p = (outer * inner).apply(Point {1, 0});
+    CHECK(p.x == 108);
+    CHECK(p.y == 10);
+    CHECK((outer * inner).scale() == 2.0);
+    auto back = (outer * inner).inverse().apply(p);
+    CHECK(back.x == 1);
+    CHECK(back.y == 0);
+  }
+}
+
+}
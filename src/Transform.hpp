@@ -0,0 +1,32 @@
+#ifndef __TRANSFORM__H__
+#define __TRANSFORM__H__
+
+#include <cstdint>
+#include "Element.hpp"
+
+namespace GDSTXT {
+
+// affine placement x' = a*x + b*y + tx, y' = c*x + d*y + ty
+struct Transform {
+  double a = 1.0;
+  double b = 0.0;
+  double c = 0.0;
+  double d = 1.0;
+  double tx = 0.0;
+  double ty = 0.0;
+
+  // SREF/AREF placement at origin: reflect about x axis when STRANS
+  // bit 0x8000 is set, then MAG, then rotate by ANGLE degrees, then move
+  static Transform placement(const Element& reference, Point origin);
+  // this applied after inner
+  Transform operator*(const Transform& inner) const noexcept;
+  Point apply(Point point) const noexcept;
+  // undoes this placement, throws when it is singular
+  Transform inverse() const;
+  // length scale, for path widths
+  double scale() const noexcept;
+};
+
+}
+
+#endif //__TRANSFORM__H__
@@ -0,0 +1,345 @@
+#include "Validate.hpp"
+#include "SPEC.hpp"
+#include "convert_func.hpp"
+#include "test_config.h"
+#include "test_fixtures.h"
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace GDSTXT {
+
+namespace {
+
+enum class Kind : unsigned char {
+  unknown,
+  library,
+  element_begin,
+  element_body,
+  other
+};
+
+struct TagInfo {
+  Kind kind = Kind::unknown;
+  // 0xff when SPEC leaves it open
+  unsigned char data_type = 0xff;
+  const char* name = "";
+};
+
+// SPEC::tag_specs by tag byte, UNKNOW left out
+struct TagTable {
+  TagInfo tags[256];
+  TagTable()
+  {
+    for (std::size_t tag = 0; tag + 1 < SPEC::tag_count; ++tag) {
+      auto& info = tags[tag];
+      info.kind = Kind::other;
+      info.data_type = SPEC::tag_specs[tag].data_type;
+      info.name = SPEC::tag_specs[tag].name;
+    }
+    for (auto tag : {SPEC::Tag::HEADER, SPEC::Tag::BGNLIB, SPEC::Tag::ENDLIB,
+                     SPEC::Tag::BGNSTR, SPEC::Tag::STRNAME, SPEC::Tag::ENDSTR})
+      tags[static_cast<unsigned char>(tag)].kind = Kind::library;
+    for (auto tag : {SPEC::Tag::BOUNDARY, SPEC::Tag::PATH, SPEC::Tag::SREF, SPEC::Tag::AREF,
+                     SPEC::Tag::TEXT, SPEC::Tag::NODE, SPEC::Tag::BOX})
+      tags[static_cast<unsigned char>(tag)].kind = Kind::element_begin;
+    for (auto tag : {SPEC::Tag::LAYER, SPEC::Tag::DATATYPE, SPEC::Tag::WIDTH, SPEC::Tag::XY,
+                     SPEC::Tag::ENDEL, SPEC::Tag::SNAME, SPEC::Tag::COLROW, SPEC::Tag::TEXTTYPE,
+                     SPEC::Tag::PRESENTATION, SPEC::Tag::STRING, SPEC::Tag::STRANS, SPEC::Tag::MAG,
+                     SPEC::Tag::ANGLE, SPEC::Tag::PATHTYPE, SPEC::Tag::ELFLAGS, SPEC::Tag::NODETYPE,
+                     SPEC::Tag::PROPATTR, SPEC::Tag::PROPVALUE, SPEC::Tag::BOXTYPE, SPEC::Tag::PLEX})
+      tags[static_cast<unsigned char>(tag)].kind = Kind::element_body;
+    // BGNEXTN, ENDEXTN
+    tags[0x30].kind = Kind::element_body;
+    tags[0x31].kind = Kind::element_body;
+  }
+};
+
+const TagTable& _table()
+{
+  static const TagTable table;
+  return table;
+}
+
+bool _body_fits(unsigned char data_type, std::size_t size) noexcept
+{
+  switch (static_cast<SPEC::TagDataType>(data_type)) {
+    case SPEC::TagDataType::NODATA:
+      return size == 0;
+    case SPEC::TagDataType::BITARRAY:
+      return size == 2;
+    case SPEC::TagDataType::INTEGER_2:
+      return size % 2 == 0;
+    case SPEC::TagDataType::INTEGER_4:
+    case SPEC::TagDataType::REAL_4:
+      return size % 4 == 0;
+    case SPEC::TagDataType::REAL_8:
+      return size % 8 == 0;
+    case SPEC::TagDataType::ASCII:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// why the header at offset cannot start a record, nullptr if it can
+const char* _bad_header(const unsigned char* data, std::size_t size, uint64_t offset) noexcept
+{
+  if (size - offset < 4)
+    return "record header is truncated";
+  std::size_t length = load_be16(data + offset);
+  if (length < 4)
+    return "record length is corrupted";
+  if (length % 2 != 0)
+    return "record length is odd";
+  if (size - offset < length)
+    return "record runs past the end of the file";
+  if (_table().tags[data[offset + 2]].kind == Kind::unknown)
+    return "unknown record tag";
+  return nullptr;
+}
+
+// stricter than _bad_header, used to pick a resync point
+bool _plausible(const unsigned char* data, std::size_t size, uint64_t offset) noexcept
+{
+  if (_bad_header(data, size, offset) != nullptr)
+    return false;
+  const auto& info = _table().tags[data[offset + 2]];
+  auto data_type = data[offset + 3];
+  return (info.data_type == 0xff || info.data_type == data_type)
+         && _body_fits(data_type, load_be16(data + offset) - 4);
+}
+
+uint64_t _resync(const unsigned char* data, std::size_t size, uint64_t offset) noexcept
+{
+  for (++offset; offset + 4 <= size; ++offset) {
+    if (!_plausible(data, size, offset))
+      continue;
+    auto next = offset + load_be16(data + offset);
+    if (next == size || _plausible(data, size, next))
+      return offset;
+  }
+  return size;
+}
+
+std::string _hex(unsigned value)
+{
+  const char* digits = "0123456789abcdef";
+  return std::string("0x") + digits[value >> 4 & 0xf] + digits[value & 0xf];
+}
+
+std::string _name(const unsigned char* body, std::size_t size)
+{
+  auto end = std::find(body, body + size, '\0');
+  return std::string(body, end);
+}
+
+}
+
+std::vector<ValidationIssue> validate_gds(const unsigned char* data, std::size_t size, std::size_t max_issues)
+{
+  enum class State { library, structure, element, done };
+
+  std::vector<ValidationIssue> issues;
+  bool full = false;
+  // appended after sorting, it has to stay last
+  uint64_t stopped = 0;
+  auto issue = [&](uint64_t offset, std::string message) {
+    if (issues.size() + 1 >= max_issues) {
+      stopped = offset;
+      full = true;
+      return;
+    }
+    issues.push_back(ValidationIssue {offset, std::move(message)});
+  };
+
+  const auto& table = _table();
+  std::unordered_set<std::string> defined;
+  // first offset every referenced name was seen at
+  std::unordered_map<std::string, uint64_t> referenced;
+  auto state = State::library;
+  std::string structure;
+  uint64_t structure_offset = 0;
+  uint64_t offset = 0;
+
+  if (size == 0)
+    issue(0, "file is empty");
+  while (offset < size && !full) {
+    if (state == State::done) {
+      // tape style files pad the last block with zeros
+      if (std::any_of(data + offset, data + size, [](unsigned char byte) { return byte != 0; }))
+        issue(offset, std::to_string(size - offset) + " bytes after ENDLIB");
+      break;
+    }
+
+    auto problem = _bad_header(data, size, offset);
+    if (problem != nullptr) {
+      auto next = _resync(data, size, offset);
+      std::string message(problem);
+      if (size - offset >= 4)
+        message += " (length " + std::to_string(load_be16(data + offset)) + ", tag " + _hex(data[offset + 2]) + ")";
+      if (next == size)
+        message += ", no record found after it";
+      else
+        message += ", skipped " + std::to_string(next - offset) + " bytes";
+      issue(offset, std::move(message));
+      offset = next;
+      continue;
+    }
+
+    auto first = data + offset;
+    std::size_t length = load_be16(first);
+    auto tag = first[2];
+    auto data_type = first[3];
+    auto body = first + 4;
+    auto body_size = length - 4;
+    const auto& info = table.tags[tag];
+
+    if (info.data_type != 0xff && info.data_type != data_type)
+      issue(offset, std::string(info.name) + " has data type " + _hex(data_type)
+                      + ", expected " + _hex(info.data_type));
+    else if (!_body_fits(data_type, body_size))
+      issue(offset, std::string(info.name) + " body of " + std::to_string(body_size)
+                      + " bytes does not fit data type " + _hex(data_type));
+
+    switch (info.kind) {
+      case Kind::element_begin:
+        if (state == State::element)
+          issue(offset, std::string(info.name) + " inside an element, ENDEL missing");
+        else if (state != State::structure)
+          issue(offset, std::string(info.name) + " outside a structure");
+        state = State::element;
+        break;
+      case Kind::element_body:
+        if (tag == static_cast<unsigned char>(SPEC::Tag::ENDEL)) {
+          if (state != State::element)
+            issue(offset, "ENDEL without an element");
+          else
+            state = State::structure;
+        } else if (state != State::element) {
+          issue(offset, std::string(info.name) + " outside an element");
+        }
+        if (tag == static_cast<unsigned char>(SPEC::Tag::SNAME))
+          referenced.emplace(_name(body, body_size), offset);
+        break;
+      case Kind::library:
+        switch (static_cast<SPEC::Tag>(tag)) {
+          case SPEC::Tag::HEADER:
+          case SPEC::Tag::BGNLIB:
+            if (state != State::library || defined.size() != 0)
+              issue(offset, std::string(info.name) + " after the first structure");
+            break;
+          case SPEC::Tag::BGNSTR:
+            if (state != State::library)
+              issue(offset, "BGNSTR inside structure " + structure + ", ENDSTR missing");
+            state = State::structure;
+            structure.clear();
+            structure_offset = offset;
+            break;
+          case SPEC::Tag::STRNAME:
+            if (state != State::structure || !structure.empty()) {
+              issue(offset, "STRNAME outside BGNSTR");
+              break;
+            }
+            structure = _name(body, body_size);
+            if (!defined.insert(structure).second)
+              issue(offset, "structure " + structure + " is defined twice");
+            break;
+          case SPEC::Tag::ENDSTR:
+            if (state == State::element)
+              issue(offset, "ENDSTR inside an element, ENDEL missing");
+            else if (state != State::structure)
+              issue(offset, "ENDSTR without BGNSTR");
+            state = State::library;
+            break;
+          case SPEC::Tag::ENDLIB:
+            if (state != State::library)
+              issue(offset, "ENDLIB inside structure " + structure + ", ENDSTR missing");
+            state = State::done;
+            break;
+          default:
+            break;
+        }
+        break;
+      default:
+        break;
+    }
+    offset += length;
+  }
+
+  if (!full) {
+    if (state == State::structure || state == State::element)
+      issue(structure_offset, "structure " + structure + " is not closed");
+    if (state != State::done && size != 0)
+      issue(size, "ENDLIB missing");
+    for (const auto& name : referenced) {
+      if (full)
+        break;
+      if (defined.count(name.first) == 0)
+        issue(name.second, "SNAME " + name.first + " names an undefined structure");
+    }
+  }
+  std::stable_sort(issues.begin(), issues.end(),
+                   [](const ValidationIssue& l, const ValidationIssue& r) { return l.offset < r.offset; });
+  if (full)
+    issues.push_back(ValidationIssue {stopped, "too many issues, stopped here"});
+  return issues;
+}
+
+void write_issues(const std::vector<ValidationIssue>& issues, IO::Writer& out)
+{
+  for (const auto& issue : issues) {
+    out.write_int(static_cast<int64_t>(issue.offset));
+    out.write(": ");
+    out.write(issue.message);
+    out.put('\n');
+  }
+}
+
+TEST_CASE("testing validate_gds") {
+  std::vector<unsigned char> gds;
+  test_record(gds, SPEC::Tag::HEADER, SPEC::TagDataType::INTEGER_2, {600});
+  test_record(gds, SPEC::Tag::BGNSTR, SPEC::TagDataType::INTEGER_2, std::vector<int64_t>(12, 0));
+  test_name(gds, SPEC::Tag::STRNAME, "A");
+  test_record(gds, SPEC::Tag::SREF, SPEC::TagDataType::NODATA);
+  test_name(gds, SPEC::Tag::SNAME, "A");
+  test_record(gds, SPEC::Tag::XY, SPEC::TagDataType::INTEGER_4, {0, 0});
+  test_record(gds, SPEC::Tag::ENDEL, SPEC::TagDataType::NODATA);
+  test_record(gds, SPEC::Tag::ENDSTR, SPEC::TagDataType::NODATA);
+  auto tail = gds.size();
+  test_record(gds, SPEC::Tag::ENDLIB, SPEC::TagDataType::NODATA);
+  gds.resize(gds.size() + 6, 0);
+  CHECK(validate_gds(gds.data(), gds.size()).empty());
+
+  // garbage in the middle, a dangling SNAME and a missing ENDEL
+  std::vector<unsigned char> bad(gds.begin(), gds.begin() + tail);
+  auto garbage = bad.size();
+  bad.insert(bad.end(), {0x00, 0x03, 0x99, 0x99, 0x12});
+  test_record(bad, SPEC::Tag::BGNSTR, SPEC::TagDataType::INTEGER_2, std::vector<int64_t>(12, 0));
+  test_name(bad, SPEC::Tag::STRNAME, "B");
+  test_record(bad, SPEC::Tag::SREF, SPEC::TagDataType::NODATA);
+  auto sname = test_name(bad, SPEC::Tag::SNAME, "C");
+  auto layer = test_record(bad, SPEC::Tag::LAYER, SPEC::TagDataType::INTEGER_4, {1});
+  auto endstr = test_record(bad, SPEC::Tag::ENDSTR, SPEC::TagDataType::NODATA);
+  test_record(bad, SPEC::Tag::ENDLIB, SPEC::TagDataType::NODATA);
+
+  auto issues = validate_gds(bad.data(), bad.size());
+  REQUIRE(issues.size() == 4);
+  CHECK(issues[0].offset == garbage);
+  CHECK(issues[0].message == "record length is corrupted (length 3, tag 0x99), skipped 5 bytes");
+  CHECK(issues[1].offset == sname);
+  CHECK(issues[1].message == "SNAME C names an undefined structure");
+  CHECK(issues[2].offset == layer);
+  CHECK(issues[2].message == "LAYER has data type 0x03, expected 0x02");
+  CHECK(issues[3].offset == endstr);
+  CHECK(issues[3].message == "ENDSTR inside an element, ENDEL missing");
+
+  CHECK(validate_gds(bad.data(), bad.size(), 2).back().message == "too many issues, stopped here");
+  // the cap reached in the SNAME pass, at an offset before issues already found
+  auto capped = validate_gds(bad.data(), bad.size(), 4);
+  REQUIRE(capped.size() == 4);
+  CHECK(capped.back().offset == sname);
+  CHECK(capped.back().message == "too many issues, stopped here");
+}
+
+}
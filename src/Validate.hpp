@@ -0,0 +1,32 @@
+#ifndef __VALIDATE__H__
+#define __VALIDATE__H__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "Writer.hpp"
+
+namespace GDSTXT {
+
+struct ValidationIssue {
+  // file offset of the record the problem was found at
+  uint64_t offset;
+  std::string message;
+};
+
+// One pass over a gds image without decoding any values: record lengths,
+// tags and data types against SPEC, body sizes against the data type,
+// BGNSTR/ENDSTR and element/ENDEL nesting, and SNAMEs naming structures
+// that are never defined. After a record header that cannot be right the
+// scan skips ahead to the next offset where two consecutive plausible
+// headers start, so one bad byte costs one issue rather than the rest of
+// the file. At most max_issues are kept, the last one saying so.
+std::vector<ValidationIssue> validate_gds(const unsigned char* data, std::size_t size,
+                                          std::size_t max_issues = 1000);
+
+// "offset: message" per line
+void write_issues(const std::vector<ValidationIssue>& issues, IO::Writer& out);
+
+}
+
+#endif //__VALIDATE__H__
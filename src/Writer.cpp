@@ -1 +1,229 @@
-#include "Record.hpp"
+#include "Writer.hpp"
+#include "test_config.h"
+#include "test_fixtures.h"
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace GDSTXT {
+namespace IO {
+
+constexpr std::size_t Writer::direct_alignment;
+
+Writer::Writer(const std::string& filename, const WriterOptions& options)
+  : _filename(filename), _fd(-1), _open(true), _direct(options.direct),
+    _buffer(nullptr), _capacity(options.buffer_size), _size(0)
+{
+  int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+#ifdef O_DIRECT
+  if (_direct) {
+    _fd = ::open(filename.c_str(), flags | O_DIRECT, 0644);
+  }
+#else
+  _direct = false;
+#endif
+  if (_fd < 0) {
+    // tmpfs and some network filesystems reject O_DIRECT with EINVAL
+    _direct = false;
+    _fd = ::open(filename.c_str(), flags, 0644);
+  }
+  if (_fd < 0) {
+    throw std::runtime_error("failed to open " + filename);
+  }
+
+  _capacity = std::max(_capacity, 2 * direct_alignment);
+  if (_direct)
+    _capacity -= _capacity % direct_alignment;
+
+  try {
+    _sink = make_output(_fd, options.backend, _capacity, options.queue_depth, direct_alignment,
+                        options.huge_pages);
+  } catch (const std::exception&) {
+    ::close(_fd);
+    throw std::runtime_error("failed to allocate output buffer for " + filename);
+  }
+  _buffer = _sink->buffer();
+}
+
+Writer::Writer(std::unique_ptr<OutputSink> sink, std::size_t capacity, const std::string& name,
+               bool direct)
+  : _filename(name), _fd(-1), _open(true), _direct(direct),
+    _sink(std::move(sink)), _buffer(_sink->buffer()), _capacity(capacity), _size(0)
+{
+  if (_direct && _capacity < 2 * direct_alignment)
+    throw std::runtime_error("direct writer " + name + " needs two aligned blocks of buffer");
+  if (_direct)
+    _capacity -= _capacity % direct_alignment;
+}
+
+void Writer::_drain(bool final)
+{
+  if (!_open)
+    return;
+
+  // O_DIRECT only takes whole blocks, the tail moves to the next buffer
+  auto count = _direct ? _size - _size % direct_alignment : _size;
+  if (count > 0) {
+    auto previous = _buffer;
+    _buffer = _sink->submit(count);
+    std::memmove(_buffer, previous + count, _size - count);
+    _size -= count;
+  }
+  if (!final)
+    return;
+
+  if (_size > 0) {
+    // finish the unaligned tail through page cache
+    _sink->finish();
+#ifdef O_DIRECT
+    if (_fd >= 0) {
+      auto flags = ::fcntl(_fd, F_GETFL);
+      ::fcntl(_fd, F_SETFL, flags & ~O_DIRECT);
+    }
+#endif
+    _direct = false;
+    _buffer = _sink->submit(_size);
+    _size = 0;
+  }
+  _sink->finish();
+}
+
+void Writer::flush()
+{
+  _drain(false);
+}
+
+void Writer::close()
+{
+  if (!_open)
+    return;
+  auto fd = _fd;
+  try {
+    _drain(true);
+  } catch (const std::exception&) {
+    _open = false;
+    _fd = -1;
+    if (fd >= 0)
+      ::close(fd);
+    throw;
+  }
+  _open = false;
+  _fd = -1;
+  if (fd >= 0 && ::close(fd) != 0)
+    throw std::runtime_error("failed to close " + _filename);
+}
+
+Writer::~Writer()
+{
+  try {
+    close();
+  } catch (const std::exception&) {
+  }
+  _sink = nullptr;
+}
+
+
+namespace {
+
+// keeps what every submit() handed over and how often finish() ran
+class RecordingSink: public OutputSink {
+  public:
+    RecordingSink(std::vector<char>& data, std::vector<std::size_t>& submits, int& finishes,
+                  std::size_t capacity)
+      : _data(data), _submits(submits), _finishes(finishes), _buffers(2, std::vector<char>(capacity)),
+        _current(0) {}
+    char* buffer() override { return _buffers[_current].data(); }
+    char* submit(std::size_t size) override
+    {
+      _data.insert(_data.end(), buffer(), buffer() + size);
+      _submits.push_back(size);
+      // hand out the other buffer, like a sink with writes in flight
+      _current ^= 1;
+      std::fill(_buffers[_current].begin(), _buffers[_current].end(), '#');
+      return buffer();
+    }
+    void finish() override { ++_finishes; }
+  private:
+    std::vector<char>& _data;
+    std::vector<std::size_t>& _submits;
+    int& _finishes;
+    std::vector<std::vector<char>> _buffers;
+    int _current;
+};
+
+}
+
+TEST_CASE("testing Writer") {
+  std::string expected;
+  for (int i = 0; expected.size() < 30000; ++i)
+    expected += std::string(static_cast<std::size_t>(i % 37 + 1), static_cast<char>('a' + i % 26)) + "\n";
+  auto write_odd_sizes = [&expected](Writer& writer) {
+    for (std::size_t done = 0, step = 1; done < expected.size(); done += step, step = step % 613 + 7)
+      writer.write(expected.data() + done, std::min(step, expected.size() - done));
+  };
+
+  std::vector<char> data;
+  std::vector<std::size_t> submits;
+  int finishes = 0;
+  auto sink = [&](std::size_t capacity) {
+    return std::unique_ptr<OutputSink>(new RecordingSink(data, submits, finishes, capacity));
+  };
+
+  SUBCASE("buffered writes arrive in order") {
+    Writer writer(sink(1000), 1000, "buffered");
+    write_odd_sizes(writer);
+    writer.close();
+    CHECK(std::string(data.begin(), data.end()) == expected);
+    for (auto size : submits)
+      CHECK(size <= 1000);
+    CHECK(finishes == 1);
+    // close() is idempotent
+    writer.close();
+    CHECK(finishes == 1);
+  }
+
+  SUBCASE("direct mode carries the unaligned tail") {
+    Writer writer(sink(3 * Writer::direct_alignment + 100), 3 * Writer::direct_alignment + 100, "direct", true);
+    CHECK(writer.capacity() == 3 * Writer::direct_alignment);
+    CHECK(writer.max_reserve() == 2 * Writer::direct_alignment);
+    write_odd_sizes(writer);
+    writer.flush();
+    auto flushed = data.size();
+    CHECK(flushed % Writer::direct_alignment == 0);
+    CHECK(flushed > expected.size() - Writer::direct_alignment);
+    // the promised room is there right after a drain that kept a tail
+    auto first = writer.reserve(writer.max_reserve());
+    std::fill(first, first + writer.max_reserve(), 'z');
+    writer.commit(writer.max_reserve());
+    writer.close();
+    REQUIRE(submits.size() >= 2);
+    for (std::size_t i = 0; i + 1 < submits.size(); ++i)
+      CHECK(submits[i] % Writer::direct_alignment == 0);
+    CHECK(submits.back() % Writer::direct_alignment != 0);
+    CHECK(std::string(data.begin(), data.end()) == expected + std::string(2 * Writer::direct_alignment, 'z'));
+    CHECK(finishes == 2);
+  }
+
+  SUBCASE("direct file falls back to page cache for the tail") {
+    TestDirectory directory;
+    WriterOptions options;
+    options.buffer_size = 2 * Writer::direct_alignment;
+    options.direct = true;
+    Writer writer(directory.path("direct.txt"), options);
+    write_odd_sizes(writer);
+    writer.close();
+    int fd = ::open(directory.path("direct.txt").c_str(), O_RDONLY | O_CLOEXEC);
+    REQUIRE(fd >= 0);
+    auto input = make_input(fd, IOBackend::sync, 1 << 16, 1);
+    std::vector<unsigned char> text(expected.size() + 1);
+    std::size_t size = 0;
+    while (auto count = input->read(text.data() + size, text.size() - size))
+      size += count;
+    ::close(fd);
+    CHECK(std::string(text.begin(), text.begin() + size) == expected);
+  }
+}
+
+}
+}
@@ -1,31 +1,81 @@
-#include <fstream>
+#ifndef __WRITER__H__
+#define __WRITER__H__
+
 #include <exception>
+#include <stdexcept>
 #include <string>
 #include <deque>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+#include "Backend.hpp"
+#include "Format.hpp"
 
 
 namespace GDSTXT {
 namespace IO {
 
+// buffer_size: bytes staged in memory before one write(2) is issued
+// direct: open with O_DIRECT, buffer and flushes are aligned to
+//         direct_alignment, falls back to page cache if fs refuses it
+// backend/queue_depth: io_uring keeps queue_depth staged buffers being
+//                      written while the next one is filled
+// huge_pages: staged buffers of 2M or more on huge pages
+struct WriterOptions {
+  std::size_t buffer_size = 8 << 20;
+  bool direct = false;
+  IOBackend backend = IOBackend::sync;
+  unsigned queue_depth = 4;
+  bool huge_pages = false;
+};
+
 class Writer {
 public:
-  Writer(const std::string& filename)
-  {
-    _file_stream.open(filename, std::ios::binary);
-    if (!_file_stream) {
-      throw std::runtime_error("failed to open " + filename);
-    }
-  }
+  static constexpr std::size_t direct_alignment = 4096;
+
+  Writer(const std::string& filename, const WriterOptions& options = WriterOptions());
+  // staged bytes go to sink instead of a file, its buffers hold capacity
+  // bytes; name only appears in error messages, direct hands the sink whole
+  // direct_alignment blocks until close() like an O_DIRECT file
+  Writer(std::unique_ptr<OutputSink> sink, std::size_t capacity, const std::string& name,
+         bool direct = false);
+  Writer(const Writer&) = delete;
+  Writer& operator=(const Writer&) = delete;
 
   inline void write(const std::deque<unsigned char>& data);
+  inline void write(const char* data, std::size_t size);
+  inline void write(const std::string& str);
+  template<std::size_t N>
+  inline void write(const char (&literal)[N]);
+  inline void put(char c);
+  inline void write_int(int64_t value);
+  inline void write_real(double value, int precision = 6);
 
-  ~Writer()
-  {
-    _file_stream.close();
-  }
+  // room for size (<= max_reserve()) bytes, fill it and then commit() what was used
+  inline char* reserve(std::size_t size);
+  inline void commit(std::size_t size);
+  std::size_t capacity() const noexcept { return _capacity; }
+  // an O_DIRECT drain keeps up to direct_alignment - 1 tail bytes staged
+  std::size_t max_reserve() const noexcept { return _direct ? _capacity - direct_alignment : _capacity; }
+
+  // push staged bytes to the file, O_DIRECT mode keeps the unaligned tail
+  void flush();
+  // final flush, throws on failure unlike the destructor
+  void close();
+
+  ~Writer();
 
 private:
-  std::ofstream _file_stream;
+  void _drain(bool final);
+
+  std::string _filename;
+  int _fd;
+  bool _open;
+  bool _direct;
+  std::unique_ptr<OutputSink> _sink;
+  char* _buffer;
+  std::size_t _capacity;
+  std::size_t _size;
 };
 
 
@@ -35,14 +85,87 @@ private:
 namespace GDSTXT {
 namespace IO {
 
+inline
+char* Writer::reserve(std::size_t size)
+{
+  if (_capacity - _size < size)
+    _drain(false);
+  return _buffer + _size;
+}
+
+inline
+void Writer::commit(std::size_t size)
+{
+  _size += size;
+}
+
+inline
+void Writer::write(const char* data, std::size_t size)
+{
+  while (size > 0) {
+    if (_size == _capacity)
+      _drain(false);
+    auto chunk = std::min(size, _capacity - _size);
+    std::memcpy(_buffer + _size, data, chunk);
+    _size += chunk;
+    data += chunk;
+    size -= chunk;
+  }
+}
+
 inline
 void Writer::write(const std::deque<unsigned char>& data)
 {
-  if (data.size() > 0) {
-    _file_stream.write(reinterpret_cast<const char*>(&(data[0])), data.size());
+  // deque storage is segmented, copy element-wise rather than from &data[0]
+  auto iter = data.begin();
+  auto left = data.size();
+  while (left > 0) {
+    if (_size == _capacity)
+      _drain(false);
+    auto chunk = std::min(left, _capacity - _size);
+    std::copy(iter, iter + chunk, _buffer + _size);
+    _size += chunk;
+    iter += chunk;
+    left -= chunk;
   }
 }
 
+inline
+void Writer::write(const std::string& str)
+{
+  write(str.data(), str.size());
+}
+
+template<std::size_t N>
+inline
+void Writer::write(const char (&literal)[N])
+{
+  write(literal, N - 1);
+}
+
+inline
+void Writer::put(char c)
+{
+  *reserve(1) = c;
+  ++_size;
+}
 
+inline
+void Writer::write_int(int64_t value)
+{
+  auto first = reserve(max_number_width);
+  _size += format_int(first, value) - first;
+}
+
+inline
+void Writer::write_real(double value, int precision)
+{
+  auto first = reserve(max_number_width);
+  _size += format_real(first, value, precision) - first;
 }
-}
\ No newline at end of file
+
+
+}
+}
+
+#endif //__WRITER__H__
@@ -151,6 +151,12 @@ TEST_CASE("testing char2_to_string") {
 }
 
 
+TEST_CASE("testing suck_data") {
+  CHECK(suck_data<16, 0x01>("65535") == std::deque<unsigned char> {0xff, 0xff});
+  CHECK(suck_data<16, 0x02>("-2") == std::deque<unsigned char> {0xff, 0xfe});
+  CHECK(suck_data<32, 0x03>("258") == std::deque<unsigned char> {0x00, 0x00, 0x01, 0x02});
+}
+
 ///////////////////////////////////////////
 std::deque<unsigned char>
 ascii_to_bit_array(const std::string& str, unsigned char tagname, unsigned char tag_data_type)
@@ -215,33 +221,9 @@ ascii_to_ascii(std::string str, unsigned char tagname, unsigned char tag_data_ty
 inline std::vector<char>
 _str_to_real8(const std::string& str)
 {
-  double value = std::strtod(str.c_str(), nullptr);
-  std::vector<char> bytes(8);
-  bytes[0] = 0;
-
-  if (value < 0) {
-    bytes[0] = 0x80;
-    value = -value;
-  }
-
-  int e = 0;
-  if (value < 1e-77) {
-    value = 0;
-  } else {
-    double lg16 = log(value) / log(16.0);
-    e = int (ceil(log(value) / log(16.0)));
-    if (e == lg16) {
-      ++e;
-    }
-  }
-  value /= pow(16.0, e - 14);
-  bytes[0] |= ((e + 64) & 0x7f);
-  uint64_t m = uint64_t (value + 0.5);
-  for (int i = 7; i > 0; --i) {
-    bytes[i] = (m & 0xff);
-    m = m >> 8;
-  }
-  return std::move(bytes);
+  unsigned char bytes[8];
+  text_to_real8(std::strtod(str.c_str(), nullptr), bytes);
+  return std::vector<char>(bytes, bytes + 8);
 }
 
 std::deque<unsigned char>
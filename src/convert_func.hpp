@@ -12,6 +12,7 @@
 #include <algorithm>
 #include <cmath>
 #include <deque>
+#include "Codec.hpp"
 #include "test_config.h"
 
 namespace GDSTXT {
@@ -67,44 +68,41 @@ std::vector<std::string> str_data_block(const std::string& str)
   return std::move(str_data_vec);
 }
 
-// converter for string to bit_array, int2, int4
+// converter for string to bit_array, int2, int4, specialized per
+// value size N in bits and data type C below
 template<std::size_t N, unsigned char C>
+std::deque<unsigned char> suck_data(std::string data_str);
+
+template<std::size_t N>
 inline
-std::deque<unsigned char> suck_data(std::string data_str)
+std::deque<unsigned char> _bits_to_bytes(const std::bitset<N>& bits)
 {
   std::deque<unsigned char> ret_data;
-  std::string bits_str;
-  switch (N) {
-    case 16: {
-      switch (C) {
-        case 0x01: {
-          bits_str = std::bitset<16>(std::stoul(data_str, nullptr, 10)).to_string();
-          break;
-        }
-        case 0x02: {
-          bits_str = std::bitset<16>(std::stol(data_str, nullptr, 10)).to_string();
-          break;
-        }
-        default: {
-          throw std::runtime_error("2 bytes data only include bit_array and int2");
-        }
-      }
-      break;
-    }
-    case 32: {
-      bits_str = std::bitset<32>(std::stol(data_str, nullptr, 10)).to_string();
-      break;
-    }
-    default: {
-        throw std::runtime_error("only real8 has more than 4 bytes");
-    }
-  };
-  for (int i = 0; i < N/8; ++i) {
-    ret_data.push_back(
-      static_cast<unsigned char>(std::bitset<8>(bits_str,i*8, 8).to_ulong())
-    );
+  for (std::size_t i = N; i > 0; i -= 8) {
+    ret_data.push_back(static_cast<unsigned char>((bits >> (i - 8)).to_ulong() & 0xff));
   }
-  return std::move(ret_data);
+  return ret_data;
+}
+
+template<>
+inline
+std::deque<unsigned char> suck_data<16, 0x01>(std::string data_str)
+{
+  return _bits_to_bytes(std::bitset<16>(std::stoul(data_str, nullptr, 10)));
+}
+
+template<>
+inline
+std::deque<unsigned char> suck_data<16, 0x02>(std::string data_str)
+{
+  return _bits_to_bytes(std::bitset<16>(std::stol(data_str, nullptr, 10)));
+}
+
+template<>
+inline
+std::deque<unsigned char> suck_data<32, 0x03>(std::string data_str)
+{
+  return _bits_to_bytes(std::bitset<32>(std::stol(data_str, nullptr, 10)));
 }
 
 
@@ -0,0 +1,87 @@
+#ifndef __TEST__FIXTURES__H__
+#define __TEST__FIXTURES__H__
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <ftw.h>
+#include "SPEC.hpp"
+
+// Helpers shared by the inline test cases: gds bytes written record by
+// record and a scratch directory for the tests that need real files.
+
+namespace GDSTXT {
+
+// appends a record header for a body of size bytes, returns its offset
+inline std::size_t test_header(std::vector<unsigned char>& gds, SPEC::Tag tag, SPEC::TagDataType type,
+                               std::size_t size)
+{
+  auto offset = gds.size();
+  gds.push_back(static_cast<unsigned char>((4 + size) >> 8));
+  gds.push_back(static_cast<unsigned char>(4 + size));
+  gds.push_back(static_cast<unsigned char>(tag));
+  gds.push_back(static_cast<unsigned char>(type));
+  return offset;
+}
+
+// appends a record of big-endian values as wide as the data type gives,
+// returns its offset
+inline std::size_t test_record(std::vector<unsigned char>& gds, SPEC::Tag tag, SPEC::TagDataType type,
+                               const std::vector<int64_t>& values = {})
+{
+  std::size_t width = 0;
+  if (type == SPEC::TagDataType::BITARRAY || type == SPEC::TagDataType::INTEGER_2)
+    width = 2;
+  else if (type == SPEC::TagDataType::INTEGER_4)
+    width = 4;
+  auto offset = test_header(gds, tag, type, values.size() * width);
+  for (auto value : values) {
+    for (auto i = width; i-- > 0;)
+      gds.push_back(static_cast<unsigned char>(static_cast<uint64_t>(value) >> (i * 8)));
+  }
+  return offset;
+}
+
+// appends an ASCII record, NUL padded to even length
+inline std::size_t test_name(std::vector<unsigned char>& gds, SPEC::Tag tag, const std::string& name)
+{
+  auto offset = test_header(gds, tag, SPEC::TagDataType::ASCII, name.size() + name.size() % 2);
+  gds.insert(gds.end(), name.begin(), name.end());
+  if (name.size() % 2)
+    gds.push_back('\0');
+  return offset;
+}
+
+// a fresh directory under TMPDIR, removed with everything in it
+class TestDirectory {
+  public:
+    TestDirectory()
+    {
+      auto tmp = std::getenv("TMPDIR");
+      std::string pattern = std::string(tmp != nullptr ? tmp : "/tmp") + "/gdstxt_test.XXXXXX";
+      std::vector<char> name(pattern.begin(), pattern.end());
+      name.push_back('\0');
+      if (::mkdtemp(name.data()) == nullptr)
+        throw std::runtime_error("Failed to create " + pattern);
+      _path = name.data();
+    }
+    TestDirectory(const TestDirectory&) = delete;
+    TestDirectory& operator=(const TestDirectory&) = delete;
+    ~TestDirectory()
+    {
+      ::nftw(_path.c_str(), [](const char* path, const struct stat*, int, struct FTW*) {
+        return std::remove(path);
+      }, 16, FTW_DEPTH | FTW_PHYS);
+    }
+    const std::string& path() const noexcept { return _path; }
+    std::string path(const std::string& name) const { return _path + "/" + name; }
+  private:
+    std::string _path;
+};
+
+}
+
+#endif //__TEST__FIXTURES__H__
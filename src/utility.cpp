@@ -1,16 +1,66 @@
+#include <limits>
 #include <string>
 #include <fstream>
 #include <iostream>
 #include <vector>
+#include <cstring>
 #include "../include/cxxopts.hpp"
 #include "Reader.hpp"
 #include "Writer.hpp"
 #include "Record.hpp"
+#include "Codec.hpp"
+#include "LayerExport.hpp"
+#include "TextFormat.hpp"
+#include "JsonLines.hpp"
+#include "Dialect.hpp"
+#include "Library.hpp"
+#include "Flatten.hpp"
+#include "BoundingBox.hpp"
+#include "SpatialIndex.hpp"
+#include "MappedFile.hpp"
+#include "Hash.hpp"
+#include "Diff.hpp"
+#include "Validate.hpp"
+#include "Batch.hpp"
+#include "Server.hpp"
+#include "Cache.hpp"
+#include "Incremental.hpp"
+#include "MemoryBudget.hpp"
+#include "StructureDriver.hpp"
+#include <csignal>
+#include <climits>
+#include <cstdlib>
 
 struct Argument {
     std::string flag;
     std::string input;
     std::string output;
+    bool direct_io;
+    bool io_uring;
+    std::string format;
+    std::string flatten;
+    bool count;
+    bool bbox;
+    std::string diff;
+    bool validate;
+    bool duplicates;
+    bool dedup;
+    bool stats;
+    std::string layer_filter;
+    bool has_window;
+    GDSTXT::Box window;
+    bool batch;
+    std::string serve;
+    std::string client;
+    std::string cache;
+    bool cache_cells;
+    std::string baseline;
+    std::string baseline_text;
+    std::size_t memory_limit;
+    unsigned threads;
+    bool numa;
+    bool huge_pages;
+    bool access_hints;
 };
 
 
@@ -23,6 +73,31 @@ Argument parse_arguments(int& argc, char* argv[])
             ("t,txt2gds", "convert txt to gds", cxxopts::value<bool>())
             ("i,input", "input file", cxxopts::value<std::string>())
             ("o,output", "output file", cxxopts::value<std::string>())
+            ("f,format", "non-gds side format: txt, compact (delta coded XY), bin, jsonl (-g only) or layers (-g only, output is a directory)", cxxopts::value<std::string>())
+            ("flatten", "with -g, write only the given top cell with its hierarchy expanded", cxxopts::value<std::string>())
+            ("count", "with --flatten, only write how many instances and elements the flat cell has", cxxopts::value<bool>())
+            ("bbox", "with -g, write the bounding box of every structure instead of converting", cxxopts::value<bool>())
+            ("diff", "with -g, compare the input against this gds and write added, removed and changed cells; exits with 1 when they differ", cxxopts::value<std::string>())
+            ("validate", "with -g, check record structure and references and write the problems found with their offsets; exits with 1 when there are any", cxxopts::value<bool>())
+            ("duplicates", "with -g, report groups of structures with identical content", cxxopts::value<bool>())
+            ("dedup", "with -g, write a gds without duplicate structures, references go to the first copy", cxxopts::value<bool>())
+            ("stats", "with -g, write element counts, points, own bounding box and content hash of every structure, structures decoded in parallel", cxxopts::value<bool>())
+            ("layer-filter", "with --stats, count only elements on these layers, e.g. 1,5/2 (LAYER or LAYER/DATATYPE); references always count", cxxopts::value<std::string>())
+            ("window", "with -g, keep only elements intersecting x1,y1,x2,y2 (database units), with --flatten in top cell coordinates", cxxopts::value<std::string>())
+            ("batch", "convert many plain text files: -i is a manifest of \"input output\" lines, or a quoted glob with -o an output pattern whose * takes each input's name", cxxopts::value<bool>())
+            ("serve", "answer requests on this Unix socket until interrupted, keeping files mapped and their indexes built between requests", cxxopts::value<std::string>())
+            ("client", "with -g, have the server on this socket answer instead: plain txt, --bbox, --window, --validate or --duplicates", cxxopts::value<std::string>())
+            ("cache", "reuse the output of an earlier run on identical input bytes with the same options, kept in this directory", cxxopts::value<std::string>())
+            ("cache-cells", "with --cache and -g to txt or compact, also cache every structure's text on its own so unchanged cells of an edited file are reused", cxxopts::value<bool>())
+            ("baseline", "with -t, copy every structure whose text is unchanged from this gds instead of encoding it, needs --baseline-text", cxxopts::value<std::string>())
+            ("baseline-text", "the text --baseline was converted to, what the input is compared against", cxxopts::value<std::string>())
+            ("memory-limit", "cap on buffered bytes, e.g. 64M, for plain conversions: -g to txt, compact, jsonl or layers, -t from txt or compact", cxxopts::value<std::string>())
+            ("j,threads", "worker threads, defaults to the number of cores", cxxopts::value<unsigned>())
+            ("numa", "with --stats or --batch, pin workers to NUMA nodes and keep each one's input and buffers on its node", cxxopts::value<bool>())
+            ("huge-pages", "back the input mapping, read and write buffers with 2M pages: hugetlb where reserved, transparent huge pages otherwise", cxxopts::value<bool>())
+            ("access-hints", "tell the kernel how inputs are read: sequential with readahead and page cache dropped behind the parser for conversions, random for --window", cxxopts::value<bool>())
+            ("direct-io", "write output with O_DIRECT, bypassing page cache", cxxopts::value<bool>())
+            ("io-uring", "read and write through io_uring when the kernel allows it", cxxopts::value<bool>())
             ("h,help", "Print help");
 
         if (argc == 1) {
@@ -42,25 +117,209 @@ Argument parse_arguments(int& argc, char* argv[])
             exit(1);
         }
 
+        std::string serve;
+        if (result.count("serve")) {
+            serve = result["serve"].as<std::string>();
+            if (result.count("i") || result.count("o") || result.count("client")) {
+                std::cerr << "\n--serve runs on its own, requests name their files\n" << std::endl;
+                exit(1);
+            }
+        }
+
         std::string input;
         if (result.count("i") == 1) {
             input = result["i"].as<std::string>();
-        } else {
+        } else if (serve.empty()) {
             std::cerr << "\nrequire one and only one input\n" << std::endl;
             exit(1);
         }
 
+        bool batch = result.count("batch") > 0;
+        bool glob = input.find_first_of("*?[") != std::string::npos;
+
         std::string output;
         if (result.count("o") == 1) {
             output = result["o"].as<std::string>();
-        } else {
+            if (batch && !glob) {
+                std::cerr << "\n--batch with a manifest takes the outputs from it, -o is only for a glob input\n" << std::endl;
+                exit(1);
+            }
+        } else if (serve.empty() && (!batch || glob)) {
             std::cerr << "\nrequire one and only one output\n" << std::endl;
             exit(1);
         }
 
         std::string flag = result["g"].as<bool>() ? "gds2txt" : "txt2gds";
 
-        return Argument {flag, input, output};
+        bool direct_io = result.count("direct-io") > 0;
+        bool io_uring = result.count("io-uring") > 0;
+
+        std::string format = "txt";
+        if (result.count("f")) {
+            format = result["f"].as<std::string>();
+        }
+        if (format != "txt" && format != "compact" && format != "bin"
+            && format != "jsonl" && format != "layers") {
+            std::cerr << "\nunknown format " << format << ", expect txt, compact, bin, jsonl or layers\n" << std::endl;
+            exit(1);
+        }
+        if ((format == "jsonl" || format == "layers") && flag != "gds2txt") {
+            std::cerr << "\n" << format << " format can only be written, use it with -g\n" << std::endl;
+            exit(1);
+        }
+
+        std::string flatten;
+        if (result.count("flatten")) {
+            flatten = result["flatten"].as<std::string>();
+            if (flag != "gds2txt" || format == "bin") {
+                std::cerr << "\n--flatten works with -g and txt, compact, jsonl or layers format\n" << std::endl;
+                exit(1);
+            }
+        }
+
+        bool count = result.count("count") > 0;
+        if (count && flatten.empty()) {
+            std::cerr << "\n--count requires --flatten\n" << std::endl;
+            exit(1);
+        }
+
+        bool bbox = result.count("bbox") > 0;
+        if (bbox && (flag != "gds2txt" || !flatten.empty())) {
+            std::cerr << "\n--bbox works with -g and without --flatten\n" << std::endl;
+            exit(1);
+        }
+
+        std::string diff;
+        if (result.count("diff")) {
+            diff = result["diff"].as<std::string>();
+            if (flag != "gds2txt" || bbox || !flatten.empty()) {
+                std::cerr << "\n--diff is a mode of -g on its own\n" << std::endl;
+                exit(1);
+            }
+        }
+
+        bool validate = result.count("validate") > 0;
+        if (validate && (flag != "gds2txt" || bbox || !flatten.empty() || !diff.empty())) {
+            std::cerr << "\n--validate is a mode of -g on its own\n" << std::endl;
+            exit(1);
+        }
+
+        bool duplicates = result.count("duplicates") > 0;
+        bool dedup = result.count("dedup") > 0;
+        if ((duplicates || dedup) && (flag != "gds2txt" || duplicates == dedup || bbox || !flatten.empty())) {
+            std::cerr << "\n--duplicates and --dedup are separate modes of -g\n" << std::endl;
+            exit(1);
+        }
+
+        GDSTXT::Box window;
+        bool has_window = result.count("window") > 0;
+        if (has_window) {
+            if (!GDSTXT::parse_window(result["window"].as<std::string>(), window)) {
+                std::cerr << "\n--window expects x1,y1,x2,y2\n" << std::endl;
+                exit(1);
+            }
+            if (flag != "gds2txt" || format == "bin" || bbox || count) {
+                std::cerr << "\n--window works with -g and txt, compact, jsonl or layers format\n" << std::endl;
+                exit(1);
+            }
+        }
+
+        bool stats = result.count("stats") > 0;
+        if (stats && (flag != "gds2txt" || format != "txt" || bbox || !flatten.empty() || !diff.empty() || validate
+                      || duplicates || dedup || has_window)) {
+            std::cerr << "\n--stats is a mode of -g on its own\n" << std::endl;
+            exit(1);
+        }
+
+        std::string layer_filter;
+        if (result.count("layer-filter")) {
+            layer_filter = result["layer-filter"].as<std::string>();
+            if (!stats) {
+                std::cerr << "\n--layer-filter requires --stats\n" << std::endl;
+                exit(1);
+            }
+            try {
+                GDSTXT::parse_layer_filter(layer_filter);
+            } catch (const std::runtime_error& e) {
+                std::cerr << "\n" << e.what() << "\n" << std::endl;
+                exit(1);
+            }
+        }
+
+        if (batch && (format != "txt" || !flatten.empty() || bbox || !diff.empty() || validate
+                      || duplicates || dedup || stats || has_window)) {
+            std::cerr << "\n--batch converts plain txt files with -g or -t and nothing else\n" << std::endl;
+            exit(1);
+        }
+
+        std::string client;
+        if (result.count("client")) {
+            client = result["client"].as<std::string>();
+            if (flag != "gds2txt" || format != "txt" || !flatten.empty() || !diff.empty() || dedup || stats || batch) {
+                std::cerr << "\n--client asks for plain txt, --bbox, --window, --validate or --duplicates with -g\n" << std::endl;
+                exit(1);
+            }
+        }
+
+        std::string cache;
+        if (result.count("cache")) {
+            cache = result["cache"].as<std::string>();
+            if (!serve.empty() || !client.empty() || batch || !diff.empty() || validate || format == "layers") {
+                std::cerr << "\n--cache works for conversions to one output file\n" << std::endl;
+                exit(1);
+            }
+        }
+
+        bool cache_cells = result.count("cache-cells") > 0;
+        if (cache_cells && (cache.empty() || flag != "gds2txt" || (format != "txt" && format != "compact")
+                            || !flatten.empty() || bbox || has_window || duplicates || dedup)) {
+            std::cerr << "\n--cache-cells works with --cache for -g to txt or compact\n" << std::endl;
+            exit(1);
+        }
+
+        std::string baseline;
+        std::string baseline_text;
+        if (result.count("baseline") || result.count("baseline-text")) {
+            if (!result.count("baseline") || !result.count("baseline-text") || flag != "txt2gds"
+                || format == "bin" || batch || !cache.empty()) {
+                std::cerr << "\n--baseline and --baseline-text go together, with -t from txt or compact\n" << std::endl;
+                exit(1);
+            }
+            baseline = result["baseline"].as<std::string>();
+            baseline_text = result["baseline-text"].as<std::string>();
+        }
+
+        std::size_t memory_limit = 0;
+        if (result.count("memory-limit")) {
+            try {
+                memory_limit = GDSTXT::MemoryBudget::parse(result["memory-limit"].as<std::string>());
+            } catch (const std::runtime_error& e) {
+                std::cerr << "\n" << e.what() << "\n" << std::endl;
+                exit(1);
+            }
+            // the other modes hold a whole library, index or file list
+            if (format == "bin" || !flatten.empty() || bbox || !diff.empty() || validate || duplicates || dedup
+                || stats || has_window || batch || !serve.empty() || !client.empty() || !cache.empty() || !baseline.empty()) {
+                std::cerr << "\n--memory-limit works for plain conversions only\n" << std::endl;
+                exit(1);
+            }
+        }
+
+        unsigned threads = GDSTXT::default_thread_count();
+        if (result.count("j")) {
+            threads = std::max(1u, result["j"].as<unsigned>());
+        }
+
+        bool huge_pages = result.count("huge-pages") > 0;
+        bool access_hints = result.count("access-hints") > 0;
+
+        bool numa = result.count("numa") > 0;
+        if (numa && !stats && !batch) {
+            std::cerr << "\n--numa works with --stats or --batch\n" << std::endl;
+            exit(1);
+        }
+
+        return Argument {flag, input, output, direct_io, io_uring, format, flatten, count, bbox, diff, validate, duplicates, dedup, stats, layer_filter, has_window, window, batch, serve, client, cache, cache_cells, baseline, baseline_text, memory_limit, threads, numa, huge_pages, access_hints};
 
     } catch (const cxxopts::OptionException& e) {
         std::cout << "Error parsing options: " << e.what() << std::endl;
@@ -69,32 +328,647 @@ Argument parse_arguments(int& argc, char* argv[])
 }
 
 
-void run(Argument& arg)
+void convert_bin(
+    Argument& arg,
+    const GDSTXT::IO::ReaderOptions& reader_options,
+    const GDSTXT::IO::WriterOptions& writer_options)
 {
-    std::ofstream output;
+    GDSTXT::IO::RecordView record;
 
     if (arg.flag == "gds2txt") {
-        GDSTXT::IO::Reader gdsfile(arg.input, GDSTXT::IO::Reader::FileType::gds);
-        output.open(arg.output);
-        if (!output) {
-            std::cerr << "Failed to open output file" << std::endl;
-            exit(1);
+        GDSTXT::IO::Reader gdsfile(arg.input, GDSTXT::IO::Reader::FileType::gds, reader_options);
+        GDSTXT::IO::BinaryWriter output(arg.output, writer_options);
+        while (gdsfile.readRecord(record)) {
+            output.append(record.tag, record.data_type, record.body, record.size);
         }
-        while (!gdsfile.is_read_done()) {
-            auto chars = gdsfile.readStream();
-            GDSTXT::StreamRecord record(chars);
-            output << record.to_text() << '\n';
+        output.close();
+        return;
+    }
+
+    GDSTXT::IO::Reader binfile(arg.input, GDSTXT::IO::Reader::FileType::bin, reader_options);
+    GDSTXT::IO::Writer gdsWriter(arg.output, writer_options);
+    while (binfile.readRecord(record)) {
+        unsigned char meta[4];
+        GDSTXT::store_be16(meta, static_cast<uint16_t>(record.size + 4));
+        meta[2] = record.tag;
+        meta[3] = record.data_type;
+        gdsWriter.write(reinterpret_cast<const char*>(meta), 4);
+        gdsWriter.write(reinterpret_cast<const char*>(record.body), record.size);
+    }
+    gdsWriter.close();
+}
+
+
+void export_layers(
+    Argument& arg,
+    const GDSTXT::IO::ReaderOptions& reader_options,
+    const GDSTXT::IO::WriterOptions& writer_options)
+{
+    GDSTXT::IO::Reader gdsfile(arg.input, GDSTXT::IO::Reader::FileType::gds, reader_options);
+    std::size_t columns = 64 << 20;
+    if (arg.memory_limit > 0) {
+        columns = GDSTXT::MemoryBudget(arg.memory_limit).layer_columns();
+    }
+    GDSTXT::LayerExporter exporter(arg.output, columns, writer_options);
+    GDSTXT::ElementDecoder decoder(exporter);
+    GDSTXT::IO::RecordView record;
+    while (gdsfile.readRecord(record)) {
+        decoder.feed(record);
+    }
+    exporter.close();
+}
+
+
+void export_jsonl(
+    Argument& arg,
+    const GDSTXT::IO::ReaderOptions& reader_options,
+    const GDSTXT::IO::WriterOptions& writer_options)
+{
+    GDSTXT::IO::Reader gdsfile(arg.input, GDSTXT::IO::Reader::FileType::gds, reader_options);
+    GDSTXT::IO::Writer output(arg.output, writer_options);
+    GDSTXT::JsonLinesWriter json(output);
+    GDSTXT::ElementDecoder decoder(json);
+    GDSTXT::IO::RecordView record;
+    while (gdsfile.readRecord(record)) {
+        decoder.feed(record);
+    }
+    output.close();
+}
+
+
+void flatten_gds(
+    Argument& arg,
+    const GDSTXT::IO::ReaderOptions& reader_options,
+    const GDSTXT::IO::WriterOptions& writer_options)
+{
+    GDSTXT::IO::Reader gdsfile(arg.input, GDSTXT::IO::Reader::FileType::gds, reader_options);
+    auto library = GDSTXT::Library::load(gdsfile);
+    GDSTXT::Flattener flattener(library, arg.threads);
+    flattener.check(arg.flatten);
+
+    if (arg.count) {
+        auto count = flattener.count(arg.flatten);
+        GDSTXT::IO::Writer output(arg.output, writer_options);
+        output.write("instances:");
+        output.write_int(static_cast<int64_t>(count.instances));
+        output.write("\nelements:");
+        output.write_int(static_cast<int64_t>(count.elements));
+        output.put('\n');
+        output.close();
+        return;
+    }
+
+    if (arg.format == "layers") {
+        GDSTXT::LayerExporter exporter(arg.output);
+        flattener.flatten(arg.flatten, exporter);
+        exporter.close();
+        return;
+    }
+
+    GDSTXT::IO::Writer output(arg.output, writer_options);
+    if (arg.format == "jsonl") {
+        GDSTXT::JsonLinesWriter json(output);
+        json.library(library.name);
+        json.units(library.user_unit, library.database_unit);
+        flattener.flatten(arg.flatten, json);
+        output.close();
+        return;
+    }
+
+    auto dialect = arg.format == "compact" ? GDSTXT::TextDialect::compact : GDSTXT::TextDialect::plain;
+    GDSTXT::write_dialect_header(dialect, output);
+    for (const auto& record : library.header) {
+        GDSTXT::write_record_text(record.view(), output);
+    }
+    GDSTXT::write_record_text(library.find(arg.flatten)->bgnstr.view(), output);
+    GDSTXT::TextElementWriter text(output, dialect);
+    flattener.flatten(arg.flatten, text);
+    output.write("ENDLIB\n");
+    output.close();
+}
+
+
+void report_bbox(
+    Argument& arg,
+    const GDSTXT::IO::ReaderOptions& reader_options,
+    const GDSTXT::IO::WriterOptions& writer_options)
+{
+    GDSTXT::IO::Reader gdsfile(arg.input, GDSTXT::IO::Reader::FileType::gds, reader_options);
+    auto library = GDSTXT::Library::load(gdsfile);
+    auto boxes = GDSTXT::structure_boxes(library, arg.threads);
+
+    // "name x_min y_min x_max y_max" per structure, "name empty" without geometry
+    GDSTXT::IO::Writer output(arg.output, writer_options);
+    for (std::size_t i = 0; i < boxes.size(); ++i) {
+        output.write(library.structures[i].name);
+        if (boxes[i].empty()) {
+            output.write(" empty\n");
+            continue;
+        }
+        for (auto value : {boxes[i].x_min, boxes[i].y_min, boxes[i].x_max, boxes[i].y_max}) {
+            output.put(' ');
+            output.write_int(value);
         }
+        output.put('\n');
+    }
+    output.close();
+}
+
+
+bool compare_gds(Argument& arg, const GDSTXT::IO::WriterOptions& writer_options)
+{
+    GDSTXT::IO::MappedFile old_gds(arg.input, arg.huge_pages);
+    GDSTXT::IO::MappedFile new_gds(arg.diff, arg.huge_pages);
+    GDSTXT::LibraryDiff diff(old_gds.data(), old_gds.size(), new_gds.data(), new_gds.size(), arg.threads);
+    GDSTXT::IO::Writer output(arg.output, writer_options);
+    diff.write_report(output);
+    output.close();
+    return diff.empty();
+}
+
+
+// hint for inputs mapped whole and read front to back
+GDSTXT::IO::AccessHint sequential_hint(const Argument& arg)
+{
+    return arg.access_hints ? GDSTXT::IO::AccessHint::sequential : GDSTXT::IO::AccessHint::none;
+}
+
+
+bool validate_gds(Argument& arg, const GDSTXT::IO::WriterOptions& writer_options)
+{
+    GDSTXT::IO::MappedFile gds(arg.input, arg.huge_pages, sequential_hint(arg));
+    auto issues = GDSTXT::validate_gds(gds.data(), gds.size());
+    GDSTXT::IO::Writer output(arg.output, writer_options);
+    GDSTXT::write_issues(issues, output);
+    output.close();
+    return issues.empty();
+}
+
+
+void deduplicate(Argument& arg, const GDSTXT::IO::WriterOptions& writer_options)
+{
+    GDSTXT::IO::MappedFile gds(arg.input, arg.huge_pages);
+    GDSTXT::StructureHashes hashes(gds.data(), gds.size(), arg.threads);
+    GDSTXT::IO::Writer output(arg.output, writer_options);
+
+    if (arg.dedup) {
+        hashes.write_deduplicated(output);
+        output.close();
         return;
     }
 
-    if(arg.flag == "txt2gds") {
-        GDSTXT::IO::Reader txtfile(arg.input, GDSTXT::IO::Reader::FileType::txt);
-        GDSTXT::IO::Writer gdsWriter(arg.output);
+    hashes.write_duplicate_groups(output);
+    output.close();
+}
+
+
+// every structure decoded on its own worker, largest first, the lines
+// come out in file order
+void structure_stats(Argument& arg, const GDSTXT::IO::WriterOptions& writer_options)
+{
+    GDSTXT::IO::MappedFile gds(arg.input, arg.huge_pages, sequential_hint(arg));
+    GDSTXT::ThreadPool pool(arg.threads, arg.numa ? GDSTXT::ThreadPool::Placement::numa : GDSTXT::ThreadPool::Placement::any);
+    GDSTXT::StructureDriver driver(gds.data(), gds.size(), pool);
+    GDSTXT::LayerFilter filter;
+    if (!arg.layer_filter.empty()) {
+        filter = GDSTXT::parse_layer_filter(arg.layer_filter);
+    }
+    auto stats = GDSTXT::structure_stats(driver, filter);
+    GDSTXT::IO::Writer output(arg.output, writer_options);
+    GDSTXT::write_stats(driver.spans(), stats, output);
+    output.close();
+}
+
+
+// the index sidecar is built on first use and reused while the gds is unchanged
+void window_gds(
+    Argument& arg,
+    const GDSTXT::IO::ReaderOptions& reader_options,
+    const GDSTXT::IO::WriterOptions& writer_options)
+{
+    // the cells are mapped right after the index build, whose pass over
+    // the gds should leave them in the page cache
+    auto index_options = reader_options;
+    index_options.drop_behind = false;
+    auto index = GDSTXT::SpatialIndex::open(arg.input, index_options, arg.threads);
+    // only the cells the index points at are read
+    GDSTXT::IO::MappedFile gds(arg.input, arg.huge_pages,
+                               arg.access_hints ? GDSTXT::IO::AccessHint::random : GDSTXT::IO::AccessHint::none);
+    auto dialect = arg.format == "compact" ? GDSTXT::TextDialect::compact : GDSTXT::TextDialect::plain;
+
+    if (arg.format == "layers") {
+        GDSTXT::LayerExporter exporter(arg.output);
+        if (!arg.flatten.empty()) {
+            GDSTXT::WindowFlattener(index, gds.data(), gds.size()).flatten(arg.flatten, arg.window, exporter);
+        } else {
+            GDSTXT::ElementDecoder decoder(exporter);
+            GDSTXT::for_each_window_record(index, gds.data(), gds.size(), arg.window,
+                [&decoder](const GDSTXT::IO::RecordView& record) { decoder.feed(record); });
+        }
+        exporter.close();
+        return;
+    }
+
+    GDSTXT::IO::Writer output(arg.output, writer_options);
+    if (arg.flatten.empty()) {
+        GDSTXT::JsonLinesWriter json(output);
+        GDSTXT::ElementDecoder decoder(json);
+        GDSTXT::write_dialect_header(dialect, output);
+        GDSTXT::for_each_window_record(index, gds.data(), gds.size(), arg.window,
+            [&](const GDSTXT::IO::RecordView& record) {
+                if (arg.format == "jsonl") {
+                    decoder.feed(record);
+                } else if (dialect == GDSTXT::TextDialect::compact
+                           && record.tag == static_cast<unsigned char>(GDSTXT::SPEC::Tag::XY)) {
+                    GDSTXT::write_compact_xy(record, output);
+                } else {
+                    GDSTXT::write_record_text(record, output);
+                }
+            });
+        output.close();
+        return;
+    }
+
+    auto top = index.index_of(arg.flatten);
+    if (top == GDSTXT::Library::npos) {
+        throw std::runtime_error("structure " + arg.flatten + " is not defined");
+    }
+    GDSTXT::WindowFlattener flattener(index, gds.data(), gds.size());
+    if (arg.format == "jsonl") {
+        GDSTXT::JsonLinesWriter json(output);
+        GDSTXT::ElementDecoder decoder(json);
+        GDSTXT::IO::RecordCursor header(gds.data(), gds.size());
+        GDSTXT::IO::RecordView record;
+        while (header.next(record) && record.tag != static_cast<unsigned char>(GDSTXT::SPEC::Tag::BGNSTR)) {
+            decoder.feed(record);
+        }
+        flattener.flatten(arg.flatten, arg.window, json);
+        output.close();
+        return;
+    }
+
+    GDSTXT::write_dialect_header(dialect, output);
+    GDSTXT::IO::RecordCursor header(gds.data(), gds.size());
+    GDSTXT::IO::RecordView record;
+    while (header.next(record) && record.tag != static_cast<unsigned char>(GDSTXT::SPEC::Tag::BGNSTR)) {
+        if (record.tag != static_cast<unsigned char>(GDSTXT::SPEC::Tag::ENDLIB)) {
+            GDSTXT::write_record_text(record, output);
+        }
+    }
+    GDSTXT::IO::RecordCursor bgnstr(gds.data(), gds.size(), index.cells()[top].begin);
+    bgnstr.next(record);
+    GDSTXT::write_record_text(record, output);
+    GDSTXT::TextElementWriter text(output, dialect);
+    flattener.flatten(arg.flatten, arg.window, text);
+    output.write("ENDLIB\n");
+    output.close();
+}
+
+
+// failures are listed per file, the other files still convert
+bool batch_convert(Argument& arg)
+{
+    bool glob = arg.input.find_first_of("*?[") != std::string::npos;
+    auto jobs = glob ? GDSTXT::glob_jobs(arg.input, arg.output) : GDSTXT::read_manifest(arg.input);
+    if (jobs.empty()) {
+        std::cerr << "no input files for " << arg.input << std::endl;
+        return false;
+    }
+    auto direction = arg.flag == "gds2txt"
+        ? GDSTXT::BatchConverter::Direction::gds2txt
+        : GDSTXT::BatchConverter::Direction::txt2gds;
+    GDSTXT::BatchConverter converter(direction, arg.threads,
+                                     arg.numa ? GDSTXT::ThreadPool::Placement::numa : GDSTXT::ThreadPool::Placement::any);
+    auto errors = converter.run(jobs);
+    bool converted = true;
+    for (std::size_t i = 0; i < jobs.size(); ++i) {
+        if (!errors[i].empty()) {
+            std::cerr << jobs[i].input << ": " << errors[i] << std::endl;
+            converted = false;
+        }
+    }
+    return converted;
+}
+
+
+GDSTXT::Server* serving = nullptr;
+
+extern "C" void stop_serving(int)
+{
+    if (serving != nullptr) {
+        serving->stop();
+    }
+}
+
+
+// SIGINT and SIGTERM let requests under way finish and remove the socket
+void serve(Argument& arg)
+{
+    GDSTXT::Server server(arg.serve, arg.threads);
+    serving = &server;
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = stop_serving;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    server.serve();
+    serving = nullptr;
+}
+
+
+// the same request run by the server, paths absolute since its working
+// directory is not ours
+bool request_server(Argument& arg)
+{
+    char resolved[PATH_MAX];
+    if (::realpath(arg.input.c_str(), resolved) == nullptr) {
+        throw std::runtime_error("Failed to open " + arg.input);
+    }
+    std::string request = "txt\t" + std::string(resolved);
+    if (arg.has_window) {
+        request = "window\t" + std::string(resolved) + "\t"
+            + std::to_string(arg.window.x_min) + "," + std::to_string(arg.window.y_min) + ","
+            + std::to_string(arg.window.x_max) + "," + std::to_string(arg.window.y_max);
+    } else if (arg.bbox) {
+        request = "bbox\t" + std::string(resolved);
+    } else if (arg.validate) {
+        request = "validate\t" + std::string(resolved);
+    } else if (arg.duplicates) {
+        request = "duplicates\t" + std::string(resolved);
+    }
+
+    GDSTXT::IO::Writer output(arg.output);
+    auto outcome = GDSTXT::send_request(arg.client, request, output);
+    output.close();
+    if (outcome.compare(0, 7, "error: ") == 0) {
+        throw std::runtime_error(outcome.substr(7));
+    }
+    return outcome == "ok";
+}
+
+
+// everything that changes the output, the cache key covers it besides
+// the input bytes
+std::string cache_options(const Argument& arg)
+{
+    std::string ret = arg.flag + " " + arg.format + " flatten=" + arg.flatten;
+    if (arg.count) {
+        ret += " count";
+    }
+    if (arg.bbox) {
+        ret += " bbox";
+    }
+    if (arg.has_window) {
+        ret += " window=" + std::to_string(arg.window.x_min) + "," + std::to_string(arg.window.y_min) + ","
+            + std::to_string(arg.window.x_max) + "," + std::to_string(arg.window.y_max);
+    }
+    if (arg.duplicates) {
+        ret += " duplicates";
+    }
+    if (arg.dedup) {
+        ret += " dedup";
+    }
+    if (arg.stats) {
+        ret += " stats layers=" + arg.layer_filter;
+    }
+    return ret;
+}
+
+
+void run(Argument& arg);
+
+// the output is copied from the cache when the same bytes were converted
+// the same way before, otherwise converted and stored for next time
+void cached_run(Argument& arg, const GDSTXT::IO::WriterOptions& writer_options)
+{
+    GDSTXT::ConversionCache cache(arg.cache);
+    GDSTXT::IO::MappedFile input(arg.input);
+    auto key = GDSTXT::ConversionCache::key(input.data(), input.size(), cache_options(arg));
+    {
+        GDSTXT::IO::Writer output(arg.output, writer_options);
+        if (cache.fetch("files", key, output)) {
+            output.close();
+            return;
+        }
+        if (arg.cache_cells) {
+            auto dialect = arg.format == "compact" ? GDSTXT::TextDialect::compact : GDSTXT::TextDialect::plain;
+            GDSTXT::write_text_cached(input.data(), input.size(), dialect, cache, output);
+            output.close();
+        }
+    }
+    if (!arg.cache_cells) {
+        Argument uncached = arg;
+        uncached.cache.clear();
+        run(uncached);
+    }
+    GDSTXT::IO::MappedFile output(arg.output);
+    cache.store("files", key, reinterpret_cast<const char*>(output.data()), output.size());
+}
+
+
+// plain text is converted a batch of lines at a time by the exception
+// free codec, one status check per batch
+void encode_text(
+    Argument& arg,
+    const GDSTXT::IO::ReaderOptions& reader_options,
+    const GDSTXT::IO::WriterOptions& writer_options)
+{
+    // the dialect comes from the header line, whatever -f says
+    auto dialect = GDSTXT::TextDialect::plain;
+    GDSTXT::IO::MappedFile text(arg.input, arg.huge_pages, sequential_hint(arg));
+    auto data = reinterpret_cast<const char*>(text.data());
+    std::size_t size = text.size();
+    std::size_t offset = 0;
+    std::size_t line = 1;
+    if (size >= 9 && std::memcmp(data, "#dialect:", 9) == 0) {
+        auto newline = static_cast<const char*>(std::memchr(data, '\n', size));
+        offset = newline == nullptr ? size : newline - data + 1;
+        dialect = GDSTXT::parse_dialect_header(std::string(data, newline == nullptr ? data + size : newline));
+        line = 2;
+    }
+    bool compact = dialect == GDSTXT::TextDialect::compact;
+
+    GDSTXT::IO::Writer gdsWriter(arg.output, writer_options);
+    if (!arg.baseline.empty()) {
+        GDSTXT::IO::MappedFile baseline_gds(arg.baseline, arg.huge_pages);
+        GDSTXT::IO::MappedFile baseline_text(arg.baseline_text, arg.huge_pages);
+        GDSTXT::encode_incremental(data, size, reinterpret_cast<const char*>(baseline_text.data()), baseline_text.size(),
+                                   baseline_gds.data(), baseline_gds.size(), gdsWriter);
+        gdsWriter.close();
+        return;
+    }
+
+    // a line at a time through the reader's bounded buffer rather than
+    // the whole file mapped
+    if (arg.memory_limit > 0) {
+        GDSTXT::IO::Reader txtfile(arg.input, GDSTXT::IO::Reader::FileType::txt, reader_options);
+        if (line == 2) {
+            txtfile.readText();
+        }
+        std::vector<unsigned char> record;
         while (!txtfile.is_read_done()) {
             auto data = txtfile.readText();
-            GDSTXT::AsciiRecord record(data);
-            gdsWriter.write(record.to_stream());
+            record.clear();
+            auto status = GDSTXT::encode_record(data.data(), data.size(), record, compact);
+            if (status != GDSTXT::Status::ok) {
+                throw std::runtime_error("line " + std::to_string(line) + ": " + GDSTXT::status_message(status));
+            }
+            gdsWriter.write(reinterpret_cast<const char*>(record.data()), record.size());
+            ++line;
+        }
+        gdsWriter.close();
+        return;
+    }
+
+    constexpr std::size_t batch_size = 1 << 20;
+    std::vector<unsigned char> batch;
+    while (offset < size) {
+        // batches end after a newline
+        auto end = size;
+        if (size - offset > batch_size) {
+            auto newline = static_cast<const char*>(std::memchr(data + offset + batch_size, '\n', size - offset - batch_size));
+            end = newline == nullptr ? size : newline - data + 1;
         }
+        batch.clear();
+        auto result = GDSTXT::encode_batch(data + offset, end - offset, batch, compact);
+        gdsWriter.write(reinterpret_cast<const char*>(batch.data()), batch.size());
+        if (result.status != GDSTXT::Status::ok) {
+            throw std::runtime_error("line " + std::to_string(line + result.records) + ": "
+                                     + GDSTXT::status_message(result.status));
+        }
+        line += result.records;
+        offset = end;
+    }
+    gdsWriter.close();
+}
+
+
+void run(Argument& arg)
+{
+    auto backend = arg.io_uring ? GDSTXT::IO::IOBackend::uring : GDSTXT::IO::IOBackend::sync;
+    GDSTXT::IO::ReaderOptions reader_options;
+    reader_options.backend = backend;
+    GDSTXT::IO::WriterOptions writer_options;
+    writer_options.direct = arg.direct_io;
+    writer_options.backend = backend;
+    if (arg.memory_limit > 0) {
+        GDSTXT::MemoryBudget budget(arg.memory_limit);
+        reader_options = budget.reader(backend);
+        writer_options = budget.writer(backend, arg.direct_io);
+    }
+    reader_options.huge_pages = arg.huge_pages;
+    writer_options.huge_pages = arg.huge_pages;
+    if (arg.access_hints) {
+        reader_options.access = GDSTXT::IO::AccessHint::sequential;
+        reader_options.drop_behind = true;
+    }
+
+    if (!arg.serve.empty()) {
+        serve(arg);
+        return;
+    }
+
+    if (!arg.client.empty()) {
+        if (!request_server(arg)) {
+            exit(1);
+        }
+        return;
+    }
+
+    if (!arg.cache.empty()) {
+        cached_run(arg, writer_options);
+        return;
+    }
+
+    if (arg.batch) {
+        if (!batch_convert(arg)) {
+            exit(1);
+        }
+        return;
+    }
+
+    if (!arg.diff.empty()) {
+        if (!compare_gds(arg, writer_options)) {
+            exit(1);
+        }
+        return;
+    }
+
+    if (arg.validate) {
+        if (!validate_gds(arg, writer_options)) {
+            exit(1);
+        }
+        return;
+    }
+
+    if (arg.duplicates || arg.dedup) {
+        deduplicate(arg, writer_options);
+        return;
+    }
+
+    if (arg.stats) {
+        structure_stats(arg, writer_options);
+        return;
+    }
+
+    if (arg.has_window) {
+        window_gds(arg, reader_options, writer_options);
+        return;
+    }
+
+    if (arg.bbox) {
+        report_bbox(arg, reader_options, writer_options);
+        return;
+    }
+
+    if (!arg.flatten.empty()) {
+        flatten_gds(arg, reader_options, writer_options);
+        return;
+    }
+
+    if (arg.format == "layers") {
+        export_layers(arg, reader_options, writer_options);
+        return;
+    }
+
+    if (arg.format == "jsonl") {
+        export_jsonl(arg, reader_options, writer_options);
+        return;
+    }
+
+    if (arg.format == "bin") {
+        convert_bin(arg, reader_options, writer_options);
+        return;
+    }
+
+    if (arg.flag == "gds2txt") {
+        GDSTXT::IO::Reader gdsfile(arg.input, GDSTXT::IO::Reader::FileType::gds, reader_options);
+        GDSTXT::IO::Writer output(arg.output, writer_options);
+        GDSTXT::IO::RecordView record;
+        if (arg.format == "compact") {
+            GDSTXT::write_dialect_header(GDSTXT::TextDialect::compact, output);
+            while (gdsfile.readRecord(record)) {
+                if (record.tag == static_cast<unsigned char>(GDSTXT::SPEC::Tag::XY)) {
+                    GDSTXT::write_compact_xy(record, output);
+                } else {
+                    GDSTXT::write_record_text(record, output);
+                }
+            }
+        } else {
+            // records as they arrive, a long XY is formatted while the
+            // rest of it is still being read
+            GDSTXT::IO::RecordPiece piece;
+            GDSTXT::RecordTextStream stream;
+            while (gdsfile.readPiece(piece)) {
+                GDSTXT::write_record_piece(piece, stream, output);
+            }
+        }
+        output.close();
+        return;
+    }
+
+    if(arg.flag == "txt2gds") {
+        encode_text(arg, reader_options, writer_options);
     }
 }
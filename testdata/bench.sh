@@ -0,0 +1,84 @@
+#!/usr/bin/env bash
+# times conversions of a generated library with and without the memory
+# options, run from testdata after building into ../build
+# usage: ./bench.sh [structures, 200 by default, about 64MB of gds]
+
+structures=${1:-200}
+bin=../build/gds2txt
+work=${TMPDIR:-/tmp}/gds2txt_bench
+mkdir -p $work
+TIMEFORMAT="%R s"
+
+# every structure 5000 boundaries of 5 points and a reference to the previous one
+if [ ! -f $work/bench_$structures.gds ]; then
+	awk -v structures=$structures 'BEGIN {
+		srand(1)
+		print "HEADER:600\nBGNLIB:1 1 1 0 0 0 1 1 1 0 0 0\nLIBNAME:BENCH\nUNITS:0.001 1e-09"
+		for (s = 0; s < structures; s++) {
+			print "BGNSTR:1 1 1 0 0 0 1 1 1 0 0 0\nSTRNAME:C" s
+			for (e = 0; e < 5000; e++) {
+				x = int(rand() * 200000) - 100000; y = int(rand() * 200000) - 100000
+				print "BOUNDARY\nLAYER:" e % 8 "\nDATATYPE:0\nXY:" x " " y " " x " " y + 400 " " x + 300 " " y + 400 " " x + 300 " " y " " x " " y "\nENDEL"
+			}
+			if (s > 0)
+				print "SREF\nSNAME:C" s - 1 "\nXY:0 0\nENDEL"
+			print "ENDSTR"
+		}
+		print "ENDLIB"
+	}' > $work/bench.txt
+	$bin -t -i $work/bench.txt -o $work/bench_$structures.gds || exit 1
+	rm $work/bench.txt
+fi
+gds=$work/bench_$structures.gds
+echo "$gds: `du -h $gds | cut -f1`"
+
+# drops the page cache of the files, clean pages need no root
+drop_cache() {
+	for file in "$@"; do
+		[ -f "$file" ] && dd if="$file" iflag=nocache count=0 status=none
+	done
+}
+
+run() {
+	local name=$1
+	shift
+	# best of three, the first run also warms the page cache unless the
+	# files in $cold are dropped before every run
+	local best=
+	for i in 1 2 3; do
+		drop_cache $cold
+		local took=`{ time $bin "$@" >/dev/null 2>&1; } 2>&1`
+		took=${took% s}
+		if [ -z "$best" ] || awk "BEGIN { exit !($took < $best) }"; then
+			best=$took
+		fi
+	done
+	printf "%-40s %s s\n" "$name" "$best"
+}
+
+run "gds2txt" -g -i $gds -o $work/out.txt
+run "gds2txt --huge-pages" -g -i $gds -o $work/out.txt --huge-pages
+run "txt2gds" -t -i $work/out.txt -o $work/out.gds
+run "txt2gds --huge-pages" -t -i $work/out.txt -o $work/out.gds --huge-pages
+run "--stats" -g -i $gds -o $work/out.stats --stats
+run "--stats --huge-pages" -g -i $gds -o $work/out.stats --stats --huge-pages
+run "--bbox" -g -i $gds -o $work/out.bbox --bbox
+run "--bbox --huge-pages" -g -i $gds -o $work/out.bbox --bbox --huge-pages
+# hints against no hints from the same cold page cache, hinted runs drop
+# their input behind them and would never start warm
+cold=$gds run "gds2txt, cold" -g -i $gds -o $work/out.txt
+cold=$gds run "gds2txt --access-hints, cold" -g -i $gds -o $work/out.txt --access-hints
+cold=$work/out.txt run "txt2gds, cold" -t -i $work/out.txt -o $work/out.gds
+cold=$work/out.txt run "txt2gds --access-hints, cold" -t -i $work/out.txt -o $work/out.gds --access-hints
+cold="$gds $gds.gdsidx" run "--window, cold" -g -i $gds -o $work/out.window --window 0,0,1000,1000
+cold="$gds $gds.gdsidx" run "--window --access-hints, cold" -g -i $gds -o $work/out.window --window 0,0,1000,1000 --access-hints
+
+# what a conversion leaves of its input in the page cache
+if command -v fincore >/dev/null; then
+	cat $gds >/dev/null
+	$bin -g -i $gds -o $work/out.txt
+	echo "page cache after gds2txt:                `fincore -n -o RES $gds`"
+	$bin -g -i $gds -o $work/out.txt --access-hints
+	echo "page cache after gds2txt --access-hints: `fincore -n -o RES $gds`"
+fi
+rm -f $work/out.txt $work/out.gds $work/out.stats $work/out.bbox $work/out.window $gds.gdsidx